@@ -0,0 +1,325 @@
+#include "pch.h"
+#include "LoadGenerator.h"
+
+#include <algorithm>
+#include <random>
+
+#ifndef _WIN32
+#include <netinet/tcp.h>
+#endif
+
+using json = nlohmann::json;
+using bench_clock = std::chrono::steady_clock;
+
+namespace {
+
+enum RequestKind { CATALOG, DESCRIPTION, STREAM, KIND_COUNT };
+const char* const KIND_NAMES[KIND_COUNT] = {"catalog", "description", "stream"};
+
+// Blocking keep-alive HTTP/1.1 client; reconnects after the server closes the connection
+class HttpClient {
+public:
+    HttpClient(const LoadOptions& options) : options(options) {}
+    ~HttpClient() { disconnect(); }
+
+    // Send one request and read the whole response. Returns false on a connection or framing error.
+    // The body is kept in body only if keep_body is set; it is counted and discarded otherwise.
+    bool request(const std::string& request_text, int& status, uint64_t& body_bytes, bool keep_body = false) {
+        if (sock == INVALID_SOCKET && !connectToServer()) {
+            return false;
+        }
+        if (!sendAll(request_text) || !readResponse(status, body_bytes, keep_body)) {
+            disconnect();
+            return false;
+        }
+        if (server_closes) {
+            disconnect();
+        }
+        return true;
+    }
+
+    std::string body;
+    std::string headers;
+
+private:
+    bool connectToServer() {
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(options.port));
+        if (inet_pton(AF_INET, options.host.c_str(), &addr.sin_addr) != 1) {
+            return false;
+        }
+
+        sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (sock == INVALID_SOCKET) {
+            return false;
+        }
+        if (connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == SOCKET_ERROR_CODE) {
+            disconnect();
+            return false;
+        }
+        int nodelay = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&nodelay), sizeof(nodelay));
+        buffer.clear();
+        return true;
+    }
+
+    void disconnect() {
+        if (sock != INVALID_SOCKET) {
+            CLOSE_SOCKET(sock);
+            sock = INVALID_SOCKET;
+        }
+    }
+
+    bool sendAll(const std::string& data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            int result = ::send(sock, data.data() + sent, static_cast<int>(data.size() - sent), MSG_NOSIGNAL);
+            if (result <= 0) {
+                return false;
+            }
+            sent += result;
+        }
+        return true;
+    }
+
+    bool fill() {
+        char chunk[64 * 1024];
+        int received = recv(sock, chunk, sizeof(chunk), 0);
+        if (received <= 0) {
+            return false;
+        }
+        buffer.append(chunk, received);
+        return true;
+    }
+
+    bool readResponse(int& status, uint64_t& body_bytes, bool keep_body) {
+        size_t header_end;
+        while ((header_end = buffer.find("\r\n\r\n")) == std::string::npos) {
+            if (!fill()) {
+                return false;
+            }
+        }
+        headers.assign(buffer, 0, header_end + 4);
+        buffer.erase(0, header_end + 4);
+
+        if (sscanf(headers.c_str(), "HTTP/%*d.%*d %d", &status) != 1) {
+            return false;
+        }
+        uint64_t content_length = 0;
+        std::string lowered = headers;
+        std::transform(lowered.begin(), lowered.end(), lowered.begin(), [](unsigned char c) { return std::tolower(c); });
+        size_t length_pos = lowered.find("\r\ncontent-length:");
+        if (length_pos != std::string::npos) {
+            content_length = std::strtoull(lowered.c_str() + length_pos + 17, nullptr, 10);
+        }
+        server_closes = lowered.find("\r\nconnection: close") != std::string::npos;
+
+        // Every response from the server is Content-Length framed
+        body.clear();
+        uint64_t remaining = content_length;
+        while (true) {
+            size_t take = static_cast<size_t>(std::min<uint64_t>(remaining, buffer.size()));
+            if (keep_body) {
+                body.append(buffer, 0, take);
+            }
+            buffer.erase(0, take);
+            remaining -= take;
+            if (remaining == 0) {
+                break;
+            }
+            if (!fill()) {
+                return false;
+            }
+        }
+        body_bytes = content_length;
+        return true;
+    }
+
+    const LoadOptions& options;
+    socket_t sock = INVALID_SOCKET;
+    std::string buffer;
+    bool server_closes = false;
+};
+
+// Track id plus the byte size of its mp3, learned from a one-byte range request
+struct TrackTarget {
+    std::string path;  // percent-encoded id
+    uint64_t size = 0;
+};
+
+std::string percentEncode(const std::string& value) {
+    static const char hex[] = "0123456789ABCDEF";
+    std::string encoded;
+    for (unsigned char c : value) {
+        if (std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+            encoded += static_cast<char>(c);
+        } else {
+            encoded += '%';
+            encoded += hex[c >> 4];
+            encoded += hex[c & 0xF];
+        }
+    }
+    return encoded;
+}
+
+std::string buildRequest(const LoadOptions& options, const std::string& path, const std::string& extra_headers = "") {
+    return "GET " + path + " HTTP/1.1\r\nHost: " + options.host + ":" + std::to_string(options.port) +
+           "\r\nUser-Agent: server_bench\r\nAccept-Encoding: gzip\r\n" + extra_headers + "\r\n";
+}
+
+// Fetch the catalog and the size of (a sample of) its tracks
+bool discoverTracks(const LoadOptions& options, std::vector<TrackTarget>& targets) {
+    HttpClient client(options);
+    int status = 0;
+    uint64_t bytes = 0;
+    std::string request = "GET /catalog HTTP/1.1\r\nHost: " + options.host + "\r\n\r\n";
+    if (!client.request(request, status, bytes, true) || status != 200) {
+        std::cerr << "Failed to fetch /catalog from " << options.host << ":" << options.port << std::endl;
+        return false;
+    }
+
+    json catalog = json::parse(client.body, nullptr, false);
+    if (!catalog.is_array()) {
+        std::cerr << "/catalog did not return a JSON array" << std::endl;
+        return false;
+    }
+
+    const size_t MAX_TARGETS = 256;
+    for (const json& track : catalog) {
+        if (targets.size() >= MAX_TARGETS) {
+            break;
+        }
+        TrackTarget target;
+        target.path = percentEncode(track.value("id", ""));
+        if (!client.request(buildRequest(options, "/stream/" + target.path, "Range: bytes=0-0\r\n"), status, bytes) ||
+            status != 206) {
+            continue;
+        }
+        size_t slash = client.headers.find("bytes 0-0/");
+        if (slash != std::string::npos) {
+            target.size = std::strtoull(client.headers.c_str() + slash + 10, nullptr, 10);
+        }
+        targets.push_back(std::move(target));
+    }
+    return true;
+}
+
+struct WorkerStats {
+    std::vector<int64_t> latencies_ns[KIND_COUNT];
+    uint64_t errors[KIND_COUNT] = {};
+    uint64_t bytes = 0;
+};
+
+void runWorker(const LoadOptions& options, const std::vector<TrackTarget>& targets, unsigned seed,
+               bench_clock::time_point deadline, WorkerStats& stats) {
+    std::mt19937_64 random(seed);
+    unsigned weights[KIND_COUNT] = {options.catalog_weight, targets.empty() ? 0 : options.description_weight,
+                                    targets.empty() ? 0 : options.stream_weight};
+    std::discrete_distribution<int> pick_kind(std::begin(weights), std::end(weights));
+    std::uniform_int_distribution<size_t> pick_track(0, targets.empty() ? 0 : targets.size() - 1);
+
+    HttpClient client(options);
+    while (bench_clock::now() < deadline) {
+        int kind = pick_kind(random);
+        std::string request;
+        if (kind == CATALOG) {
+            request = buildRequest(options, "/catalog");
+        } else {
+            const TrackTarget& target = targets[pick_track(random)];
+            if (kind == DESCRIPTION) {
+                request = buildRequest(options, "/description/" + target.path);
+            } else {
+                // A player seeking around the file: one range starting anywhere in it
+                uint64_t length = std::min<uint64_t>(options.range_bytes, std::max<uint64_t>(target.size, 1));
+                uint64_t first = target.size > length ? random() % (target.size - length) : 0;
+                request = buildRequest(options, "/stream/" + target.path,
+                                       "Range: bytes=" + std::to_string(first) + "-" + std::to_string(first + length - 1) + "\r\n");
+            }
+        }
+
+        int status = 0;
+        uint64_t bytes = 0;
+        auto started = bench_clock::now();
+        bool ok = client.request(request, status, bytes);
+        auto elapsed = bench_clock::now() - started;
+
+        if (!ok || status >= 400) {
+            stats.errors[kind]++;
+            continue;
+        }
+        stats.bytes += bytes;
+        stats.latencies_ns[kind].push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+}
+
+double percentileMs(const std::vector<int64_t>& sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = std::min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()));
+    return sorted[index] / 1e6;
+}
+
+void printRow(const char* name, std::vector<int64_t>& latencies, uint64_t errors, double seconds) {
+    std::sort(latencies.begin(), latencies.end());
+    printf("%-12s %10zu %8llu %12.1f %9.3f %9.3f %9.3f %9.3f\n", name, latencies.size(),
+           static_cast<unsigned long long>(errors), latencies.size() / seconds, percentileMs(latencies, 0.50),
+           percentileMs(latencies, 0.99), percentileMs(latencies, 0.999),
+           latencies.empty() ? 0.0 : latencies.back() / 1e6);
+}
+
+}
+
+int runLoad(const LoadOptions& options) {
+    std::vector<TrackTarget> targets;
+    if (!discoverTracks(options, targets)) {
+        return 1;
+    }
+    if (targets.empty()) {
+        std::cout << "Catalog has no streamable tracks; only /catalog will be requested" << std::endl;
+    }
+
+    std::cout << "Running " << options.duration_seconds << "s with " << options.concurrency << " connections, mix "
+              << options.catalog_weight << "/" << options.description_weight << "/" << options.stream_weight
+              << " (catalog/description/stream) over " << targets.size() << " tracks" << std::endl;
+
+    std::vector<WorkerStats> stats(options.concurrency);
+    std::vector<std::thread> workers;
+    auto started = bench_clock::now();
+    auto deadline = started + std::chrono::duration_cast<bench_clock::duration>(
+                                  std::chrono::duration<double>(options.duration_seconds));
+    for (unsigned i = 0; i < options.concurrency; ++i) {
+        workers.emplace_back(runWorker, std::cref(options), std::cref(targets), 0x5eed + i, deadline, std::ref(stats[i]));
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    double seconds = std::chrono::duration<double>(bench_clock::now() - started).count();
+
+    // Merge per-thread results
+    WorkerStats total;
+    for (WorkerStats& worker : stats) {
+        for (int kind = 0; kind < KIND_COUNT; ++kind) {
+            total.latencies_ns[kind].insert(total.latencies_ns[kind].end(), worker.latencies_ns[kind].begin(),
+                                            worker.latencies_ns[kind].end());
+            total.errors[kind] += worker.errors[kind];
+        }
+        total.bytes += worker.bytes;
+    }
+
+    std::vector<int64_t> all;
+    uint64_t all_errors = 0;
+    printf("%-12s %10s %8s %12s %9s %9s %9s %9s\n", "route", "requests", "errors", "req/s", "p50 ms", "p99 ms",
+           "p999 ms", "max ms");
+    for (int kind = 0; kind < KIND_COUNT; ++kind) {
+        all.insert(all.end(), total.latencies_ns[kind].begin(), total.latencies_ns[kind].end());
+        all_errors += total.errors[kind];
+        printRow(KIND_NAMES[kind], total.latencies_ns[kind], total.errors[kind], seconds);
+    }
+    printRow("total", all, all_errors, seconds);
+    printf("Throughput: %.1f MB/s of response bodies\n", total.bytes / seconds / (1024 * 1024));
+
+    return all.empty() ? 1 : 0;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "ServerConfig.h"
+
+// Settings for a load run against a running server
+struct LoadOptions {
+    std::string host = "127.0.0.1";
+    int port = ServerConfig().port;
+    unsigned concurrency = 16;     // client connections, one thread each
+    double duration_seconds = 10;
+
+    // Relative weights of the request mix
+    unsigned catalog_weight = 10;
+    unsigned description_weight = 30;
+    unsigned stream_weight = 60;
+
+    uint64_t range_bytes = 256 * 1024;  // size of each ranged /stream request
+};
+
+// Replay a mix of /catalog, /description/<id> and ranged /stream/<id> requests over keep-alive
+// connections and print throughput and latency percentiles. Returns a process exit code.
+int runLoad(const LoadOptions& options);
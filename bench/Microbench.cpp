@@ -0,0 +1,268 @@
+#include "pch.h"
+#include "Microbench.h"
+#include "Catalog/TrackCatalog.h"
+#include "Catalog/CatalogQuery.h"
+#include "Http/Handlers.h"
+#include "Http/RequestParser.h"
+#include "Http/Range.h"
+#include "Net/Connection.h"
+#include "Utils/Arena.h"
+#include "Utils/Utf8.h"
+
+using bench_clock = std::chrono::steady_clock;
+
+namespace {
+
+// Results are folded into this so the compiler can't drop the work being measured
+volatile size_t sink = 0;
+void consume(size_t value) { sink = sink + value; }
+
+bool selected(std::string_view filter, std::string_view name) {
+    return filter.empty() || name.find(filter) != std::string_view::npos;
+}
+
+// Time body() until at least MIN_RUN_TIME has passed, doubling the batch size, and print ns per call
+template <typename Body>
+void measure(std::string_view filter, const char* name, Body&& body) {
+    if (!selected(filter, name)) {
+        return;
+    }
+
+    const auto MIN_RUN_TIME = std::chrono::milliseconds(300);
+    body();  // warm up caches and lazy statics
+
+    uint64_t iterations = 1;
+    bench_clock::duration elapsed;
+    while (true) {
+        auto started = bench_clock::now();
+        for (uint64_t i = 0; i < iterations; ++i) {
+            body();
+        }
+        elapsed = bench_clock::now() - started;
+        if (elapsed >= MIN_RUN_TIME) {
+            break;
+        }
+        iterations *= 2;
+    }
+
+    double ns_per_op = std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+    printf("%-40s %12.1f ns/op %12llu iterations\n", name, ns_per_op, static_cast<unsigned long long>(iterations));
+}
+
+const std::string BROWSER_REQUEST =
+    "GET /stream/Some%20Artist%20-%20Some%20Track HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36\r\n"
+    "Accept: */*\r\n"
+    "Accept-Encoding: identity;q=1, *;q=0\r\n"
+    "Accept-Language: en-US,en;q=0.9\r\n"
+    "Referer: http://localhost:8080/\r\n"
+    "Range: bytes=1048576-\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+
+// Snapshot with synthetic tracks, shaped like a real library
+CatalogSnapshot makeSyntheticCatalog(size_t track_count) {
+    CatalogSnapshot snapshot;
+    TrackTable::Builder builder;
+    builder.reserve(track_count);
+    for (size_t i = 0; i < track_count; ++i) {
+        TrackInfo track;
+        std::string id = "Artist " + std::to_string(i % 97) + " - Track " + std::to_string(i);
+        track.id = toUtf8(id);
+        track.title = toUtf8("Track " + std::to_string(i));
+        track.artist = toUtf8("Artist " + std::to_string(i % 97));
+        track.album = toUtf8("Album " + std::to_string(i % 311));
+        track.duration = 120 + static_cast<int>(i % 300);
+        track.filepath = toUtf8("music/" + id + ".mp3");
+        track.description_path = toUtf8("music/" + id + ".json");
+        builder.add(track);
+    }
+    snapshot.tracks = builder.build();
+    return snapshot;
+}
+
+// Function to check the secondary indexes on the values that trip them up: an empty artist,
+// an album shared by several rows and values equal but for case. Returns false on a mismatch.
+bool checkTrackIndexes() {
+    struct Sample {
+        const char* id;
+        const char* artist;
+        const char* album;
+    };
+    const Sample samples[] = {
+        {"a", "", "Zed"}, {"b", "Art", "Alpha"}, {"c", "Art", "Zed"}, {"d", "Art", "Mid"}, {"e", "art", "zed"},
+    };
+    TrackTable::Builder builder;
+    for (const Sample& sample : samples) {
+        TrackInfo track;
+        track.id = toUtf8(sample.id);
+        track.title = toUtf8("");
+        track.artist = toUtf8(sample.artist);
+        track.album = toUtf8(sample.album);
+        builder.add(track);
+    }
+    TrackTable tracks = builder.build();
+
+    bool passed = true;
+    auto expect = [&](const char* what, std::span<const uint32_t> rows, size_t count) {
+        if (rows.size() != count) {
+            printf("index check failed: %s matched %zu rows, expected %zu\n", what, rows.size(), count);
+            passed = false;
+        }
+    };
+    expect("album=Zed", tracks.rowsWithAlbum("Zed"), 3);
+    expect("album=Mid", tracks.rowsWithAlbum("mid"), 1);
+    expect("artist=", tracks.rowsWithArtist(""), 1);
+    expect("artist=Art", tracks.rowsWithArtist("ART"), 4);
+    expect("title=", tracks.rowsWithTitlePrefix(""), 5);
+    return passed;
+}
+
+void benchUrlDecode(std::string_view filter) {
+    const std::string ascii = "Some%20Artist%20-%20Some%20Track+%28Live%29";
+    const std::string utf8 = "%E3%82%B5%E3%83%B3%E3%83%97%E3%83%AB%20%E2%80%93%20%C3%89t%C3%A9";
+
+    measure(filter, "urlDecode/ascii", [&]() { consume(urlDecode(ascii).size()); });
+    measure(filter, "urlDecode/utf8", [&]() { consume(urlDecode(utf8).size()); });
+    // As the handlers call it: into the request arena, which is reset once per request
+    measure(filter, "urlDecode/arena", [&]() {
+        consume(urlDecode(ascii, &requestArena()).size());
+        requestArena().reset();
+    });
+}
+
+void benchRequestParsing(std::string_view filter) {
+    RequestParser parser;
+    HttpRequest request;
+    measure(filter, "parse/request", [&]() {
+        parser.reset();
+        consume(static_cast<size_t>(parser.parse(BROWSER_REQUEST, request)));
+    });
+
+    // A request arriving a few bytes per read, as from a slow client
+    measure(filter, "parse/request_trickled", [&]() {
+        parser.reset();
+        for (size_t length = 16; length < BROWSER_REQUEST.size(); length += 16) {
+            consume(static_cast<size_t>(parser.parse(std::string_view(BROWSER_REQUEST).substr(0, length), request)));
+        }
+        consume(static_cast<size_t>(parser.parse(BROWSER_REQUEST, request)));
+    });
+
+    measure(filter, "parse/header_lookups", [&]() {
+        // The lookups handleHttpRequest does for a typical /stream request
+        consume(request.header("Connection").size());
+        consume(request.header("Range").size());
+        consume(request.header("If-None-Match").size());
+    });
+
+    std::pmr::vector<ByteRange> ranges;
+    measure(filter, "parse/range_header", [&]() {
+        ranges.clear();
+        consume(static_cast<size_t>(parseRangeHeader("bytes=0-499,1000-1499,-500", 10 * 1024 * 1024, ranges)));
+    });
+
+    // Full handler for a track that isn't in the catalog: parse, decode, lookup and a queued 404.
+    // Request logging is silenced so the console doesn't dominate the measurement.
+    std::streambuf* console = std::cout.rdbuf(nullptr);
+    const std::string missing_request =
+        "GET /description/No%20Such%20Track HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n\r\n";
+    measure(filter, "handleHttpRequest/404", [&]() {
+        Connection conn(INVALID_SOCKET, "bench");
+        conn.input = missing_request;
+        conn.parser.parse(conn.input, conn.request);
+        conn.request_length = conn.request.head_length;
+        handleHttpRequest(conn);
+        requestArena().reset();  // as the event loop does after every request
+        consume(conn.hasPendingOutput());
+    });
+    std::cout.rdbuf(console);
+    std::cout.clear();
+}
+
+void benchCatalogSerialization(std::string_view filter) {
+    for (size_t track_count : {100, 1000, 10000}) {
+        CatalogSnapshot snapshot = makeSyntheticCatalog(track_count);
+        std::string name = "buildCatalogResponse/" + std::to_string(track_count);
+        measure(filter, name.c_str(), [&]() {
+            snapshot.response = CatalogResponse();
+            buildCatalogResponse(snapshot);
+            consume(snapshot.response.body.identity->size());
+        });
+    }
+
+    // A mobile client's pages: the first 50 tracks, and 50 of one artist with two fields
+    CatalogSnapshot paged = makeSyntheticCatalog(10000);
+    std::string page;
+    measure(filter, "catalogQuery/page50/10000", [&]() {
+        page.clear();
+        CatalogQuery query;
+        query.limit = 50;
+        consume(runCatalogQuery(paged.tracks, query, page));
+    });
+    measure(filter, "catalogQuery/artist_fields/10000", [&]() {
+        page.clear();
+        CatalogQuery query;
+        query.limit = 50;
+        query.artist = "artist 42";
+        query.fields = CATALOG_FIELD_ID | CATALOG_FIELD_TITLE;
+        consume(runCatalogQuery(paged.tracks, query, page));
+    });
+
+    // Id lookups as /stream and /description do them, hits and misses, in a large catalog
+    if (!selected(filter, "catalog/") && !filter.starts_with("catalog/")) {
+        return;
+    }
+    CatalogSnapshot snapshot = makeSyntheticCatalog(100000);
+    std::vector<std::string> ids;
+    for (size_t i = 0; i < 1024; ++i) {
+        size_t n = (i * 7919) % 100000;
+        ids.push_back("Artist " + std::to_string(n % 97) + " - Track " + std::to_string(n) + (i % 4 == 0 ? "x" : ""));
+    }
+    size_t next = 0;
+    measure(filter, "catalog/find/100000", [&]() {
+        consume(snapshot.tracks.find(ids[next++ & 1023]) != nullptr);
+    });
+    measure(filter, "catalog/build/100000", [&]() {
+        TrackTable::Builder builder;
+        for (const TrackRow& row : snapshot.tracks) {
+            builder.add(snapshot.tracks, row);
+        }
+        consume(builder.build().size());
+    });
+    printf("%-40s %12.1f bytes/track\n", "catalog/memory/100000", snapshot.tracks.memoryUsage() / 100000.0);
+
+    // Full-text search: a selective two-term query, a short prefix, and an infix match
+    measure(filter, "catalog/search_build/100000", [&]() {
+        SearchIndex index;
+        index.build(snapshot.tracks);
+        consume(index.tokenCount());
+    });
+    snapshot.search.build(snapshot.tracks);
+    std::vector<uint32_t> rows;
+    for (const char* query : {"artist 42 track 1234", "albu", "rack 9999"}) {
+        std::string name = std::string("catalog/search/") + query;
+        measure(filter, name.c_str(), [&]() {
+            rows.clear();
+            consume(snapshot.search.search(query, 0, 20, rows));
+        });
+    }
+    measure(filter, "catalog/search_update/100000", [&]() {
+        SearchIndex index;
+        index.build(snapshot.tracks, &snapshot.tracks, &snapshot.search);
+        consume(index.tokenCount());
+    });
+    printf("%-40s %12.1f bytes/track\n", "catalog/search_memory/100000", snapshot.search.memoryUsage() / 100000.0);
+}
+
+}
+
+int runMicrobenchmarks(std::string_view filter) {
+    if (!checkTrackIndexes()) {
+        return 1;
+    }
+    benchUrlDecode(filter);
+    benchRequestParsing(filter);
+    benchCatalogSerialization(filter);
+    return 0;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <string_view>
+
+// Run the hot-path microbenchmarks whose name contains filter (all of them if empty)
+// and print the time per operation. Returns a process exit code.
+int runMicrobenchmarks(std::string_view filter);
@@ -0,0 +1,83 @@
+#include "pch.h"
+#include "LoadGenerator.h"
+#include "Microbench.h"
+
+#include <string_view>
+
+static void printUsage() {
+    std::cout <<
+        "Usage:\n"
+        "  server_bench load [options]   replay a request mix against a running server\n"
+        "    --host <addr>               server address (default 127.0.0.1)\n"
+        "    --port <port>               server port (default " << ServerConfig().port << ")\n"
+        "    --concurrency <n>           client connections (default 16)\n"
+        "    --duration <seconds>        length of the run (default 10)\n"
+        "    --mix <c>,<d>,<s>           weights of /catalog, /description and /stream (default 10,30,60)\n"
+        "    --range-bytes <n>           bytes per ranged /stream request (default 262144)\n"
+        "  server_bench micro [filter]   run the in-process microbenchmarks\n";
+}
+
+static bool parseLoadOptions(int argc, char* argv[], LoadOptions& options) {
+    for (int i = 2; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return false;
+        }
+        const char* value = argv[++i];
+        if (arg == "--host") {
+            options.host = value;
+        } else if (arg == "--port") {
+            options.port = std::atoi(value);
+        } else if (arg == "--concurrency") {
+            options.concurrency = static_cast<unsigned>(std::max(1, std::atoi(value)));
+        } else if (arg == "--duration") {
+            options.duration_seconds = std::atof(value);
+        } else if (arg == "--mix") {
+            if (sscanf(value, "%u,%u,%u", &options.catalog_weight, &options.description_weight,
+                       &options.stream_weight) != 3) {
+                std::cerr << "--mix expects three comma-separated weights" << std::endl;
+                return false;
+            }
+        } else if (arg == "--range-bytes") {
+            options.range_bytes = std::max<uint64_t>(1, std::strtoull(value, nullptr, 10));
+        } else {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        printUsage();
+        return 1;
+    }
+
+#ifdef _WIN32
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        std::cerr << "Failed to initialize socket system." << std::endl;
+        return 1;
+    }
+#endif
+
+    std::string_view mode = argv[1];
+    int result = 1;
+    if (mode == "load") {
+        LoadOptions options;
+        if (parseLoadOptions(argc, argv, options)) {
+            result = runLoad(options);
+        }
+    } else if (mode == "micro") {
+        result = runMicrobenchmarks(argc > 2 ? argv[2] : "");
+    } else {
+        printUsage();
+    }
+
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return result;
+}
@@ -0,0 +1,217 @@
+#include "pch.h"
+#include "Catalog/CatalogIndex.h"
+#include "Utils/Hash.h"
+#include "Utils/Utf8.h"
+
+static constexpr char INDEX_MAGIC[4] = {'C', 'T', 'I', 'X'};
+static constexpr size_t HEADER_SIZE = 16;
+static constexpr size_t FOOTER_SIZE = 8;
+
+// Bounds-checked reader over the mapped index
+namespace {
+class IndexReader {
+public:
+    explicit IndexReader(std::string_view data) : data(data) {}
+
+    template <typename T>
+    bool read(T& value) {
+        if (data.size() - position < sizeof(T)) {
+            return false;
+        }
+        memcpy(&value, data.data() + position, sizeof(T));
+        position += sizeof(T);
+        return true;
+    }
+
+    bool readString(std::string_view& value) {
+        uint32_t length;
+        if (!read(length) || data.size() - position < length) {
+            return false;
+        }
+        value = data.substr(position, length);
+        position += length;
+        return true;
+    }
+
+    bool readStamp(FileStamp& stamp) {
+        return read(stamp.mtime) && read(stamp.size);
+    }
+
+    bool readSeekIndex(Mp3SeekIndex& index, std::string_view& points) {
+        return read(index.duration_ms) && read(index.bitrate) && read(index.sample_rate) &&
+               read(index.mpeg_version) && read(index.audio_start) && read(index.audio_end) &&
+               readString(points) && points.size() % sizeof(uint32_t) == 0;
+    }
+
+    size_t offset() const { return position; }
+    void seek(size_t offset) { position = offset; }
+
+private:
+    std::string_view data;
+    size_t position = 0;
+};
+
+class IndexWriter {
+public:
+    template <typename T>
+    void write(const T& value) {
+        buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void writeString(std::string_view value) {
+        write(static_cast<uint32_t>(value.size()));
+        buffer.append(value);
+    }
+
+    void writeStamp(const FileStamp& stamp) {
+        write(stamp.mtime);
+        write(stamp.size);
+    }
+
+    void writeSeekIndex(const Mp3SeekIndex& index) {
+        write(index.duration_ms);
+        write(index.bitrate);
+        write(index.sample_rate);
+        write(index.mpeg_version);
+        write(index.audio_start);
+        write(index.audio_end);
+        writeString(std::string_view(reinterpret_cast<const char*>(index.points.data()),
+                                     index.points.size() * sizeof(uint32_t)));
+    }
+
+    std::string buffer;
+};
+}
+
+bool CatalogIndex::open(const std::string& path) {
+    records.clear();
+    if (!mapping.open(path)) {
+        return false;
+    }
+
+    std::string_view data = mapping.data();
+    if (data.size() < HEADER_SIZE + FOOTER_SIZE || memcmp(data.data(), INDEX_MAGIC, 4) != 0) {
+        mapping.close();
+        return false;
+    }
+
+    // Validate the whole file before trusting any of it
+    std::string_view payload = data.substr(0, data.size() - FOOTER_SIZE);
+    uint64_t stored_hash;
+    memcpy(&stored_hash, data.data() + payload.size(), sizeof(stored_hash));
+    if (fnv1aHash(payload) != stored_hash) {
+        mapping.close();
+        return false;
+    }
+
+    IndexReader reader(payload);
+    reader.seek(4);
+    uint32_t version = 0, count = 0, reserved = 0;
+    if (!reader.read(version) || !reader.read(count) || !reader.read(reserved) || version != FORMAT_VERSION) {
+        mapping.close();
+        return false;
+    }
+
+    records.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t record_length;
+        if (!reader.read(record_length)) {
+            break;
+        }
+        // A length running past the payload would leave the reader beyond its end
+        if (record_length > payload.size() - reader.offset()) {
+            records.clear();
+            mapping.close();
+            return false;
+        }
+        size_t record_end = reader.offset() + record_length;
+
+        Record record;
+        uint8_t description_exists;
+        std::string_view filepath;
+        if (!reader.readStamp(record.mp3) || !reader.readStamp(record.description) ||
+            !reader.read(description_exists) || !reader.read(record.duration) ||
+            !reader.readString(filepath) || !reader.readString(record.id) || !reader.readString(record.title) ||
+            !reader.readString(record.artist) || !reader.readString(record.album) ||
+            !reader.readSeekIndex(record.seek_index, record.seek_points) || reader.offset() > record_end) {
+            records.clear();
+            mapping.close();
+            return false;
+        }
+        record.mp3.exists = true;
+        record.description.exists = description_exists != 0;
+
+        records.emplace(filepath, record);
+        reader.seek(record_end);
+    }
+
+    return true;
+}
+
+bool CatalogIndex::lookup(TrackInfo& track) const {
+    auto it = records.find(viewUtf8(track.filepath));
+    if (it == records.end() || !(it->second.mp3 == track.file_stamp) ||
+        !(it->second.description == track.description_stamp)) {
+        return false;
+    }
+
+    const Record& record = it->second;
+    track.title = toUtf8(std::string(record.title));
+    track.artist = toUtf8(std::string(record.artist));
+    track.album = toUtf8(std::string(record.album));
+    track.duration = record.duration;
+    track.seek_index = record.seek_index;
+    track.seek_index.points.resize(record.seek_points.size() / sizeof(uint32_t));
+    if (!record.seek_points.empty()) {
+        memcpy(track.seek_index.points.data(), record.seek_points.data(), record.seek_points.size());
+    }
+    return true;
+}
+
+bool CatalogIndex::write(const std::string& path, const TrackTable& tracks) {
+    IndexWriter writer;
+    writer.buffer.append(INDEX_MAGIC, 4);
+    writer.write(FORMAT_VERSION);
+    writer.write(static_cast<uint32_t>(tracks.size()));
+    writer.write(static_cast<uint32_t>(0));
+
+    IndexWriter record;
+    for (const TrackRow& track : tracks) {
+        record.buffer.clear();
+        record.writeStamp(track.file_stamp);
+        record.writeStamp(track.description_stamp);
+        record.write(static_cast<uint8_t>(track.description_stamp.exists ? 1 : 0));
+        record.write(static_cast<int32_t>(track.duration));
+        record.writeString(tracks.text(track.filepath));
+        record.writeString(tracks.text(track.id));
+        record.writeString(tracks.text(track.title));
+        record.writeString(tracks.text(track.artist));
+        record.writeString(tracks.text(track.album));
+        record.writeSeekIndex(tracks.seekIndex(track));
+
+        writer.write(static_cast<uint32_t>(record.buffer.size()));
+        writer.buffer += record.buffer;
+    }
+    writer.write(fnv1aHash(writer.buffer));
+
+    // Write next to the target and rename over it, so a crash never leaves a torn index behind
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            return false;
+        }
+        out.write(writer.buffer.data(), writer.buffer.size());
+        if (!out) {
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(temp_path, path, ec);
+    if (ec) {
+        std::filesystem::remove(temp_path, ec);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "Catalog/TrackTable.h"
+#include "Utils/MappedFile.h"
+
+#include <string_view>
+
+// Persistent binary catalog index, memory-mapped at startup so unchanged tracks
+// don't need their description sidecars opened or parsed.
+//
+// Layout (native byte order):
+//   header  "CTIX", uint32 version, uint32 record count, uint32 reserved
+//   record  uint32 length, int64/uint64 mp3 mtime/size, int64/uint64 description mtime/size,
+//           uint8 description exists, int32 duration, then uint32-length-prefixed
+//           filepath, id, title, artist and album, then the seek index: uint32 duration ms,
+//           bitrate and sample rate, uint8 MPEG version, uint64 audio start and end, and a
+//           uint32-length-prefixed array of uint32 seek points
+//   footer  uint64 FNV-1a hash of everything before it
+class CatalogIndex {
+public:
+    static constexpr uint32_t FORMAT_VERSION = 2;
+
+    // Map and validate an index file; returns false (leaving the index empty) if it is
+    // missing, from another format version, truncated or corrupt
+    bool open(const std::string& path);
+
+    // Fill track's metadata from the index if track.filepath is indexed with exactly
+    // the same file_stamp and description_stamp
+    bool lookup(TrackInfo& track) const;
+
+    size_t size() const { return records.size(); }
+
+    // Write tracks to path atomically (temporary file + rename)
+    static bool write(const std::string& path, const TrackTable& tracks);
+
+private:
+    struct Record {
+        FileStamp mp3;
+        FileStamp description;
+        int32_t duration;
+        std::string_view id;
+        std::string_view title;
+        std::string_view artist;
+        std::string_view album;
+        Mp3SeekIndex seek_index;     // points left empty; copied out of seek_points on lookup
+        std::string_view seek_points;
+    };
+
+    MappedFile mapping;
+    std::unordered_map<std::string_view, Record> records;  // views point into mapping
+};
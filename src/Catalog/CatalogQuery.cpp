@@ -0,0 +1,127 @@
+#include "pch.h"
+#include "Catalog/CatalogQuery.h"
+#include "Utils/Json.h"
+
+#include <algorithm>
+#include <charconv>
+
+unsigned parseCatalogFields(std::string_view list) {
+    static const std::pair<std::string_view, unsigned> names[] = {
+        {"id", CATALOG_FIELD_ID},         {"title", CATALOG_FIELD_TITLE},
+        {"artist", CATALOG_FIELD_ARTIST}, {"album", CATALOG_FIELD_ALBUM},
+        {"duration", CATALOG_FIELD_DURATION},
+    };
+
+    unsigned fields = 0;
+    while (true) {
+        size_t comma = list.find(',');
+        std::string_view name = list.substr(0, comma);
+        auto it = std::find_if(std::begin(names), std::end(names), [&](const auto& entry) { return entry.first == name; });
+        if (it == std::end(names)) {
+            return 0;
+        }
+        fields |= it->second;
+        if (comma == std::string_view::npos) {
+            return fields;
+        }
+        list.remove_prefix(comma + 1);
+    }
+}
+
+void appendTrackJson(std::string& out, const TrackTable& tracks, const TrackRow& track, unsigned fields) {
+    // Keys in alphabetical order, as nlohmann::json wrote them, so the full catalog kept its bytes and ETag
+    bool first = true;
+    auto key = [&](const char* name) {
+        out += first ? "{\"" : ",\"";
+        out += name;
+        out += "\":";
+        first = false;
+    };
+    if (fields & CATALOG_FIELD_ALBUM) {
+        key("album");
+        appendJsonString(out, tracks.text(track.album));
+    }
+    if (fields & CATALOG_FIELD_ARTIST) {
+        key("artist");
+        appendJsonString(out, tracks.text(track.artist));
+    }
+    if (fields & CATALOG_FIELD_DURATION) {
+        key("duration");
+        char digits[16];
+        auto [end, ec] = std::to_chars(digits, digits + sizeof(digits), track.duration);
+        out.append(digits, end);
+    }
+    if (fields & CATALOG_FIELD_ID) {
+        key("id");
+        appendJsonString(out, tracks.text(track.id));
+    }
+    if (fields & CATALOG_FIELD_TITLE) {
+        key("title");
+        appendJsonString(out, tracks.text(track.title));
+    }
+    out += first ? "{}" : "}";
+}
+
+// Equality ignoring ASCII case, matching the table's secondary indexes
+static bool foldedEquals(std::string_view a, std::string_view b) {
+    auto fold = [](unsigned char c) { return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c; };
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (fold(a[i]) != fold(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t runCatalogQuery(const TrackTable& tracks, const CatalogQuery& query, std::string& out) {
+    // Candidates come from the narrowest secondary index that applies; the other filters are checked per row
+    std::span<const uint32_t> candidates;
+    bool filtered = false;
+    auto narrow = [&](std::span<const uint32_t> rows) {
+        if (!filtered || rows.size() < candidates.size()) {
+            candidates = rows;
+        }
+        filtered = true;
+    };
+    if (!query.artist.empty()) {
+        narrow(tracks.rowsWithArtist(query.artist));
+    }
+    if (!query.album.empty()) {
+        narrow(tracks.rowsWithAlbum(query.album));
+    }
+    if (!query.title_prefix.empty()) {
+        narrow(tracks.rowsWithTitlePrefix(query.title_prefix));
+    }
+
+    std::vector<uint32_t> matches;
+    if (filtered) {
+        for (uint32_t row : candidates) {
+            const TrackRow& track = tracks[row];
+            if ((query.artist.empty() || foldedEquals(tracks.text(track.artist), query.artist)) &&
+                (query.album.empty() || foldedEquals(tracks.text(track.album), query.album)) &&
+                (query.title_prefix.empty() ||
+                 foldedEquals(tracks.text(track.title).substr(0, query.title_prefix.size()), query.title_prefix))) {
+                matches.push_back(row);
+            }
+        }
+        // Row positions are id order
+        std::sort(matches.begin(), matches.end());
+    }
+
+    size_t total = filtered ? matches.size() : tracks.size();
+    size_t first = std::min(query.offset, total);
+    size_t last = first + std::min(query.limit, total - first);
+
+    out += '[';
+    for (size_t i = first; i < last; ++i) {
+        if (i > first) {
+            out += ',';
+        }
+        appendTrackJson(out, tracks, tracks[filtered ? matches[i] : i], query.fields);
+    }
+    out += ']';
+    return total;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Catalog/TrackTable.h"
+
+#include <string_view>
+
+// Track fields a /catalog response can carry; a query's fields is a mask of these
+constexpr unsigned CATALOG_FIELD_ID = 1 << 0;
+constexpr unsigned CATALOG_FIELD_TITLE = 1 << 1;
+constexpr unsigned CATALOG_FIELD_ARTIST = 1 << 2;
+constexpr unsigned CATALOG_FIELD_ALBUM = 1 << 3;
+constexpr unsigned CATALOG_FIELD_DURATION = 1 << 4;
+constexpr unsigned CATALOG_ALL_FIELDS = (1 << 5) - 1;
+
+// Mask for a comma-separated list of field names ("id,title"); 0 if any name is unknown
+unsigned parseCatalogFields(std::string_view list);
+
+// One page of a filtered /catalog listing. Filters are ASCII case-insensitive and combine with AND;
+// matches are listed in id order, as in the full catalog.
+struct CatalogQuery {
+    size_t offset = 0;
+    size_t limit = SIZE_MAX;
+    unsigned fields = CATALOG_ALL_FIELDS;
+    std::string artist;        // exact artist
+    std::string album;         // exact album
+    std::string title_prefix;  // title starts with
+};
+
+// Append a track as a JSON object with the given fields, in the same key order as the full catalog
+void appendTrackJson(std::string& out, const TrackTable& tracks, const TrackRow& track, unsigned fields = CATALOG_ALL_FIELDS);
+
+// Append the JSON array of the query's page to out; returns how many tracks matched in total
+size_t runCatalogQuery(const TrackTable& tracks, const CatalogQuery& query, std::string& out);
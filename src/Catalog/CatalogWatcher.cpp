@@ -0,0 +1,300 @@
+#include "pch.h"
+#include "ServerConfig.h"
+#include "Catalog/CatalogWatcher.h"
+#include "Catalog/TrackCatalog.h"
+#include "Utils/Utf8.h"
+#include "Utils/Logger.h"
+
+#include <set>
+#include <condition_variable>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Platform directory change notifications, plus a wakeup for reload and stop requests
+class DirectoryWatch {
+public:
+    DirectoryWatch();
+    ~DirectoryWatch();
+
+    // Start receiving change events for dir; returns false if the platform or directory can't be watched
+    bool open(const fs::path& dir);
+
+    // Wait up to timeout_ms (-1 = forever) for changes or a wakeup. Names of changed files are
+    // appended to names; overflow is set when the kernel dropped events and a rescan is needed.
+    void wait(int timeout_ms, std::vector<fs::path>& names, bool& overflow);
+
+    void wakeup();
+
+private:
+#ifdef __linux__
+    int inotify_fd = -1;
+    int wake_fd = -1;
+#elif defined(_WIN32)
+    HANDLE directory = INVALID_HANDLE_VALUE;
+    HANDLE change_event = NULL;
+    HANDLE wake_event = NULL;
+    OVERLAPPED overlapped = {};
+    alignas(DWORD) char buffer[64 * 1024];
+    bool armDirectoryRead();
+#else
+    // No notification support: reload and stop requests still need to wake the thread
+    std::mutex wake_mutex;
+    std::condition_variable wake_cv;
+    bool woken = false;
+#endif
+};
+
+#ifdef __linux__
+
+DirectoryWatch::DirectoryWatch() {
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+DirectoryWatch::~DirectoryWatch() {
+    if (inotify_fd != -1) close(inotify_fd);
+    if (wake_fd != -1) close(wake_fd);
+}
+
+bool DirectoryWatch::open(const fs::path& dir) {
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd == -1) {
+        return false;
+    }
+    uint32_t mask = IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB;
+    if (inotify_add_watch(inotify_fd, dir.c_str(), mask) == -1) {
+        close(inotify_fd);
+        inotify_fd = -1;
+        return false;
+    }
+    return true;
+}
+
+void DirectoryWatch::wait(int timeout_ms, std::vector<fs::path>& names, bool& overflow) {
+    pollfd fds[2] = {{wake_fd, POLLIN, 0}, {inotify_fd, POLLIN, 0}};
+    int count = poll(fds, inotify_fd == -1 ? 1 : 2, timeout_ms);
+    if (count <= 0) {
+        return;
+    }
+
+    if (fds[0].revents & POLLIN) {
+        uint64_t value;
+        ssize_t bytes_read = read(wake_fd, &value, sizeof(value));
+        (void)bytes_read;
+    }
+
+    if (inotify_fd != -1 && (fds[1].revents & POLLIN)) {
+        alignas(inotify_event) char buffer[16 * 1024];
+        ssize_t length;
+        while ((length = read(inotify_fd, buffer, sizeof(buffer))) > 0) {
+            for (char* ptr = buffer; ptr < buffer + length;) {
+                const inotify_event* event = reinterpret_cast<const inotify_event*>(ptr);
+                if (event->mask & IN_Q_OVERFLOW) {
+                    overflow = true;
+                } else if (event->len > 0) {
+                    names.emplace_back(event->name);
+                }
+                ptr += sizeof(inotify_event) + event->len;
+            }
+        }
+    }
+}
+
+void DirectoryWatch::wakeup() {
+    uint64_t one = 1;
+    ssize_t written = write(wake_fd, &one, sizeof(one));
+    (void)written;
+}
+
+#elif defined(_WIN32)
+
+DirectoryWatch::DirectoryWatch() {
+    wake_event = CreateEventW(NULL, FALSE, FALSE, NULL);
+}
+
+DirectoryWatch::~DirectoryWatch() {
+    if (directory != INVALID_HANDLE_VALUE) {
+        CancelIoEx(directory, &overlapped);
+        CloseHandle(directory);
+    }
+    if (change_event) CloseHandle(change_event);
+    if (wake_event) CloseHandle(wake_event);
+}
+
+bool DirectoryWatch::open(const fs::path& dir) {
+    directory = CreateFileW(dir.wstring().c_str(), FILE_LIST_DIRECTORY,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+                            FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+    if (directory == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    change_event = CreateEventW(NULL, TRUE, FALSE, NULL);
+    overlapped.hEvent = change_event;
+    return armDirectoryRead();
+}
+
+bool DirectoryWatch::armDirectoryRead() {
+    ResetEvent(change_event);
+    DWORD filter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE;
+    return ReadDirectoryChangesW(directory, buffer, sizeof(buffer), FALSE, filter, NULL, &overlapped, NULL) != 0;
+}
+
+void DirectoryWatch::wait(int timeout_ms, std::vector<fs::path>& names, bool& overflow) {
+    HANDLE handles[2] = {wake_event, change_event};
+    DWORD count = directory == INVALID_HANDLE_VALUE ? 1 : 2;
+    DWORD result = WaitForMultipleObjects(count, handles, FALSE, timeout_ms < 0 ? INFINITE : static_cast<DWORD>(timeout_ms));
+    if (result != WAIT_OBJECT_0 + 1) {
+        return;
+    }
+
+    DWORD length = 0;
+    if (!GetOverlappedResult(directory, &overlapped, &length, FALSE) || length == 0) {
+        // Zero bytes means the buffer overflowed and the individual changes were lost
+        overflow = true;
+    } else {
+        for (char* ptr = buffer;;) {
+            const FILE_NOTIFY_INFORMATION* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(ptr);
+            names.emplace_back(std::wstring(info->FileName, info->FileNameLength / sizeof(WCHAR)));
+            if (info->NextEntryOffset == 0) {
+                break;
+            }
+            ptr += info->NextEntryOffset;
+        }
+    }
+
+    if (!armDirectoryRead()) {
+        CloseHandle(directory);
+        directory = INVALID_HANDLE_VALUE;
+    }
+}
+
+void DirectoryWatch::wakeup() {
+    SetEvent(wake_event);
+}
+
+#else // No change notifications: only reload and stop requests wake the thread
+
+DirectoryWatch::DirectoryWatch() {}
+DirectoryWatch::~DirectoryWatch() {}
+
+bool DirectoryWatch::open(const fs::path&) {
+    return false;
+}
+
+void DirectoryWatch::wait(int timeout_ms, std::vector<fs::path>&, bool&) {
+    std::unique_lock<std::mutex> lock(wake_mutex);
+    if (timeout_ms < 0) {
+        wake_cv.wait(lock, [this]() { return woken; });
+    } else {
+        wake_cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this]() { return woken; });
+    }
+    woken = false;
+}
+
+void DirectoryWatch::wakeup() {
+    std::lock_guard<std::mutex> lock(wake_mutex);
+    woken = true;
+    wake_cv.notify_one();
+}
+
+#endif
+
+std::unique_ptr<DirectoryWatch> watch;
+std::thread watcher_thread;
+std::atomic<bool> watcher_running{false};
+std::atomic<bool> reload_requested{false};
+
+void watcherLoop() {
+    using clock = std::chrono::steady_clock;
+
+    // Track ids touched since the last update, applied once the directory has been quiet for a moment,
+    // or at the latest MAX_DEBOUNCE_PERIODS debounces after the first of them so a directory that never
+    // goes quiet (a long copy, a tagger rewriting files one by one) still reaches the catalog
+    constexpr int MAX_DEBOUNCE_PERIODS = 10;
+    std::set<std::string> pending;
+    clock::time_point apply_at;
+    clock::time_point apply_by;
+    std::vector<fs::path> names;
+
+    while (watcher_running) {
+        int timeout_ms = -1;
+        if (!pending.empty()) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(apply_at - clock::now()).count();
+            timeout_ms = static_cast<int>(std::max<int64_t>(0, remaining));
+        }
+
+        names.clear();
+        bool overflow = false;
+        watch->wait(timeout_ms, names, overflow);
+
+        for (const fs::path& name : names) {
+            // Only mp3 files and their sidecars matter; this also skips our own index writes
+            if (name.extension() == ".mp3" || name.extension() == fs::path(DESCRIPTION_EXT)) {
+                std::chrono::milliseconds debounce(currentConfig()->catalog_watch_debounce_ms);
+                if (pending.empty()) {
+                    apply_by = clock::now() + debounce * MAX_DEBOUNCE_PERIODS;
+                }
+                pending.insert(fromUtf8(name.stem().u8string()));
+                apply_at = std::min(clock::now() + debounce, apply_by);
+            }
+        }
+
+        bool reload = reload_requested.exchange(false);
+        if (reload) {
+            // An explicit reload re-reads the config file too, before the rescan that may use it
+            reloadServerConfig();
+        }
+        if (overflow || reload) {
+            pending.clear();
+            loadTrackCatalog();
+            continue;
+        }
+
+        if (!pending.empty() && clock::now() >= apply_at) {
+            updateCatalogTracks(std::vector<std::string>(pending.begin(), pending.end()));
+            pending.clear();
+        }
+    }
+}
+
+}
+
+void startCatalogWatcher() {
+    if (watcher_running) {
+        return;
+    }
+
+    watch = std::make_unique<DirectoryWatch>();
+    const std::u8string music_dir = currentConfig()->music_dir;
+    if (watch->open(fs::path(music_dir))) {
+        logMessage(LogLevel::Info, "Watching %s for changes", fromUtf8(music_dir).c_str());
+    } else {
+        logMessage(LogLevel::Warning, "File system notifications unavailable; catalog changes need /reload");
+    }
+
+    watcher_running = true;
+    watcher_thread = std::thread(watcherLoop);
+}
+
+void stopCatalogWatcher() {
+    if (!watcher_running.exchange(false)) {
+        return;
+    }
+    watch->wakeup();
+    watcher_thread.join();
+    watch.reset();
+}
+
+void requestCatalogReload() {
+    reload_requested = true;
+    if (watch) {
+        watch->wakeup();
+    }
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+// Background thread that keeps the catalog in sync with the music directory.
+// File system notifications (inotify on Linux, ReadDirectoryChangesW on Windows) are
+// batched and applied as incremental updates; full rescans run on the same thread.
+
+// Function to start watching the music directory; call after the initial loadTrackCatalog()
+void startCatalogWatcher();
+
+// Function to stop the watcher thread and wait for it to exit
+void stopCatalogWatcher();
+
+// Function to schedule a config file reload and a full rescan on the watcher thread; returns
+// immediately. On Linux it only sets a flag and writes to an eventfd, so it is safe in a signal handler.
+void requestCatalogReload();
@@ -0,0 +1,456 @@
+#include "pch.h"
+#include "Catalog/SearchIndex.h"
+#include "Utils/Hash.h"
+
+#include <algorithm>
+
+namespace {
+
+// Row tokens carry the field they came from in their top bits
+constexpr unsigned FIELD_SHIFT = 30;
+constexpr uint32_t TOKEN_MASK = (1u << FIELD_SHIFT) - 1;
+enum Field : uint32_t { TITLE, ARTIST, ALBUM };
+constexpr uint32_t FIELD_WEIGHTS[] = {4, 3, 2};
+
+// How a token matches a query term; multiplied by the field weight for the score
+enum MatchKind : uint8_t { NO_MATCH = 0, INFIX = 1, PREFIX = 2, EXACT = 3 };
+
+// Latin-1 Supplement and Latin Extended-A letters folded to lowercase ASCII
+struct Fold {
+    uint32_t first;
+    uint32_t last;
+    const char* replacement;
+};
+constexpr Fold FOLDS[] = {
+    {0xC0, 0xC5, "a"},   {0xC6, 0xC6, "ae"},  {0xC7, 0xC7, "c"},   {0xC8, 0xCB, "e"},   {0xCC, 0xCF, "i"},
+    {0xD0, 0xD0, "d"},   {0xD1, 0xD1, "n"},   {0xD2, 0xD6, "o"},   {0xD8, 0xD8, "o"},   {0xD9, 0xDC, "u"},
+    {0xDD, 0xDD, "y"},   {0xDE, 0xDE, "th"},  {0xDF, 0xDF, "ss"},  {0xE0, 0xE5, "a"},   {0xE6, 0xE6, "ae"},
+    {0xE7, 0xE7, "c"},   {0xE8, 0xEB, "e"},   {0xEC, 0xEF, "i"},   {0xF0, 0xF0, "d"},   {0xF1, 0xF1, "n"},
+    {0xF2, 0xF6, "o"},   {0xF8, 0xF8, "o"},   {0xF9, 0xFC, "u"},   {0xFD, 0xFD, "y"},   {0xFE, 0xFE, "th"},
+    {0xFF, 0xFF, "y"},   {0x100, 0x105, "a"}, {0x106, 0x10D, "c"}, {0x10E, 0x111, "d"}, {0x112, 0x11B, "e"},
+    {0x11C, 0x123, "g"}, {0x124, 0x127, "h"}, {0x128, 0x131, "i"}, {0x132, 0x133, "ij"}, {0x134, 0x135, "j"},
+    {0x136, 0x138, "k"}, {0x139, 0x142, "l"}, {0x143, 0x14B, "n"}, {0x14C, 0x151, "o"}, {0x152, 0x153, "oe"},
+    {0x154, 0x159, "r"}, {0x15A, 0x161, "s"}, {0x162, 0x167, "t"}, {0x168, 0x173, "u"}, {0x174, 0x175, "w"},
+    {0x176, 0x178, "y"}, {0x179, 0x17E, "z"}, {0x17F, 0x17F, "s"},
+};
+
+// Decode one code point; returns its length, or 0 for a byte that doesn't start valid UTF-8
+size_t decodeUtf8(const unsigned char* bytes, size_t available, uint32_t& code_point) {
+    unsigned char lead = bytes[0];
+    size_t length = lead < 0x80 ? 1 : lead >= 0xC2 && lead <= 0xDF ? 2 : lead >= 0xE0 && lead <= 0xEF ? 3
+                  : lead >= 0xF0 && lead <= 0xF4 ? 4 : 0;
+    if (length == 0 || length > available) {
+        return 0;
+    }
+    code_point = length == 1 ? lead : lead & (0x7F >> length);
+    for (size_t i = 1; i < length; ++i) {
+        if ((bytes[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+        code_point = (code_point << 6) | (bytes[i] & 0x3F);
+    }
+    return length;
+}
+
+void appendUtf8(std::string& out, uint32_t code_point) {
+    if (code_point < 0x80) {
+        out += static_cast<char>(code_point);
+    } else if (code_point < 0x800) {
+        out += static_cast<char>(0xC0 | (code_point >> 6));
+        out += static_cast<char>(0x80 | (code_point & 0x3F));
+    } else if (code_point < 0x10000) {
+        out += static_cast<char>(0xE0 | (code_point >> 12));
+        out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code_point & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (code_point >> 18));
+        out += static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code_point & 0x3F));
+    }
+}
+
+bool isSeparator(uint32_t code_point) {
+    return (code_point >= 0x80 && code_point <= 0xBF) || code_point == 0xD7 || code_point == 0xF7 ||
+           (code_point >= 0x2000 && code_point <= 0x206F) || (code_point >= 0x3000 && code_point <= 0x303F) ||
+           (code_point >= 0xFF01 && code_point <= 0xFF0F);
+}
+
+uint32_t trigramKey(const char* bytes) {
+    return (uint32_t(uint8_t(bytes[0])) << 16) | (uint32_t(uint8_t(bytes[1])) << 8) | uint8_t(bytes[2]);
+}
+
+// An incremental build keeps the tokens of removed and renamed tracks in the dictionary; once this
+// fraction of it (1/n) is tokens no row has any more, the index is rebuilt from scratch instead
+constexpr size_t DEAD_TOKEN_FRACTION = 4;
+
+size_t slotCountFor(size_t count) {
+    size_t slot_count = 16;
+    while (slot_count < count * 2) {
+        slot_count <<= 1;
+    }
+    return slot_count;
+}
+
+}
+
+void tokenizeSearchText(std::string_view text, std::vector<std::string>& tokens) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(text.data());
+    std::string token;
+    auto finish = [&]() {
+        if (!token.empty()) {
+            tokens.push_back(std::move(token));
+            token.clear();
+        }
+    };
+
+    for (size_t i = 0; i < text.size();) {
+        uint32_t code_point;
+        size_t length = decodeUtf8(bytes + i, text.size() - i, code_point);
+        if (length == 0) {
+            finish();
+            i++;
+            continue;
+        }
+        i += length;
+
+        if (code_point < 0x80) {
+            char c = static_cast<char>(code_point);
+            if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')) {
+                token += c;
+            } else if (c >= 'A' && c <= 'Z') {
+                token += static_cast<char>(c + ('a' - 'A'));
+            } else if (c != '\'') {
+                finish();
+            }
+            continue;
+        }
+        if (code_point == 0x2018 || code_point == 0x2019) {
+            continue;  // typographic apostrophes join like '
+        }
+        if (isSeparator(code_point)) {
+            finish();
+            continue;
+        }
+
+        const Fold* fold = std::find_if(std::begin(FOLDS), std::end(FOLDS), [&](const Fold& entry) {
+            return code_point >= entry.first && code_point <= entry.last;
+        });
+        if (fold != std::end(FOLDS)) {
+            token += fold->replacement;
+            continue;
+        }
+        // Greek and Cyrillic capitals
+        if ((code_point >= 0x391 && code_point <= 0x3A9) || (code_point >= 0x410 && code_point <= 0x42F)) {
+            code_point += 0x20;
+        } else if (code_point >= 0x400 && code_point <= 0x40F) {
+            code_point += 0x50;
+        }
+        appendUtf8(token, code_point);
+    }
+    finish();
+}
+
+struct SearchIndex::TermMatch {
+    uint32_t token;
+    MatchKind kind;
+
+    bool operator<(const TermMatch& other) const { return token < other.token; }
+};
+
+uint32_t SearchIndex::findToken(std::string_view token) const {
+    if (token_slots.empty()) {
+        return UINT32_MAX;
+    }
+    size_t mask = token_slots.size() - 1;
+    for (size_t i = fnv1aHash(token) & mask;; i = (i + 1) & mask) {
+        uint32_t slot = token_slots[i];
+        if (slot == 0) {
+            return UINT32_MAX;
+        }
+        const PooledString& entry = tokens[slot - 1];
+        if (std::string_view(token_pool.data() + entry.offset, entry.length) == token) {
+            return slot - 1;
+        }
+    }
+}
+
+uint32_t SearchIndex::addToken(std::string_view token) {
+    if ((tokens.size() + 1) * 2 > token_slots.size()) {
+        token_slots.assign(slotCountFor(tokens.size() + 1), 0);
+        size_t mask = token_slots.size() - 1;
+        for (size_t n = 0; n < tokens.size(); ++n) {
+            size_t i = fnv1aHash(std::string_view(token_pool.data() + tokens[n].offset, tokens[n].length)) & mask;
+            while (token_slots[i] != 0) {
+                i = (i + 1) & mask;
+            }
+            token_slots[i] = static_cast<uint32_t>(n + 1);
+        }
+    }
+
+    uint32_t id = static_cast<uint32_t>(tokens.size());
+    tokens.push_back({static_cast<uint32_t>(token_pool.size()), static_cast<uint32_t>(token.size())});
+    token_pool.append(token);
+
+    size_t mask = token_slots.size() - 1;
+    size_t i = fnv1aHash(token) & mask;
+    while (token_slots[i] != 0) {
+        i = (i + 1) & mask;
+    }
+    token_slots[i] = id + 1;
+    return id;
+}
+
+void SearchIndex::build(const TrackTable& tracks, const TrackTable* previous_tracks, const SearchIndex* previous) {
+    if (!previous_tracks || !previous) {
+        previous_tracks = nullptr;
+        previous = nullptr;
+    }
+
+    // Carry the dictionary over so unchanged rows' token ids stay valid
+    if (previous) {
+        token_pool = previous->token_pool;
+        tokens = previous->tokens;
+        token_slots = previous->token_slots;
+    } else {
+        token_pool.clear();
+        tokens.clear();
+        token_slots.clear();
+    }
+    size_t old_token_count = tokens.size();
+
+    row_offsets.assign(1, 0);
+    row_offsets.reserve(tracks.size() + 1);
+    row_tokens.clear();
+    row_tokens.reserve(previous ? previous->row_tokens.size() : tracks.size() * 8);
+
+    std::vector<std::string> words;
+    std::vector<uint32_t> tagged;
+    for (const TrackRow& row : tracks) {
+        const TrackRow* old = previous_tracks ? previous_tracks->find(tracks.text(row.id)) : nullptr;
+        if (old && old->file_stamp == row.file_stamp && old->description_stamp == row.description_stamp) {
+            size_t position = previous_tracks->position(*old);
+            row_tokens.insert(row_tokens.end(), previous->row_tokens.begin() + previous->row_offsets[position],
+                              previous->row_tokens.begin() + previous->row_offsets[position + 1]);
+            row_offsets.push_back(static_cast<uint32_t>(row_tokens.size()));
+            continue;
+        }
+
+        tagged.clear();
+        const PooledString fields[] = {row.title, row.artist, row.album};
+        for (uint32_t field = TITLE; field <= ALBUM; ++field) {
+            words.clear();
+            tokenizeSearchText(tracks.text(fields[field]), words);
+            for (const std::string& word : words) {
+                uint32_t id = findToken(word);
+                if (id == UINT32_MAX) {
+                    id = addToken(word);
+                }
+                tagged.push_back(id | (field << FIELD_SHIFT));
+            }
+        }
+        // One entry per token, keeping the most important field it appears in
+        std::sort(tagged.begin(), tagged.end(), [](uint32_t a, uint32_t b) {
+            return (a & TOKEN_MASK) != (b & TOKEN_MASK) ? (a & TOKEN_MASK) < (b & TOKEN_MASK) : a < b;
+        });
+        tagged.erase(std::unique(tagged.begin(), tagged.end(),
+                                 [](uint32_t a, uint32_t b) { return (a & TOKEN_MASK) == (b & TOKEN_MASK); }),
+                     tagged.end());
+        row_tokens.insert(row_tokens.end(), tagged.begin(), tagged.end());
+        row_offsets.push_back(static_cast<uint32_t>(row_tokens.size()));
+    }
+
+    // Postings by counting sort; rows are visited in order, so each list comes out ascending
+    posting_offsets.assign(tokens.size() + 1, 0);
+    for (uint32_t token : row_tokens) {
+        posting_offsets[(token & TOKEN_MASK) + 1]++;
+    }
+    if (previous) {
+        size_t dead = std::count(posting_offsets.begin() + 1, posting_offsets.end(), 0u);
+        if (dead * DEAD_TOKEN_FRACTION > tokens.size()) {
+            build(tracks);
+            return;
+        }
+    }
+    for (size_t i = 1; i < posting_offsets.size(); ++i) {
+        posting_offsets[i] += posting_offsets[i - 1];
+    }
+    postings.resize(row_tokens.size());
+    std::vector<uint32_t> fill(posting_offsets.begin(), posting_offsets.end() - 1);
+    for (size_t row = 0; row + 1 < row_offsets.size(); ++row) {
+        for (uint32_t i = row_offsets[row]; i < row_offsets[row + 1]; ++i) {
+            postings[fill[row_tokens[i] & TOKEN_MASK]++] = static_cast<uint32_t>(row);
+        }
+    }
+
+    // Sorted dictionary and trigrams: merge the new tokens into the previous generation's
+    auto tokenText = [this](uint32_t id) { return std::string_view(token_pool.data() + tokens[id].offset, tokens[id].length); };
+    std::vector<uint32_t> added(tokens.size() - old_token_count);
+    for (size_t i = 0; i < added.size(); ++i) {
+        added[i] = static_cast<uint32_t>(old_token_count + i);
+    }
+    std::sort(added.begin(), added.end(), [&](uint32_t a, uint32_t b) { return tokenText(a) < tokenText(b); });
+    sorted_tokens.clear();
+    sorted_tokens.reserve(tokens.size());
+    const std::vector<uint32_t> no_tokens;
+    const std::vector<uint32_t>& old_sorted = previous ? previous->sorted_tokens : no_tokens;
+    std::merge(old_sorted.begin(), old_sorted.end(), added.begin(), added.end(), std::back_inserter(sorted_tokens),
+               [&](uint32_t a, uint32_t b) { return tokenText(a) < tokenText(b); });
+
+    std::vector<std::pair<uint32_t, uint32_t>> added_trigrams;  // (trigram, token)
+    for (uint32_t id : added) {
+        std::string_view text = tokenText(id);
+        for (size_t i = 0; i + 3 <= text.size(); ++i) {
+            added_trigrams.emplace_back(trigramKey(text.data() + i), id);
+        }
+    }
+    std::sort(added_trigrams.begin(), added_trigrams.end());
+    added_trigrams.erase(std::unique(added_trigrams.begin(), added_trigrams.end()), added_trigrams.end());
+
+    // New token ids are all above the old ones, so appending them keeps each list ascending
+    const SearchIndex* old = previous;
+    trigram_keys.clear();
+    trigram_offsets.assign(1, 0);
+    trigram_tokens.clear();
+    size_t old_key = 0, next_added = 0;
+    size_t old_key_count = old ? old->trigram_keys.size() : 0;
+    while (old_key < old_key_count || next_added < added_trigrams.size()) {
+        uint32_t key = old_key < old_key_count ? old->trigram_keys[old_key] : UINT32_MAX;
+        if (next_added < added_trigrams.size()) {
+            key = std::min(key, added_trigrams[next_added].first);
+        }
+        trigram_keys.push_back(key);
+        if (old_key < old_key_count && old->trigram_keys[old_key] == key) {
+            trigram_tokens.insert(trigram_tokens.end(), old->trigram_tokens.begin() + old->trigram_offsets[old_key],
+                                  old->trigram_tokens.begin() + old->trigram_offsets[old_key + 1]);
+            old_key++;
+        }
+        while (next_added < added_trigrams.size() && added_trigrams[next_added].first == key) {
+            trigram_tokens.push_back(added_trigrams[next_added++].second);
+        }
+        trigram_offsets.push_back(static_cast<uint32_t>(trigram_tokens.size()));
+    }
+}
+
+void SearchIndex::matchTerm(std::string_view term, std::vector<TermMatch>& matches) const {
+    auto tokenText = [this](uint32_t id) { return std::string_view(token_pool.data() + tokens[id].offset, tokens[id].length); };
+
+    // Tokens the term is a prefix of form one range of the sorted dictionary
+    auto it = std::partition_point(sorted_tokens.begin(), sorted_tokens.end(),
+                                   [&](uint32_t id) { return tokenText(id) < term; });
+    for (; it != sorted_tokens.end() && tokenText(*it).starts_with(term); ++it) {
+        matches.push_back({*it, tokenText(*it).size() == term.size() ? EXACT : PREFIX});
+    }
+
+    // Tokens containing it further in: check those listed under the term's rarest trigram
+    if (term.size() >= 3) {
+        size_t best = SIZE_MAX, best_length = SIZE_MAX;
+        for (size_t i = 0; i + 3 <= term.size(); ++i) {
+            auto key = std::lower_bound(trigram_keys.begin(), trigram_keys.end(), trigramKey(term.data() + i));
+            if (key == trigram_keys.end() || *key != trigramKey(term.data() + i)) {
+                best_length = 0;  // some trigram occurs nowhere, so no token contains the term
+                break;
+            }
+            size_t index = key - trigram_keys.begin();
+            size_t length = trigram_offsets[index + 1] - trigram_offsets[index];
+            if (length < best_length) {
+                best = index;
+                best_length = length;
+            }
+        }
+        if (best_length != 0 && best != SIZE_MAX) {
+            for (uint32_t i = trigram_offsets[best]; i < trigram_offsets[best + 1]; ++i) {
+                std::string_view text = tokenText(trigram_tokens[i]);
+                size_t found = text.find(term);
+                if (found != std::string_view::npos && found != 0) {
+                    matches.push_back({trigram_tokens[i], INFIX});
+                }
+            }
+        }
+    }
+    std::sort(matches.begin(), matches.end());
+}
+
+size_t SearchIndex::search(std::string_view query, size_t offset, size_t limit, std::vector<uint32_t>& rows) const {
+    std::vector<std::string> terms;
+    tokenizeSearchText(query, terms);
+    std::sort(terms.begin(), terms.end());
+    terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+    if (terms.empty()) {
+        return 0;
+    }
+
+    // Resolve every term to its matching tokens; candidates come from the term with the fewest postings
+    std::vector<std::vector<TermMatch>> term_matches(terms.size());
+    size_t rarest = 0, rarest_postings = SIZE_MAX;
+    for (size_t t = 0; t < terms.size(); ++t) {
+        matchTerm(terms[t], term_matches[t]);
+        size_t posting_count = 0;
+        for (const TermMatch& match : term_matches[t]) {
+            posting_count += posting_offsets[match.token + 1] - posting_offsets[match.token];
+        }
+        if (posting_count == 0) {
+            return 0;
+        }
+        if (posting_count < rarest_postings) {
+            rarest = t;
+            rarest_postings = posting_count;
+        }
+    }
+
+    std::vector<uint32_t> candidates;
+    candidates.reserve(rarest_postings);
+    for (const TermMatch& match : term_matches[rarest]) {
+        candidates.insert(candidates.end(), postings.begin() + posting_offsets[match.token],
+                          postings.begin() + posting_offsets[match.token + 1]);
+    }
+    if (term_matches[rarest].size() > 1) {
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    }
+
+    // Score each candidate on every term: the best field and match kind among its tokens
+    struct Scored {
+        uint32_t score;
+        uint32_t row;
+    };
+    std::vector<Scored> scored;
+    for (uint32_t row : candidates) {
+        uint32_t score = 0;
+        for (const std::vector<TermMatch>& matches : term_matches) {
+            uint32_t best = 0;
+            for (uint32_t i = row_offsets[row]; i < row_offsets[row + 1]; ++i) {
+                uint32_t token = row_tokens[i] & TOKEN_MASK;
+                auto match = std::lower_bound(matches.begin(), matches.end(), TermMatch{token, NO_MATCH});
+                if (match != matches.end() && match->token == token) {
+                    best = std::max(best, FIELD_WEIGHTS[row_tokens[i] >> FIELD_SHIFT] * match->kind);
+                }
+            }
+            if (best == 0) {
+                score = 0;
+                break;
+            }
+            score += best;
+        }
+        if (score > 0) {
+            scored.push_back({score, row});
+        }
+    }
+
+    // Best first, ties in id order; only the requested page needs to be sorted
+    auto better = [](const Scored& a, const Scored& b) { return a.score != b.score ? a.score > b.score : a.row < b.row; };
+    size_t first = std::min(offset, scored.size());
+    size_t last = first + std::min(limit, scored.size() - first);
+    std::partial_sort(scored.begin(), scored.begin() + last, scored.end(), better);
+    for (size_t i = first; i < last; ++i) {
+        rows.push_back(scored[i].row);
+    }
+    return scored.size();
+}
+
+size_t SearchIndex::memoryUsage() const {
+    return token_pool.capacity() + tokens.capacity() * sizeof(PooledString) +
+           (token_slots.capacity() + sorted_tokens.capacity() + row_offsets.capacity() + row_tokens.capacity() +
+            posting_offsets.capacity() + postings.capacity() + trigram_keys.capacity() + trigram_offsets.capacity() +
+            trigram_tokens.capacity()) * sizeof(uint32_t);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Catalog/TrackTable.h"
+
+#include <string_view>
+
+// Split text into normalized search tokens: lowercase, Latin diacritics folded ("Björk" -> "bjork"),
+// apostrophes dropped ("Don't" -> "dont") and anything else that isn't a letter or digit a separator
+void tokenizeSearchText(std::string_view text, std::vector<std::string>& tokens);
+
+// Inverted index over the titles, artists and albums of one TrackTable.
+// Query terms match tokens they are a prefix of and, from three characters on, tokens they occur
+// in anywhere (via a trigram index of the token dictionary). Results are ranked by which field
+// matched and how closely. An index for the next generation can be built from the previous one,
+// re-tokenizing only the tracks that changed.
+class SearchIndex {
+public:
+    // Build for tracks. With a previous generation, rows whose files are unchanged reuse its tokens
+    // and its dictionary is extended rather than rebuilt, until a quarter of it is tokens no track
+    // has any more; then the index is built afresh.
+    void build(const TrackTable& tracks, const TrackTable* previous_tracks = nullptr, const SearchIndex* previous = nullptr);
+
+    // Rows of the indexed table matching every term of query, best match first; returns how many
+    // matched in total and appends those from offset up to limit of them to rows
+    size_t search(std::string_view query, size_t offset, size_t limit, std::vector<uint32_t>& rows) const;
+
+    size_t tokenCount() const { return tokens.size(); }
+    size_t memoryUsage() const;
+
+private:
+    struct TermMatch;
+
+    uint32_t findToken(std::string_view token) const;
+    uint32_t addToken(std::string_view token);
+    void matchTerm(std::string_view term, std::vector<TermMatch>& matches) const;
+
+    // Token dictionary; ids are stable from one generation to the next
+    std::string token_pool;
+    std::vector<PooledString> tokens;
+    std::vector<uint32_t> token_slots;    // open-addressing, token id + 1
+    std::vector<uint32_t> sorted_tokens;  // token ids in byte order, for prefix ranges
+
+    // Per row: its distinct tokens, each tagged with the field it came from in the top bits
+    std::vector<uint32_t> row_offsets;
+    std::vector<uint32_t> row_tokens;
+
+    // Per token: the rows containing it, ascending
+    std::vector<uint32_t> posting_offsets;
+    std::vector<uint32_t> postings;
+
+    // Per trigram of token bytes: tokens containing it, ascending
+    std::vector<uint32_t> trigram_keys;  // sorted
+    std::vector<uint32_t> trigram_offsets;
+    std::vector<uint32_t> trigram_tokens;
+};
@@ -0,0 +1,350 @@
+#include "pch.h"
+#include "ServerConfig.h"
+#include "Catalog/TrackCatalog.h"
+#include "Catalog/CatalogIndex.h"
+#include "Catalog/CatalogQuery.h"
+#include "Media/Mp3.h"
+#include "Net/FileBody.h"
+#include "Net/PrecompressedCache.h"
+#include "Utils/Utf8.h"
+#include "Utils/Compression.h"
+#include "Utils/Hash.h"
+#include "Utils/Logger.h"
+#include "Utils/Metrics.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+// Published snapshot; swapped atomically, never modified after publication
+static std::atomic<std::shared_ptr<const CatalogSnapshot>> current_catalog{std::make_shared<const CatalogSnapshot>()};
+static std::mutex reload_mutex;
+static uint64_t catalog_generation = 0;  // guarded by reload_mutex
+
+std::shared_ptr<const CatalogSnapshot> currentCatalog() {
+    return current_catalog.load();
+}
+
+FileStamp FileStamp::of(const std::filesystem::path& path) {
+    FileStamp stamp;
+    std::error_code ec;
+    auto mtime = std::filesystem::last_write_time(path, ec);
+    if (ec) {
+        return stamp;
+    }
+    uint64_t size = std::filesystem::file_size(path, ec);
+    if (ec) {
+        return stamp;
+    }
+    stamp.exists = true;
+    stamp.mtime = static_cast<int64_t>(mtime.time_since_epoch().count());
+    stamp.size = size;
+    return stamp;
+}
+
+int64_t FileStamp::modifiedSeconds() const {
+    using FileTime = std::filesystem::file_time_type;
+    auto modified = std::chrono::file_clock::to_sys(FileTime(FileTime::duration(mtime)));
+    return std::chrono::floor<std::chrono::seconds>(modified).time_since_epoch().count();
+}
+
+void buildCatalogResponse(CatalogSnapshot& snapshot) {
+    // The unfiltered query: every track in id order, so identical catalogs produce identical bytes
+    std::string body;
+    body.reserve(snapshot.tracks.size() * 128);
+    runCatalogQuery(snapshot.tracks, CatalogQuery(), body);
+
+    CatalogResponse& response = snapshot.response;
+    // The ETag depends only on the content, so an unchanged catalog keeps its ETag across reloads and restarts
+    char hash_hex[17];
+    snprintf(hash_hex, sizeof(hash_hex), "%016llx", static_cast<unsigned long long>(fnv1aHash(body)));
+    response.etag = "\"" + std::string(hash_hex) + "\"";
+    response.body = precompress(std::move(body), 9, currentConfig()->catalog_brotli_quality);
+}
+
+// Function to make a fully built snapshot visible to readers
+static void publishCatalog(std::shared_ptr<CatalogSnapshot> snapshot) {
+    snapshot->generation = ++catalog_generation;
+    buildCatalogResponse(*snapshot);
+    current_catalog.store(std::move(snapshot));
+}
+
+// Function to fill a track's metadata from its description sidecar, creating a default one if missing
+static void loadTrackDescription(TrackInfo& track, const ServerConfig& config) {
+    const std::u8string& id = track.id;
+    const std::u8string& description_path = track.description_path;
+
+    // Default values in case description file doesn't exist
+    track.title = id;
+    track.artist = toUtf8("Unknown");
+    track.album = toUtf8("Unknown");
+    // Sidecars without a duration (or with 0, as auto-created ones used to have) get the measured one
+    int measured_duration = static_cast<int>((track.seek_index.duration_ms + 500) / 1000);
+    track.duration = measured_duration;
+
+    // Try to load description file if it exists
+    if (track.description_stamp.exists) {
+        // Open JSON description file in binary mode to avoid encoding issues
+        std::ifstream desc_file(fromUtf8(description_path), std::ios::binary);
+        if (desc_file.is_open()) {
+            std::string contents((std::istreambuf_iterator<char>(desc_file)), std::istreambuf_iterator<char>());
+            desc_file.close();
+            // Skip UTF-8 BOM if present
+            if (contents.starts_with("\xEF\xBB\xBF")) {
+                contents.erase(0, 3);
+            }
+            try {
+                json desc_data = json::parse(contents);
+                track.title = toUtf8(desc_data.value("title", fromUtf8(id)));
+                track.artist = toUtf8(desc_data.value("artist", "Unknown"));
+                track.album = toUtf8(desc_data.value("album", "Unknown"));
+                int duration = desc_data.value("duration", 0);
+                if (duration > 0) {
+                    track.duration = duration;
+                }
+            }
+            catch (const std::exception& e) {
+                logMessage(LogLevel::Warning, "Error parsing %s: %s", fromUtf8(description_path).c_str(), e.what());
+            }
+
+            // Compress it now, while it is in hand, so /description never has to
+            if (contents.size() <= config.description_cache_max_file_bytes) {
+                descriptionCache().store(fromUtf8(description_path), track.description_stamp,
+                                         precompress(std::move(contents), 9, config.description_brotli_quality));
+            }
+        }
+    }
+    else {
+        // Create a default description file with UTF-8 encoding
+        json desc_data;
+        desc_data["title"] = fromUtf8(id);
+        desc_data["artist"] = "Unknown";
+        desc_data["album"] = "Unknown";
+        desc_data["duration"] = measured_duration;
+
+        // Open JSON description file in binary mode for writing with UTF-8 encoding
+        std::ofstream desc_file(fromUtf8(description_path), std::ios::binary);
+        if (desc_file.is_open()) {
+            // Add a UTF-8 BOM at the start
+            desc_file << '\xEF' << '\xBB' << '\xBF';
+            // Write JSON with proper UTF-8 encoding
+            desc_file << desc_data.dump(4);
+            desc_file.close();
+        }
+        else {
+            logMessage(LogLevel::Warning, "Failed to create description file: %s", fromUtf8(description_path).c_str());
+        }
+
+        // Record the file we just wrote so the next load can reuse it from the index
+        track.description_stamp = FileStamp::of(fs::path(description_path));
+    }
+}
+
+// Function to index a track's mp3 frames for seeking and to measure its duration
+static void loadSeekIndex(TrackInfo& track) {
+    std::shared_ptr<FileBody> file = FileBody::open(fromUtf8(track.filepath));
+    if (!file || !buildMp3SeekIndex(*file, track.seek_index)) {
+        logMessage(LogLevel::Debug, "No MP3 frames found in %s; ?t= seeking disabled", fromUtf8(track.filepath).c_str());
+    }
+}
+
+// Function to run work(i) for every i in [0, count) across the available cores
+static void parallelFor(size_t count, const std::function<void(size_t)>& work) {
+    // Small batches aren't worth the thread start-up cost
+    size_t thread_count = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), (count + 15) / 16);
+    if (thread_count <= 1) {
+        for (size_t i = 0; i < count; ++i) {
+            work(i);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&]() {
+            for (size_t i = next++; i < count; i = next++) {
+                work(i);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+// Function to describe the track for an mp3 path without reading any file contents
+static TrackInfo makeTrack(const fs::path& mp3_path, const ServerConfig& config) {
+    TrackInfo track;
+    // Use stem() to get the filename without any extension
+    track.id = toUtf8(mp3_path.stem().string());
+    track.filepath = toUtf8(mp3_path.string());
+    track.description_path = config.music_dir + track.id + DESCRIPTION_EXT;
+    track.file_stamp = FileStamp::of(mp3_path);
+    track.description_stamp = FileStamp::of(fs::path(track.description_path));
+    return track;
+}
+
+// Function to persist a snapshot's tracks so the next start-up can skip unchanged sidecars
+static void writeCatalogIndex(const CatalogSnapshot& snapshot, const ServerConfig& config) {
+    std::string index_path = fromUtf8(config.catalogIndexPath());
+    if (!CatalogIndex::write(index_path, snapshot.tracks)) {
+        logMessage(LogLevel::Warning, "Failed to write catalog index: %s", index_path.c_str());
+    }
+}
+
+// Holds reload_mutex for one rebuild and reports how long it waited for and held it
+class ReloadLock {
+public:
+    ReloadLock() : wait_started(std::chrono::steady_clock::now()), lock(reload_mutex),
+                   acquired(std::chrono::steady_clock::now()) {}
+    ~ReloadLock() { recordCatalogLoad(acquired - wait_started, std::chrono::steady_clock::now() - acquired); }
+
+private:
+    std::chrono::steady_clock::time_point wait_started;
+    std::lock_guard<std::mutex> lock;
+    std::chrono::steady_clock::time_point acquired;
+};
+
+// Function to load track catalog from the music directory
+void loadTrackCatalog() {
+    // Only one rebuild at a time; readers are never blocked by it
+    ReloadLock lock;
+
+    // Build the next generation off to the side, then swap it in
+    auto snapshot = std::make_shared<CatalogSnapshot>();
+    std::shared_ptr<const ServerConfig> config = currentConfig();
+    const std::u8string& music_dir = config->music_dir;
+
+    try {
+        if (!fs::exists(music_dir)) {
+            fs::create_directory(music_dir);
+            logMessage(LogLevel::Info, "Created music directory: %s", fromUtf8(music_dir).c_str());
+            publishCatalog(std::move(snapshot));
+            return;
+        }
+
+        std::vector<TrackInfo> scanned;
+        std::vector<size_t> changed;  // positions in scanned whose sidecar must be parsed
+        size_t indexed_count = 0;
+        {
+            CatalogIndex index;
+            index.open(fromUtf8(config->catalogIndexPath()));
+
+            for (const auto& entry : fs::directory_iterator(music_dir)) {
+                if (entry.path().extension() != ".mp3") {
+                    continue;
+                }
+
+                // Unchanged mp3 and sidecar: take the metadata straight from the mapped index
+                TrackInfo track = makeTrack(entry.path(), *config);
+                if (!index.lookup(track)) {
+                    changed.push_back(scanned.size());
+                }
+                scanned.push_back(std::move(track));
+            }
+            indexed_count = index.size();
+        }
+
+        // Index the mp3s and parse the sidecars that changed since the index was written
+        parallelFor(changed.size(), [&](size_t i) {
+            loadSeekIndex(scanned[changed[i]]);
+            loadTrackDescription(scanned[changed[i]], *config);
+        });
+
+        TrackTable::Builder builder;
+        builder.reserve(scanned.size());
+        for (const TrackInfo& track : scanned) {
+            builder.add(track);
+        }
+        snapshot->tracks = builder.build();
+        snapshot->search.build(snapshot->tracks);
+
+        logMessage(LogLevel::Info, "Loaded %zu tracks into catalog (%zu from index, %zu parsed).", snapshot->tracks.size(),
+                   scanned.size() - changed.size(), changed.size());
+
+        // Tracks added, changed or removed: refresh the index for the next start-up
+        if (!changed.empty() || indexed_count != scanned.size()) {
+            writeCatalogIndex(*snapshot, *config);
+        }
+    }
+    catch (const std::exception& e) {
+        // A partial scan must not replace a good catalog; the next reload or watcher delta tries again
+        logMessage(LogLevel::Error, "Error loading track catalog, keeping the current one: %s", e.what());
+        return;
+    }
+
+    publishCatalog(std::move(snapshot));
+}
+
+void updateCatalogTracks(const std::vector<std::string>& track_ids) {
+    ReloadLock lock;
+
+    // Copy-on-write: start from the published generation and patch only the named tracks
+    std::shared_ptr<const CatalogSnapshot> current = currentCatalog();
+    const TrackTable& existing = current->tracks;
+    std::vector<TrackInfo> loaded;
+    std::unordered_set<std::string_view> replaced;  // ids whose existing rows are dropped
+    auto snapshot = std::make_shared<CatalogSnapshot>();
+    std::shared_ptr<const ServerConfig> config = currentConfig();
+
+    size_t added = 0, updated = 0, removed = 0;
+    try {
+        for (const std::string& id : track_ids) {
+            fs::path mp3_path = fs::path(config->music_dir) / fs::path(toUtf8(id + ".mp3"));
+            TrackInfo track = makeTrack(mp3_path, *config);
+
+            const TrackRow* row = existing.find(id);
+            if (!track.file_stamp.exists) {
+                if (row) {
+                    replaced.insert(id);
+                    removed++;
+                }
+                continue;
+            }
+
+            if (row && row->file_stamp == track.file_stamp && row->description_stamp == track.description_stamp) {
+                continue;  // e.g. the event was for a sidecar we wrote ourselves
+            }
+
+            loadSeekIndex(track);
+            loadTrackDescription(track, *config);
+            if (row) {
+                replaced.insert(id);
+                updated++;
+            } else {
+                added++;
+            }
+            loaded.push_back(std::move(track));
+        }
+
+        if (added + updated + removed == 0) {
+            return;
+        }
+
+        TrackTable::Builder builder;
+        builder.reserve(existing.size() + added);
+        for (const TrackRow& row : existing) {
+            if (!replaced.count(existing.text(row.id))) {
+                builder.add(existing, row);
+            }
+        }
+        for (const TrackInfo& track : loaded) {
+            builder.add(track);
+        }
+        snapshot->tracks = builder.build();
+        // Only the re-read tracks are tokenized again
+        snapshot->search.build(snapshot->tracks, &existing, &current->search);
+    }
+    catch (const std::exception& e) {
+        logMessage(LogLevel::Error, "Error updating track catalog: %s", e.what());
+        return;
+    }
+
+    logMessage(LogLevel::Info, "Catalog updated: %zu added, %zu changed, %zu removed (%zu tracks).", added, updated,
+               removed, snapshot->tracks.size());
+    writeCatalogIndex(*snapshot, *config);
+    publishCatalog(std::move(snapshot));
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "Catalog/TrackTable.h"
+#include "Catalog/SearchIndex.h"
+#include "CatalogResponse.h"
+
+// Immutable view of the whole catalog for one generation.
+// Readers take a reference with currentCatalog() and never lock; a reload builds a
+// new snapshot off to the side and publishes it atomically.
+struct CatalogSnapshot {
+    uint64_t generation = 0;
+    TrackTable tracks;
+    SearchIndex search;  // over tracks
+    CatalogResponse response;
+};
+
+// Latest published snapshot; empty until the first loadTrackCatalog()
+std::shared_ptr<const CatalogSnapshot> currentCatalog();
+
+// Function to serialize a snapshot's /catalog response (body, compressed variants, ETag) from its tracks;
+// run once per generation before the snapshot is published
+void buildCatalogResponse(CatalogSnapshot& snapshot);
+
+// Function to rescan the music directory and publish the result as a new generation
+void loadTrackCatalog();
+
+// Function to re-examine the named tracks (mp3 stems) and publish a new generation if any
+// of them were added, changed or removed; the rest of the catalog is carried over untouched
+void updateCatalogTracks(const std::vector<std::string>& track_ids);
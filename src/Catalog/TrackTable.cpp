@@ -0,0 +1,245 @@
+#include "pch.h"
+#include "Catalog/TrackTable.h"
+#include "Utils/Hash.h"
+#include "Utils/Utf8.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+// Slot count keeping an open-addressing index of count entries at most half full
+static size_t slotCountFor(size_t count) {
+    size_t slot_count = 16;
+    while (slot_count < count * 2) {
+        slot_count <<= 1;
+    }
+    return slot_count;
+}
+
+static unsigned char foldCase(unsigned char c) {
+    return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+// Three-way comparison ignoring ASCII case; other bytes compare as themselves
+static int compareFolded(std::string_view a, std::string_view b) {
+    size_t length = std::min(a.size(), b.size());
+    for (size_t i = 0; i < length; ++i) {
+        unsigned char x = foldCase(a[i]), y = foldCase(b[i]);
+        if (x != y) {
+            return x < y ? -1 : 1;
+        }
+    }
+    return a.size() == b.size() ? 0 : (a.size() < b.size() ? -1 : 1);
+}
+
+const TrackRow* TrackTable::find(std::string_view id) const {
+    if (slots.empty()) {
+        return nullptr;
+    }
+    size_t mask = slots.size() - 1;
+    for (size_t i = fnv1aHash(id) & mask;; i = (i + 1) & mask) {
+        uint32_t slot = slots[i];
+        if (slot == 0) {
+            return nullptr;
+        }
+        const TrackRow& row = rows[slot - 1];
+        if (text(row.id) == id) {
+            return &row;
+        }
+    }
+}
+
+std::span<const uint32_t> TrackTable::equalRange(const std::vector<uint32_t>& index, PooledString TrackRow::*field,
+                                                 std::string_view value, bool prefix) const {
+    auto first = std::partition_point(index.begin(), index.end(), [&](uint32_t row) {
+        return compareFolded(text(rows[row].*field), value) < 0;
+    });
+    auto last = std::partition_point(first, index.end(), [&](uint32_t row) {
+        std::string_view key = text(rows[row].*field);
+        return compareFolded(prefix ? key.substr(0, value.size()) : key, value) == 0;
+    });
+    return std::span<const uint32_t>(index.data() + (first - index.begin()), last - first);
+}
+
+std::span<const uint32_t> TrackTable::rowsWithArtist(std::string_view artist) const {
+    return equalRange(by_artist, &TrackRow::artist, artist, false);
+}
+
+std::span<const uint32_t> TrackTable::rowsWithAlbum(std::string_view album) const {
+    return equalRange(by_album, &TrackRow::album, album, false);
+}
+
+std::span<const uint32_t> TrackTable::rowsWithTitlePrefix(std::string_view prefix) const {
+    return equalRange(by_title, &TrackRow::title, prefix, true);
+}
+
+size_t TrackTable::memoryUsage() const {
+    size_t bytes = pool.capacity() + rows.capacity() * sizeof(TrackRow) +
+                   seek_indexes.capacity() * sizeof(Mp3SeekIndex) +
+                   (slots.capacity() + by_artist.capacity() + by_album.capacity() + by_title.capacity()) * sizeof(uint32_t);
+    for (const Mp3SeekIndex& index : seek_indexes) {
+        bytes += index.points.capacity() * sizeof(uint32_t);
+    }
+    return bytes;
+}
+
+void TrackTable::Builder::reserve(size_t track_count) {
+    table.rows.reserve(track_count);
+    table.seek_indexes.reserve(track_count);
+    // Ids appear three times (id and both paths); a rough guess saves most of the regrowth
+    table.pool.reserve(track_count * 128);
+}
+
+PooledString TrackTable::Builder::append(std::string_view value) {
+    if (table.pool.size() + value.size() > UINT32_MAX) {
+        throw std::length_error("Catalog strings exceed 4 GiB");
+    }
+    PooledString string{static_cast<uint32_t>(table.pool.size()), static_cast<uint32_t>(value.size())};
+    table.pool.append(value);
+    return string;
+}
+
+PooledString TrackTable::Builder::intern(std::string_view value) {
+    if ((interned.size() + 1) * 2 > intern_slots.size()) {
+        // Grow and re-insert everything interned so far
+        intern_slots.assign(slotCountFor(interned.size() + 1), 0);
+        size_t mask = intern_slots.size() - 1;
+        for (size_t n = 0; n < interned.size(); ++n) {
+            size_t i = fnv1aHash(table.text(interned[n])) & mask;
+            while (intern_slots[i] != 0) {
+                i = (i + 1) & mask;
+            }
+            intern_slots[i] = static_cast<uint32_t>(n + 1);
+        }
+    }
+
+    size_t mask = intern_slots.size() - 1;
+    for (size_t i = fnv1aHash(value) & mask;; i = (i + 1) & mask) {
+        uint32_t slot = intern_slots[i];
+        if (slot == 0) {
+            interned.push_back(append(value));
+            intern_slots[i] = static_cast<uint32_t>(interned.size());
+            return interned.back();
+        }
+        if (table.text(interned[slot - 1]) == value) {
+            return interned[slot - 1];
+        }
+    }
+}
+
+void TrackTable::Builder::add(const TrackInfo& track) {
+    TrackRow row;
+    row.id = append(viewUtf8(track.id));
+    row.title = intern(viewUtf8(track.title));
+    row.artist = intern(viewUtf8(track.artist));
+    row.album = intern(viewUtf8(track.album));
+    row.filepath = append(viewUtf8(track.filepath));
+    row.description_path = append(viewUtf8(track.description_path));
+    row.duration = track.duration;
+    row.file_stamp = track.file_stamp;
+    row.description_stamp = track.description_stamp;
+    table.rows.push_back(row);
+    table.seek_indexes.push_back(track.seek_index);
+}
+
+void TrackTable::Builder::add(const TrackTable& source, const TrackRow& source_row) {
+    TrackRow row = source_row;
+    row.id = append(source.text(source_row.id));
+    row.title = intern(source.text(source_row.title));
+    row.artist = intern(source.text(source_row.artist));
+    row.album = intern(source.text(source_row.album));
+    row.filepath = append(source.text(source_row.filepath));
+    row.description_path = append(source.text(source_row.description_path));
+    table.rows.push_back(row);
+    table.seek_indexes.push_back(source.seekIndex(source_row));
+}
+
+TrackTable TrackTable::Builder::build() {
+    // Id order; the stable sort leaves duplicates in the order they were added, and the last one wins
+    std::vector<uint32_t> order(table.rows.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+        return table.text(table.rows[a].id) < table.text(table.rows[b].id);
+    });
+
+    TrackTable result;
+    result.rows.reserve(order.size());
+    result.seek_indexes.reserve(order.size());
+    for (size_t n = 0; n < order.size(); ++n) {
+        const TrackRow& row = table.rows[order[n]];
+        if (n + 1 < order.size() && table.text(table.rows[order[n + 1]].id) == table.text(row.id)) {
+            continue;
+        }
+        result.rows.push_back(row);
+        result.seek_indexes.push_back(std::move(table.seek_indexes[order[n]]));
+    }
+    result.pool = std::move(table.pool);
+    result.pool.shrink_to_fit();
+
+    result.slots.assign(slotCountFor(result.rows.size()), 0);
+    size_t mask = result.slots.size() - 1;
+    for (size_t n = 0; n < result.rows.size(); ++n) {
+        size_t i = fnv1aHash(result.text(result.rows[n].id)) & mask;
+        while (result.slots[i] != 0) {
+            i = (i + 1) & mask;
+        }
+        result.slots[i] = static_cast<uint32_t>(n + 1);
+    }
+
+    // Secondary indexes. Every title, artist and album went through intern(), so rank the distinct
+    // strings once (equal ranks for values equal but for case) and sort rows by (rank, id) integers.
+    // The first eight folded bytes decide most comparisons without going back to the pool.
+    struct Keyed {
+        uint64_t prefix;
+        PooledString string;
+    };
+    std::vector<Keyed> distinct;
+    distinct.reserve(interned.size());
+    for (PooledString string : interned) {
+        std::string_view value = result.text(string);
+        uint64_t prefix = 0;
+        for (size_t i = 0; i < 8; ++i) {
+            prefix = (prefix << 8) | (i < value.size() ? foldCase(value[i]) : 0);
+        }
+        distinct.push_back({prefix, string});
+    }
+    auto folded = [&result](const Keyed& a, const Keyed& b) {
+        return a.prefix != b.prefix ? (a.prefix < b.prefix ? -1 : 1) : compareFolded(result.text(a.string), result.text(b.string));
+    };
+    std::sort(distinct.begin(), distinct.end(), [&](const Keyed& a, const Keyed& b) { return folded(a, b) < 0; });
+    // Keyed by offset and length together: an interned "" shares its offset with the next string
+    auto locate = [](PooledString string) { return (uint64_t(string.offset) << 32) | string.length; };
+    std::vector<std::pair<uint64_t, uint32_t>> rank_by_location;  // (location, rank), sorted by location
+    rank_by_location.reserve(distinct.size());
+    uint32_t rank = 0;
+    for (size_t n = 0; n < distinct.size(); ++n) {
+        if (n > 0 && folded(distinct[n - 1], distinct[n]) != 0) {
+            rank++;
+        }
+        rank_by_location.emplace_back(locate(distinct[n].string), rank);
+    }
+    std::sort(rank_by_location.begin(), rank_by_location.end());
+
+    auto sortedBy = [&](PooledString TrackRow::*field) {
+        std::vector<uint64_t> keys(result.rows.size());
+        for (size_t n = 0; n < result.rows.size(); ++n) {
+            auto found = std::lower_bound(rank_by_location.begin(), rank_by_location.end(),
+                                          std::make_pair(locate(result.rows[n].*field), uint32_t(0)));
+            keys[n] = (uint64_t(found->second) << 32) | n;
+        }
+        std::sort(keys.begin(), keys.end());
+        std::vector<uint32_t> index(keys.size());
+        for (size_t n = 0; n < keys.size(); ++n) {
+            index[n] = static_cast<uint32_t>(keys[n]);
+        }
+        return index;
+    };
+    result.by_artist = sortedBy(&TrackRow::artist);
+    result.by_album = sortedBy(&TrackRow::album);
+    result.by_title = sortedBy(&TrackRow::title);
+
+    table = TrackTable();
+    interned.clear();
+    intern_slots.clear();
+    return result;
+}
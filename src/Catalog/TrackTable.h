@@ -0,0 +1,99 @@
+#pragma once
+
+#include "TrackInfo.h"
+
+#include <span>
+#include <string_view>
+
+// Offset and length of a string in a TrackTable's pool
+struct PooledString {
+    uint32_t offset = 0;
+    uint32_t length = 0;
+};
+
+// One track as a TrackTable stores it: fixed size, with every string kept in the table's pool
+struct TrackRow {
+    PooledString id;
+    PooledString title;
+    PooledString artist;
+    PooledString album;
+    PooledString filepath;
+    PooledString description_path;
+    int32_t duration;  // in seconds
+    FileStamp file_stamp;
+    FileStamp description_stamp;
+};
+
+// Compact, immutable storage for a catalog's tracks.
+// Rows sit in one array in id order, all their strings in one contiguous pool (titles, artists
+// and albums interned, so an album shared by a dozen tracks is stored once), and ids are found
+// through a flat open-addressing index that is probed with a string_view, never a temporary.
+// Secondary indexes by artist, album and title serve filtered /catalog queries.
+// Built once with a Builder and never modified, so it is safe to read from any thread.
+class TrackTable {
+public:
+    class Builder;
+
+    size_t size() const { return rows.size(); }
+    bool empty() const { return rows.empty(); }
+
+    // Rows in id order
+    const TrackRow& operator[](size_t index) const { return rows[index]; }
+    std::vector<TrackRow>::const_iterator begin() const { return rows.begin(); }
+    std::vector<TrackRow>::const_iterator end() const { return rows.end(); }
+
+    std::string_view text(PooledString string) const { return std::string_view(pool.data() + string.offset, string.length); }
+
+    // Position of a row of this table
+    size_t position(const TrackRow& row) const { return &row - rows.data(); }
+
+    // Seek index of a row of this table; kept apart from the rows as only streams need it
+    const Mp3SeekIndex& seekIndex(const TrackRow& row) const { return seek_indexes[position(row)]; }
+
+    // Returns nullptr if there is no track with this id
+    const TrackRow* find(std::string_view id) const;
+
+    // Positions of the rows whose artist or album equals value, or whose title starts with
+    // prefix, all ignoring ASCII case; ordered by that field, then by id
+    std::span<const uint32_t> rowsWithArtist(std::string_view artist) const;
+    std::span<const uint32_t> rowsWithAlbum(std::string_view album) const;
+    std::span<const uint32_t> rowsWithTitlePrefix(std::string_view prefix) const;
+
+    // Bytes held by the rows, pool and indexes
+    size_t memoryUsage() const;
+
+private:
+    std::span<const uint32_t> equalRange(const std::vector<uint32_t>& index, PooledString TrackRow::*field,
+                                         std::string_view value, bool prefix) const;
+
+    std::string pool;
+    std::vector<TrackRow> rows;
+    std::vector<Mp3SeekIndex> seek_indexes;  // parallel to rows
+    std::vector<uint32_t> slots;             // row + 1, or 0 when empty; size is a power of two
+    std::vector<uint32_t> by_artist;         // row positions sorted by artist (folded), then id
+    std::vector<uint32_t> by_album;
+    std::vector<uint32_t> by_title;
+};
+
+// Collects tracks, in any order, for a new TrackTable
+class TrackTable::Builder {
+public:
+    void reserve(size_t track_count);
+
+    // A track with the same id as one added earlier replaces it
+    void add(const TrackInfo& track);
+
+    // Copy a row of another table, e.g. the previous generation's unchanged tracks
+    void add(const TrackTable& table, const TrackRow& row);
+
+    // Sort, index and hand over everything added; the builder is empty afterwards
+    TrackTable build();
+
+private:
+    PooledString append(std::string_view value);
+    PooledString intern(std::string_view value);
+
+    TrackTable table;
+    std::vector<PooledString> interned;  // distinct interned strings
+    std::vector<uint32_t> intern_slots;  // into interned, + 1; size is a power of two
+};
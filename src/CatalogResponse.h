@@ -0,0 +1,9 @@
+#pragma once
+
+#include "Utils/Compression.h"
+
+// Pre-serialized /catalog response for one catalog generation; never modified once published
+struct CatalogResponse {
+    std::string etag;  // strong ETag of the identity body; compressed variants append "-gz" or "-br"
+    PrecompressedBody body;
+};
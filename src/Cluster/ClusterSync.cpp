@@ -0,0 +1,405 @@
+#include "pch.h"
+#include "ServerConfig.h"
+#include "Cluster/ClusterSync.h"
+#include "Catalog/TrackCatalog.h"
+#include "Catalog/CatalogQuery.h"
+#include "Http/Headers.h"
+#include "Utils/Json.h"
+#include "Utils/Logger.h"
+#include "Utils/Utf8.h"
+
+#include <algorithm>
+#include <condition_variable>
+
+#ifndef _WIN32
+#include <netdb.h>
+#include <sys/time.h>
+#endif
+
+using json = nlohmann::json;
+
+// Published view; swapped atomically, never modified after publication
+static std::atomic<std::shared_ptr<const ClusterView>> current_view;
+
+std::shared_ptr<const ClusterView> currentClusterView() {
+    return current_view.load();
+}
+
+namespace {
+
+// Consecutive failed fetches before a peer's tracks are dropped from the view, so one lost
+// poll doesn't make half the catalog flicker
+constexpr unsigned PEER_FAILURES_BEFORE_DROP = 3;
+
+// Largest peer catalog accepted
+constexpr size_t MAX_PEER_CATALOG_BYTES = 256 * 1024 * 1024;
+
+// One track of a peer's catalog
+struct PeerTrack {
+    std::string id;
+    std::string object;  // JSON object, as published
+    TrackInfo info;      // its fields, for queries and search over the merged view; no files
+};
+
+// What the sync thread remembers about one peer
+struct PeerState {
+    size_t node;       // ring index
+    std::string etag;  // of the catalog last fetched, sent back as If-None-Match
+    std::vector<PeerTrack> tracks;  // in id order
+    unsigned failures = 0;
+    bool listed = false;  // whether its tracks are in the view
+};
+
+enum class FetchResult { Changed, Unchanged, Failed };
+
+void setSocketTimeouts(socket_t sock, int timeout_ms) {
+#ifdef _WIN32
+    DWORD value = static_cast<DWORD>(timeout_ms);
+#else
+    timeval value{timeout_ms / 1000, (timeout_ms % 1000) * 1000};
+#endif
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&value), sizeof(value));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Function to connect to "host:port" (host may be a bracketed IPv6 address); INVALID_SOCKET on failure
+socket_t connectToNode(const std::string& node, int timeout_ms) {
+    size_t colon = node.rfind(':');
+    std::string host = node.substr(0, colon);
+    std::string port = node.substr(colon + 1);
+    if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+        host = host.substr(1, host.size() - 2);
+    }
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0) {
+        return INVALID_SOCKET;
+    }
+    socket_t sock = INVALID_SOCKET;
+    for (addrinfo* address = addresses; address && sock == INVALID_SOCKET; address = address->ai_next) {
+        sock = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (sock == INVALID_SOCKET) {
+            continue;
+        }
+        // On Linux the send timeout bounds connect() too
+        setSocketTimeouts(sock, timeout_ms);
+        if (connect(sock, address->ai_addr, static_cast<int>(address->ai_addrlen)) == SOCKET_ERROR_CODE) {
+            CLOSE_SOCKET(sock);
+            sock = INVALID_SOCKET;
+        }
+    }
+    freeaddrinfo(addresses);
+    return sock;
+}
+
+// Value of header name in a response head (status line and header lines), empty if absent
+std::string_view responseHeader(std::string_view head, std::string_view name) {
+    size_t line_start = head.find("\r\n");
+    while (line_start != std::string_view::npos) {
+        line_start += 2;
+        size_t line_end = head.find("\r\n", line_start);
+        std::string_view line = head.substr(line_start, line_end - line_start);
+        size_t colon = line.find(':');
+        if (colon != std::string_view::npos && equalsIgnoreCase(line.substr(0, colon), name)) {
+            return trimWhitespace(line.substr(colon + 1));
+        }
+        line_start = line_end;
+    }
+    return {};
+}
+
+// Function to GET a peer's local catalog, revalidating the copy with ETag etag.
+// On Changed, body and etag hold the new catalog; error says what went wrong on Failed.
+FetchResult fetchPeerCatalog(const std::string& node, int timeout_ms, std::string& etag, std::string& body,
+                             std::string& error) {
+    socket_t sock = connectToNode(node, timeout_ms);
+    if (sock == INVALID_SOCKET) {
+        error = "connect failed";
+        return FetchResult::Failed;
+    }
+
+    std::string request = "GET /cluster/catalog HTTP/1.1\r\nHost: " + node + "\r\n";
+    if (!etag.empty()) {
+        request += "If-None-Match: " + etag + "\r\n";
+    }
+    request += "Accept-Encoding: identity\r\nConnection: close\r\n\r\n";
+    for (size_t sent = 0; sent < request.size();) {
+        int result = ::send(sock, request.data() + sent, static_cast<int>(request.size() - sent), MSG_NOSIGNAL);
+        if (result <= 0) {
+            CLOSE_SOCKET(sock);
+            error = "send failed";
+            return FetchResult::Failed;
+        }
+        sent += result;
+    }
+
+    // The peer closes the connection after the response, so read to the end
+    std::string response;
+    char chunk[64 * 1024];
+    int received;
+    while ((received = recv(sock, chunk, sizeof(chunk), 0)) > 0 && response.size() <= MAX_PEER_CATALOG_BYTES) {
+        response.append(chunk, received);
+    }
+    CLOSE_SOCKET(sock);
+    if (received < 0) {
+        error = "receive failed or timed out";
+        return FetchResult::Failed;
+    }
+
+    size_t head_end = response.find("\r\n\r\n");
+    int status = 0;
+    if (head_end == std::string::npos || sscanf(response.c_str(), "HTTP/%*d.%*d %d", &status) != 1) {
+        error = "malformed response";
+        return FetchResult::Failed;
+    }
+    std::string_view head(response.data(), head_end + 2);
+    if (status == 304) {
+        return FetchResult::Unchanged;
+    }
+    if (status != 200) {
+        error = "status " + std::to_string(status);
+        return FetchResult::Failed;
+    }
+    std::string_view length = responseHeader(head, "Content-Length");
+    size_t body_length = response.size() - head_end - 4;
+    if (length.empty() || std::strtoull(std::string(length).c_str(), nullptr, 10) != body_length) {
+        error = "truncated response";
+        return FetchResult::Failed;
+    }
+    etag = std::string(responseHeader(head, "ETag"));
+    body = response.substr(head_end + 4);
+    return FetchResult::Changed;
+}
+
+// Function to split a catalog body into its tracks, sorted by id; false if it isn't a catalog.
+// Objects are re-serialized the way the peer wrote them, nlohmann's dump().
+bool parsePeerCatalog(const std::string& body, std::vector<PeerTrack>& tracks) {
+    tracks.clear();
+    try {
+        json catalog = json::parse(body);
+        if (!catalog.is_array()) {
+            return false;
+        }
+        for (const json& track : catalog) {
+            if (!track.is_object() || !track.contains("id") || !track["id"].is_string()) {
+                return false;
+            }
+            PeerTrack& parsed = tracks.emplace_back();
+            parsed.id = track["id"].get<std::string>();
+            parsed.object = track.dump();
+            parsed.info.id = toUtf8(parsed.id);
+            parsed.info.title = toUtf8(track.value("title", std::string()));
+            parsed.info.artist = toUtf8(track.value("artist", std::string()));
+            parsed.info.album = toUtf8(track.value("album", std::string()));
+            parsed.info.duration = track.value("duration", 0);
+        }
+    } catch (const json::exception&) {
+        return false;
+    }
+    std::sort(tracks.begin(), tracks.end(), [](const PeerTrack& a, const PeerTrack& b) { return a.id < b.id; });
+    return true;
+}
+
+class ClusterSync {
+public:
+    ClusterSync(const ServerConfig& config)
+        : ring(config.cluster_nodes, config.cluster_virtual_nodes),
+          self(std::find(config.cluster_nodes.begin(), config.cluster_nodes.end(), config.cluster_self) -
+               config.cluster_nodes.begin()) {
+        for (size_t node = 0; node < ring.nodeCount(); ++node) {
+            if (node != self) {
+                peers.emplace_back().node = node;
+            }
+        }
+    }
+
+    void run();
+    void stop();
+
+private:
+    // Function to fetch one peer's catalog; true if that changed anything the view shows
+    bool poll(PeerState& peer, const ServerConfig& config);
+    void publish();
+
+    HashRing ring;
+    size_t self;
+    std::vector<PeerState> peers;
+    uint64_t published_generation = 0;
+    bool published = false;
+
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool running = true;  // guarded by mutex
+};
+
+bool ClusterSync::poll(PeerState& peer, const ServerConfig& config) {
+    const std::string& node = ring.node(peer.node);
+    std::string body, error;
+    FetchResult result = fetchPeerCatalog(node, config.cluster_peer_timeout_ms, peer.etag, body, error);
+    std::vector<PeerTrack> tracks;
+    if (result == FetchResult::Changed) {
+        if (parsePeerCatalog(body, tracks)) {
+            peer.tracks = std::move(tracks);
+        } else {
+            result = FetchResult::Failed;
+            error = "not a catalog";
+            peer.etag.clear();
+        }
+    }
+
+    if (result == FetchResult::Failed) {
+        if (peer.failures++ == 0) {
+            logMessage(LogLevel::Warning, "Cluster: fetching the catalog of %s failed (%s)", node.c_str(), error.c_str());
+        }
+        if (peer.failures == PEER_FAILURES_BEFORE_DROP && peer.listed) {
+            logMessage(LogLevel::Warning, "Cluster: %s unreachable, dropping its %zu tracks", node.c_str(), peer.tracks.size());
+            peer.listed = false;
+            peer.tracks.clear();
+            peer.etag.clear();
+            return true;
+        }
+        return peer.failures == 1;  // reachability shows in the status
+    }
+
+    bool changed = result == FetchResult::Changed || !peer.listed || peer.failures > 0;
+    if (peer.failures > 0 || !peer.listed) {
+        logMessage(LogLevel::Info, "Cluster: %s has %zu tracks", node.c_str(), peer.tracks.size());
+    }
+    peer.failures = 0;
+    peer.listed = true;
+    return changed;
+}
+
+void ClusterSync::publish() {
+    std::shared_ptr<const CatalogSnapshot> local = currentCatalog();
+    auto view = std::make_shared<ClusterView>();
+    view->ring = ring;
+    view->self = self;
+    view->local_generation = local->generation;
+
+    // Peers' tracks this node hasn't got; where several peers list one, the first in node order is shown
+    std::vector<const PeerTrack*> remote;
+    for (const PeerState& peer : peers) {
+        if (!peer.listed) {
+            continue;
+        }
+        for (const PeerTrack& track : peer.tracks) {
+            uint64_t& holders = view->remote_tracks[track.id];
+            if (holders == 0 && !local->tracks.find(track.id)) {
+                remote.push_back(&track);
+            }
+            holders |= 1ull << peer.node;
+        }
+    }
+    std::sort(remote.begin(), remote.end(), [](const PeerTrack* a, const PeerTrack* b) { return a->id < b->id; });
+
+    // Merge with the local tracks, both already in id order, into one listing like a local /catalog
+    std::string body;
+    body.reserve((local->tracks.size() + remote.size()) * 128);
+    body += '[';
+    size_t next_remote = 0;
+    auto appendRemoteUpTo = [&](std::string_view id, bool all) {
+        for (; next_remote < remote.size() && (all || remote[next_remote]->id < id); ++next_remote) {
+            if (body.size() > 1) {
+                body += ',';
+            }
+            body += remote[next_remote]->object;
+        }
+    };
+    for (const TrackRow& row : local->tracks) {
+        appendRemoteUpTo(local->tracks.text(row.id), false);
+        if (body.size() > 1) {
+            body += ',';
+        }
+        appendTrackJson(body, local->tracks, row);
+    }
+    appendRemoteUpTo({}, true);
+    body += ']';
+
+    char hash_hex[17];
+    snprintf(hash_hex, sizeof(hash_hex), "%016llx", static_cast<unsigned long long>(fnv1aHash(body)));
+    view->catalog.etag = "\"" + std::string(hash_hex) + "\"";
+    view->catalog.body = precompress(std::move(body), 9, currentConfig()->catalog_brotli_quality);
+
+    // The same tracks as a table with its search index, so filtered /catalog pages and /search
+    // list what the whole /catalog does
+    TrackTable::Builder builder;
+    builder.reserve(local->tracks.size() + remote.size());
+    for (const TrackRow& row : local->tracks) {
+        builder.add(local->tracks, row);
+    }
+    for (const PeerTrack* track : remote) {
+        builder.add(track->info);
+    }
+    view->tracks = builder.build();
+    view->search.build(view->tracks);
+
+    std::string status = "{\"self\":";
+    appendJsonString(status, ring.node(self));
+    status += ",\"local_generation\":" + std::to_string(local->generation) + ",\"local_tracks\":" +
+              std::to_string(local->tracks.size()) + ",\"peers\":[";
+    for (const PeerState& peer : peers) {
+        status += status.back() == '[' ? "{\"node\":" : ",{\"node\":";
+        appendJsonString(status, ring.node(peer.node));
+        status += ",\"reachable\":";
+        status += peer.failures == 0 && peer.listed ? "true" : "false";
+        status += ",\"tracks\":" + std::to_string(peer.listed ? peer.tracks.size() : 0) + "}";
+        view->peers_reachable += peer.failures == 0 && peer.listed ? 1 : 0;
+    }
+    status += "]}";
+    view->status = std::make_shared<const std::string>(std::move(status));
+
+    published_generation = local->generation;
+    published = true;
+    current_view.store(std::move(view));
+}
+
+void ClusterSync::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running) {
+        lock.unlock();
+        std::shared_ptr<const ServerConfig> config = currentConfig();
+        bool changed = !published || currentCatalog()->generation != published_generation;
+        for (PeerState& peer : peers) {
+            changed |= poll(peer, *config);
+        }
+        if (changed) {
+            publish();
+        }
+        lock.lock();
+        wakeup.wait_for(lock, std::chrono::milliseconds(config->cluster_poll_interval_ms), [this] { return !running; });
+    }
+}
+
+void ClusterSync::stop() {
+    std::lock_guard<std::mutex> lock(mutex);
+    running = false;
+    wakeup.notify_all();
+}
+
+std::unique_ptr<ClusterSync> cluster_sync;
+std::thread sync_thread;
+
+}
+
+void startClusterSync() {
+    std::shared_ptr<const ServerConfig> config = currentConfig();
+    if (config->cluster_self.empty() || cluster_sync) {
+        return;
+    }
+    logMessage(LogLevel::Info, "Cluster: %s, one of %zu nodes", config->cluster_self.c_str(), config->cluster_nodes.size());
+    cluster_sync = std::make_unique<ClusterSync>(*config);
+    sync_thread = std::thread([] { cluster_sync->run(); });
+}
+
+void stopClusterSync() {
+    if (!cluster_sync) {
+        return;
+    }
+    cluster_sync->stop();
+    sync_thread.join();
+    cluster_sync.reset();
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Cluster/HashRing.h"
+#include "CatalogResponse.h"
+#include "Catalog/SearchIndex.h"
+#include "Utils/Hash.h"
+
+// Cluster mode: every node serves its own music directory, and the nodes listed in cluster_nodes
+// replicate their catalogs to each other. A background thread fetches each peer's local catalog
+// (GET /cluster/catalog, revalidated with If-None-Match so an unchanged one costs a 304) and
+// publishes what it learned as a ClusterView. /catalog then lists the whole cluster, and a request
+// for a track this node doesn't have is redirected to the first node in the track's ring order
+// that has it.
+
+// What this node knows about the rest of the cluster at one moment; never modified once published.
+// Like a catalog snapshot, take it once per request for a consistent view.
+struct ClusterView {
+    HashRing ring;
+    size_t self = 0;  // this node's index in the ring
+
+    // Every track id peers publish, with one bit per node (by ring index) whose catalog lists it
+    std::unordered_map<std::string, uint64_t, StringHash, std::equal_to<>> remote_tracks;
+
+    // /catalog for the cluster: this node's tracks and the peers' ones it hasn't got, in id order
+    CatalogResponse catalog;
+    TrackTable tracks;   // the same tracks, which filtered /catalog pages and /search run over
+    SearchIndex search;  // over tracks
+    uint64_t local_generation = 0;  // of the local catalog merged into it
+
+    // /cluster/status body: the nodes and what was last heard from each
+    std::shared_ptr<const std::string> status;
+    size_t peers_reachable = 0;
+};
+
+// The cluster view in effect; nullptr when this node isn't clustered or hasn't synced yet
+std::shared_ptr<const ClusterView> currentClusterView();
+
+// Function to start the thread that syncs with the peers, if cluster_self is set; call after the
+// initial loadTrackCatalog()
+void startClusterSync();
+
+// Function to stop the sync thread and wait for it to exit
+void stopClusterSync();
@@ -0,0 +1,55 @@
+#include "pch.h"
+#include "Cluster/HashRing.h"
+#include "Utils/Hash.h"
+
+#include <algorithm>
+
+HashRing::HashRing(const std::vector<std::string>& nodes, unsigned virtual_nodes) : nodes(nodes) {
+    points.reserve(nodes.size() * virtual_nodes);
+    for (size_t node = 0; node < nodes.size(); ++node) {
+        for (unsigned i = 0; i < virtual_nodes; ++i) {
+            std::string label = nodes[node] + "#" + std::to_string(i);
+            points.push_back({hashKey(label), static_cast<uint32_t>(node)});
+        }
+    }
+    // Ties are broken by node index so every node sorts the ring the same way
+    std::sort(points.begin(), points.end(), [](const Point& a, const Point& b) {
+        return a.hash != b.hash ? a.hash < b.hash : a.node < b.node;
+    });
+}
+
+uint64_t HashRing::hashKey(std::string_view key) {
+    // FNV-1a, finished with the SplitMix64 mixer: similar keys ("node#1", "node#2") land far apart
+    uint64_t hash = fnv1aHash(key);
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebull;
+    return hash ^ (hash >> 31);
+}
+
+size_t HashRing::firstPoint(std::string_view key) const {
+    uint64_t hash = hashKey(key);
+    auto it = std::lower_bound(points.begin(), points.end(), hash,
+                               [](const Point& point, uint64_t value) { return point.hash < value; });
+    return it == points.end() ? 0 : static_cast<size_t>(it - points.begin());
+}
+
+size_t HashRing::owner(std::string_view key) const {
+    return points[firstPoint(key)].node;
+}
+
+size_t HashRing::firstOf(std::string_view key, uint64_t candidates) const {
+    if (points.empty() || candidates == 0) {
+        return SIZE_MAX;
+    }
+    uint64_t seen = 0;
+    uint64_t all = nodes.size() == MAX_NODES ? ~0ull : (1ull << nodes.size()) - 1;
+    for (size_t i = firstPoint(key), visited = 0; visited < points.size() && seen != all; ++visited) {
+        uint32_t node = points[i].node;
+        if (candidates & (1ull << node)) {
+            return node;
+        }
+        seen |= 1ull << node;
+        i = i + 1 == points.size() ? 0 : i + 1;
+    }
+    return SIZE_MAX;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+// Consistent-hash ring over the nodes of a cluster. Each node sits at many points (virtual nodes),
+// so keys spread evenly and adding or removing a node only moves the keys next to its points.
+// Every node builds the same ring from the same node list, so they all agree on where a key goes.
+// Immutable once built, so it is safe to read from any thread.
+class HashRing {
+public:
+    static constexpr size_t MAX_NODES = 64;  // nodes are tracked in 64-bit masks
+
+    HashRing() = default;
+    HashRing(const std::vector<std::string>& nodes, unsigned virtual_nodes);
+
+    size_t nodeCount() const { return nodes.size(); }
+    const std::string& node(size_t index) const { return nodes[index]; }
+
+    // Index of the node that owns key; the ring must not be empty
+    size_t owner(std::string_view key) const;
+
+    // Index of the first node in key's preference order (its owner, then each other node in the
+    // order met walking the ring onwards) whose bit is set in candidates; SIZE_MAX if there is none
+    size_t firstOf(std::string_view key, uint64_t candidates) const;
+
+private:
+    struct Point {
+        uint64_t hash;
+        uint32_t node;
+    };
+
+    static uint64_t hashKey(std::string_view key);
+    size_t firstPoint(std::string_view key) const;
+
+    std::vector<std::string> nodes;
+    std::vector<Point> points;  // sorted by hash
+};
@@ -0,0 +1,1175 @@
+#include "pch.h"
+#include "ServerConfig.h"
+#include "Http/Handlers.h"
+#include "Http/Range.h"
+#include "Http/Headers.h"
+#include "Catalog/TrackCatalog.h"
+#include "Catalog/CatalogQuery.h"
+#include "Catalog/CatalogWatcher.h"
+#include "Cluster/ClusterSync.h"
+#include "Net/FileCache.h"
+#include "Net/PrecompressedCache.h"
+#include "Net/HlsCache.h"
+#include "Net/DiskReader.h"
+#include "Net/BufferPool.h"
+#include "Media/Mp3.h"
+#include "Utils/Arena.h"
+#include "Utils/Background.h"
+#include "Utils/Compression.h"
+#include "Utils/Hash.h"
+#include "Utils/Utf8.h"
+#include "Utils/Logger.h"
+#include "Utils/Metrics.h"
+#include "Utils/Profiler.h"
+#include <string_view>
+#include <algorithm>
+#include <charconv>
+
+namespace fs = std::filesystem;
+
+// Value of a hex digit, or -1
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Function to URL-decode a string with UTF-8 support
+std::pmr::u8string urlDecode(std::string_view value, std::pmr::memory_resource* memory) {
+    std::pmr::u8string decoded(memory);
+    decoded.reserve(value.length());
+
+    for (size_t i = 0; i < value.length(); ++i) {
+        if (value[i] == '%') {
+            int high = i + 2 < value.length() ? hexValue(value[i + 1]) : -1;
+            int low = high >= 0 ? hexValue(value[i + 2]) : -1;
+            if (low >= 0) {
+                decoded += static_cast<char8_t>(high * 16 + low);
+                i += 2;
+            } else {
+                // Malformed encoding, just append '%'
+                decoded += u8'%';
+            }
+        } else if (value[i] == '+') {
+            decoded += u8' ';
+        } else {
+            decoded += static_cast<char8_t>(value[i]);
+        }
+    }
+
+    return decoded;
+}
+
+// Status line plus Content-Type and the "Content-Length: " label for one status and content type.
+// Built on first use; each event loop thread keeps its own table so lookups never lock.
+static const std::string& headerPrefix(int status_code, std::string_view content_type) {
+    struct Prefix {
+        int status_code;
+        std::string content_type;
+        std::string text;
+    };
+    thread_local std::deque<Prefix> prefixes;  // deque: references stay valid as it grows
+    for (const Prefix& prefix : prefixes) {
+        if (prefix.status_code == status_code && prefix.content_type == content_type) {
+            return prefix.text;
+        }
+    }
+
+    std::string status_text;
+    switch (status_code) {
+        case 200: status_text = "OK"; break;
+        case 202: status_text = "Accepted"; break;
+        case 206: status_text = "Partial Content"; break;
+        case 307: status_text = "Temporary Redirect"; break;
+        case 304: status_text = "Not Modified"; break;
+        case 400: status_text = "Bad Request"; break;
+        case 404: status_text = "Not Found"; break;
+        case 409: status_text = "Conflict"; break;
+        case 416: status_text = "Range Not Satisfiable"; break;
+        case 500: status_text = "Internal Server Error"; break;
+        case 501: status_text = "Not Implemented"; break;
+        case 503: status_text = "Service Unavailable"; break;
+        default: status_text = "Unknown"; break;
+    }
+
+    std::string text = "HTTP/1.1 " + std::to_string(status_code) + " " + status_text + "\r\n";
+    // Add UTF-8 charset to content type if not already present
+    std::string final_content_type(content_type);
+    if (content_type.find("charset=") == std::string_view::npos) {
+        if (content_type.find("text/") == 0 || content_type == "application/json") {
+            final_content_type += "; charset=utf-8";
+        }
+    }
+    if (status_code != 304) {
+        // A 304 carries no body, so it has no content headers either
+        text += "Content-Type: " + final_content_type + "\r\n";
+        text += "Content-Length: ";
+    }
+
+    prefixes.push_back({status_code, std::string(content_type), std::move(text)});
+    return prefixes.back().text;
+}
+
+template <class String>
+static void appendNumber(String& out, uint64_t value) {
+    char digits[24];
+    auto [end, ec] = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, end);
+}
+
+// Function to send HTTP response header with UTF-8 support
+// extra_headers holds complete "Name: value\r\n" lines to append
+static void sendHttpHeader(Connection& conn, int status_code, std::string_view content_type, size_t content_length,
+                           std::string_view extra_headers = {}) {
+    static const std::string keep_alive_prefix = "Connection: keep-alive\r\nKeep-Alive: timeout=";
+    static const std::string close_line = "Connection: close\r\n";
+    static const std::string cors_line = "Access-Control-Allow-Origin: *\r\n";  // Enable CORS
+
+    // Only the numbers are formatted per response; the rest is copied from prebuilt templates
+    const std::string& prefix = headerPrefix(status_code, content_type);
+    std::string header = bufferPool().take(prefix.size() + keep_alive_prefix.size() + cors_line.size() + extra_headers.size() + 32);
+    header += prefix;
+    if (status_code != 304) {
+        appendNumber(header, content_length);
+        header += "\r\n";
+    }
+    if (conn.keep_alive) {
+        header += keep_alive_prefix;
+        appendNumber(header, conn.keep_alive_timeout);
+        header += ", max=";
+        appendNumber(header, conn.keep_alive_remaining);
+        header += "\r\n";
+    } else {
+        header += close_line;
+    }
+    header += cors_line;
+    header += extra_headers;
+    header += "\r\n";  // End of header
+
+    // Queued ahead of the body; the connection writes both in a single gather write
+    conn.response_status = status_code;
+    conn.send(std::move(header));
+}
+
+// Function to send a complete response with a short body given in place, such as an error message
+static void sendText(Connection& conn, int status_code, std::string_view content_type, std::string_view body,
+                     std::string_view extra_headers = {}) {
+    sendHttpHeader(conn, status_code, content_type, body.size(), extra_headers);
+    conn.send(body.data(), body.size());
+}
+
+// Function to send {"error": message} with status_code
+static void sendJsonError(Connection& conn, int status_code, std::string_view message) {
+    std::pmr::string body(&requestArena());
+    body.append("{\"error\": \"").append(message).append("\"}");
+    sendText(conn, status_code, "application/json", body);
+}
+
+// Function to find a parameter in a query string ("a=1&t=30"); empty if it is absent
+static std::string_view queryParameter(std::string_view query, std::string_view name) {
+    while (!query.empty()) {
+        size_t end = query.find('&');
+        std::string_view pair = query.substr(0, end);
+        if (pair.size() > name.size() && pair.starts_with(name) && pair[name.size()] == '=') {
+            return pair.substr(name.size() + 1);
+        }
+        if (end == std::string_view::npos) {
+            break;
+        }
+        query.remove_prefix(end + 1);
+    }
+    return {};
+}
+
+// Function to check whether a query string has any of the parameters a /catalog query understands.
+// Without one the request gets the pre-serialized catalog: cache-busters and unknown parameters
+// must not make every request rebuild and compress the whole listing.
+static bool hasCatalogQueryParameter(std::string_view query) {
+    static constexpr std::string_view names[] = {"offset", "limit", "fields", "artist", "album", "prefix"};
+    for (std::string_view name : names) {
+        if (!queryParameter(query, name).empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Function to take the catalog snapshot in effect and look a track up in it, timed as the request's
+// catalog span. The snapshot stays valid for as long as catalog holds it, even across a reload.
+static const TrackRow* findTrack(Connection& conn, std::shared_ptr<const CatalogSnapshot>& catalog,
+                                 std::string_view track_id) {
+    TraceScope span(conn.trace, TraceSpan::Catalog);
+    catalog = currentCatalog();
+    return catalog->tracks.find(track_id);
+}
+
+// Function to open a track or description file, reusing a cached handle when the catalog says it
+// hasn't changed; timed as the request's open span
+static std::shared_ptr<FileBody> openFile(Connection& conn, std::string_view path, const FileStamp& stamp) {
+    TraceScope span(conn.trace, TraceSpan::Open);
+    return fileCache().open(path, stamp);
+}
+
+// Function to build the strong ETag of a file from its catalog stamp, "<mtime>-<size>" in hex, so
+// validating a request never needs a stat(). A representation that is only part of the file appends
+// what selects it, part (e.g. the start time of a ?t= seek).
+static std::pmr::string fileEtag(const FileStamp& stamp, uint64_t part = 0) {
+    char text[64];
+    int length = part == 0
+        ? snprintf(text, sizeof(text), "\"%llx-%llx\"", static_cast<unsigned long long>(stamp.mtime),
+                   static_cast<unsigned long long>(stamp.size))
+        : snprintf(text, sizeof(text), "\"%llx-%llx-%llx\"", static_cast<unsigned long long>(stamp.mtime),
+                   static_cast<unsigned long long>(stamp.size), static_cast<unsigned long long>(part));
+    return std::pmr::string(text, static_cast<size_t>(length), &requestArena());
+}
+
+// Function to append the caching headers of a response: Cache-Control ("no-cache" for a max_age
+// of 0), then ETag unless etag is empty and Last-Modified unless last_modified is -1
+static void appendCacheHeaders(std::pmr::string& headers, unsigned max_age, std::string_view etag, int64_t last_modified) {
+    if (max_age == 0) {
+        headers += "Cache-Control: no-cache\r\n";
+    } else {
+        headers += "Cache-Control: public, max-age=";
+        appendNumber(headers, max_age);
+        headers += "\r\n";
+    }
+    if (!etag.empty()) {
+        headers.append("ETag: ").append(etag).append("\r\n");
+    }
+    if (last_modified >= 0) {
+        char date[HTTP_DATE_LENGTH];
+        headers.append("Last-Modified: ").append(formatHttpDate(last_modified, date)).append("\r\n");
+    }
+}
+
+// Function to check a request's validators against the representation it would get: true if a 304
+// answers it. If-None-Match takes precedence, and If-Modified-Since only counts without it and
+// with a last_modified (-1 for none).
+static bool notModified(const HttpRequest& request, std::string_view etag, int64_t last_modified) {
+    std::string_view if_none_match = request.header("If-None-Match");
+    if (!if_none_match.empty()) {
+        return !etag.empty() && etagMatches(if_none_match, etag);
+    }
+    std::string_view if_modified_since = request.header("If-Modified-Since");
+    int64_t since;
+    return last_modified >= 0 && !if_modified_since.empty() && parseHttpDate(if_modified_since, since) &&
+           last_modified <= since;
+}
+
+// Function to get the Range header a request's response should honour: none when an If-Range makes
+// it conditional on validators that no longer match, so the client gets the whole new representation
+// rather than a piece of it to splice onto the old one
+static std::string_view rangeToServe(const HttpRequest& request, std::string_view etag, int64_t last_modified) {
+    std::string_view if_range = request.header("If-Range");
+    if (!if_range.empty() && !ifRangeMatches(if_range, etag, last_modified)) {
+        return {};
+    }
+    return request.header("Range");
+}
+
+// Function to send the variant of a body the client prefers, with Vary: Accept-Encoding.
+// etag is the identity body's strong ETag, or empty for none; compressed variants get their own
+// by appending "-gz" or "-br". last_modified, unless -1, is sent as Last-Modified. A request whose
+// If-None-Match or If-Modified-Since matches gets a 304. extra_headers follow the ETag and Vary lines.
+static void sendPrecompressed(Connection& conn, const HttpRequest& request, const PrecompressedBody& body,
+                              std::string_view etag, std::string_view extra_headers,
+                              std::string_view content_type = "application/json", int64_t last_modified = -1) {
+    ContentCoding coding = chooseContentCoding(request.header("Accept-Encoding"), body.gzip != nullptr, body.brotli != nullptr);
+    const std::shared_ptr<const std::string>* selected = &body.identity;
+    std::string_view suffix, encoding_line;
+    if (coding == ContentCoding::Brotli) {
+        selected = &body.brotli;
+        suffix = "-br";
+        encoding_line = "Content-Encoding: br\r\n";
+    } else if (coding == ContentCoding::Gzip) {
+        selected = &body.gzip;
+        suffix = "-gz";
+        encoding_line = "Content-Encoding: gzip\r\n";
+    }
+
+    std::pmr::string headers(&requestArena());
+    std::pmr::string variant_etag(&requestArena());
+    if (!etag.empty()) {
+        if (suffix.empty()) {
+            variant_etag = etag;
+        } else {
+            variant_etag.append(etag.substr(0, etag.size() - 1)).append(suffix).append("\"");
+        }
+        headers.append("ETag: ").append(variant_etag).append("\r\n");
+    }
+    if (last_modified >= 0) {
+        char date[HTTP_DATE_LENGTH];
+        headers.append("Last-Modified: ").append(formatHttpDate(last_modified, date)).append("\r\n");
+    }
+    headers += "Vary: Accept-Encoding\r\n";
+    headers += extra_headers;
+
+    if (notModified(request, variant_etag, last_modified)) {
+        sendHttpHeader(conn, 304, content_type, 0, headers);
+        return;
+    }
+
+    headers += encoding_line;
+    sendHttpHeader(conn, 200, content_type, (*selected)->length(), headers);
+    conn.send(*selected);
+}
+
+// Function to send catalog as JSON response with UTF-8 support.
+// Serves the pre-serialized body of the current generation, compressed if the client accepts it; in
+// a cluster, the merged listing of every node's tracks unless local_only is set.
+static void sendCatalog(Connection& conn, const HttpRequest& request, bool local_only = false) {
+    std::shared_ptr<const ClusterView> cluster = local_only ? nullptr : currentClusterView();
+    if (cluster) {
+        sendPrecompressed(conn, request, cluster->catalog.body, cluster->catalog.etag, "Cache-Control: no-cache\r\n");
+        return;
+    }
+    std::shared_ptr<const CatalogSnapshot> catalog = currentCatalog();
+    sendPrecompressed(conn, request, catalog->response.body, catalog->response.etag, "Cache-Control: no-cache\r\n");
+}
+
+// Function to redirect a request for a track this node hasn't got to the node that should serve
+// it: the first in the track's ring order whose published catalog lists it. Only nodes known to
+// have the track are candidates, so requests never bounce between nodes. Returns false, having
+// sent nothing, when no peer has it (or the node isn't clustered).
+static bool redirectToHolder(Connection& conn, const HttpRequest& request, std::string_view track_id) {
+    std::shared_ptr<const ClusterView> cluster = currentClusterView();
+    if (!cluster) {
+        return false;
+    }
+    auto found = cluster->remote_tracks.find(track_id);
+    if (found == cluster->remote_tracks.end()) {
+        return false;
+    }
+    size_t node = cluster->ring.firstOf(track_id, found->second & ~(1ull << cluster->self));
+    if (node == SIZE_MAX) {
+        return false;
+    }
+
+    std::pmr::string headers("Cache-Control: no-cache\r\nLocation: http://", &requestArena());
+    headers.append(cluster->ring.node(node)).append(request.target).append("\r\n");
+    sendText(conn, 307, "text/plain", "Track is served by another node", headers);
+    return true;
+}
+
+// Function to parse /catalog query parameters; returns an error message, or nullptr if they are valid
+static const char* parseCatalogQuery(std::string_view query_string, CatalogQuery& query) {
+    auto parseCount = [](std::string_view value, size_t& count) {
+        auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), count);
+        return ec == std::errc() && end == value.data() + value.size();
+    };
+
+    std::string_view offset = queryParameter(query_string, "offset");
+    if (!offset.empty() && !parseCount(offset, query.offset)) {
+        return "offset must be a non-negative integer";
+    }
+    std::string_view limit = queryParameter(query_string, "limit");
+    if (!limit.empty() && !parseCount(limit, query.limit)) {
+        return "limit must be a non-negative integer";
+    }
+    std::string_view fields = queryParameter(query_string, "fields");
+    if (!fields.empty() && (query.fields = parseCatalogFields(viewUtf8(urlDecode(fields, &requestArena())))) == 0) {
+        return "fields must list id, title, artist, album or duration";
+    }
+    query.artist = viewUtf8(urlDecode(queryParameter(query_string, "artist"), &requestArena()));
+    query.album = viewUtf8(urlDecode(queryParameter(query_string, "album"), &requestArena()));
+    query.title_prefix = viewUtf8(urlDecode(queryParameter(query_string, "prefix"), &requestArena()));
+    return nullptr;
+}
+
+// What filtered /catalog pages and /search list: the tracks plain /catalog does, so in a cluster the
+// merged view of every node's tracks, otherwise the local catalog. Holds the snapshot it points into.
+struct ListedTracks {
+    std::shared_ptr<const CatalogSnapshot> catalog;
+    std::shared_ptr<const ClusterView> cluster;
+    const TrackTable* tracks;
+    const SearchIndex* search;
+    std::string_view etag;  // of the full /catalog response listing the same tracks
+};
+
+static ListedTracks listedTracks() {
+    ListedTracks listed;
+    listed.cluster = currentClusterView();
+    if (listed.cluster) {
+        listed.tracks = &listed.cluster->tracks;
+        listed.search = &listed.cluster->search;
+        listed.etag = listed.cluster->catalog.etag;
+    } else {
+        listed.catalog = currentCatalog();
+        listed.tracks = &listed.catalog->tracks;
+        listed.search = &listed.catalog->search;
+        listed.etag = listed.catalog->response.etag;
+    }
+    return listed;
+}
+
+// Function to send a track listing computed for this request: a JSON array like /catalog's, with
+// X-Total-Count giving the number of matches. The same tracks and request target always give the
+// same bytes, so the ETag extends the full listing's (catalog_etag).
+static void sendTrackListing(Connection& conn, const HttpRequest& request, std::string_view catalog_etag,
+                             std::shared_ptr<std::string> body, size_t total) {
+    char target_hash[17];
+    snprintf(target_hash, sizeof(target_hash), "%016llx", static_cast<unsigned long long>(fnv1aHash(request.target)));
+    std::pmr::string etag(&requestArena());
+    etag.append(catalog_etag.substr(0, catalog_etag.size() - 1)).append("-").append(target_hash).append("\"");
+    std::pmr::string headers("Cache-Control: no-cache\r\nX-Total-Count: ", &requestArena());
+    appendNumber(headers, total);
+    headers += "\r\nAccess-Control-Expose-Headers: X-Total-Count\r\n";
+
+    // Compress only into the coding this client will get, and not at all for small pages
+    std::shared_ptr<const ServerConfig> config = currentConfig();
+    bool worth_compressing = body->size() >= config->catalog_query_gzip_min_bytes;
+    ContentCoding coding = chooseContentCoding(request.header("Accept-Encoding"), worth_compressing && gzipAvailable(),
+                                               worth_compressing && brotliAvailable());
+    PrecompressedBody variants;
+    std::string compressed;
+    if (coding == ContentCoding::Brotli && brotliCompress(*body, compressed, config->catalog_query_brotli_quality)) {
+        variants.brotli = std::make_shared<const std::string>(std::move(compressed));
+    } else if (coding == ContentCoding::Gzip && gzipCompress(*body, compressed, config->catalog_query_gzip_level)) {
+        variants.gzip = std::make_shared<const std::string>(std::move(compressed));
+    }
+    variants.identity = std::move(body);
+    sendPrecompressed(conn, request, variants, etag, headers);
+}
+
+// Function to send one page of a filtered /catalog listing (offset, limit, fields, artist, album, prefix)
+static void sendCatalogQuery(Connection& conn, const HttpRequest& request) {
+    CatalogQuery query;
+    if (const char* error = parseCatalogQuery(request.query, query)) {
+        sendJsonError(conn, 400, error);
+        return;
+    }
+    // Pages are bounded like /search's, so no request serializes the whole catalog on its own
+    std::shared_ptr<const ServerConfig> config = currentConfig();
+    if (queryParameter(request.query, "limit").empty()) {
+        query.limit = config->catalog_query_default_limit;
+    }
+    query.limit = std::min(query.limit, config->catalog_query_max_limit);
+
+    ListedTracks listed = listedTracks();
+    auto body = std::make_shared<std::string>();
+    size_t total = runCatalogQuery(*listed.tracks, query, *body);
+    sendTrackListing(conn, request, listed.etag, std::move(body), total);
+}
+
+// Function to send the tracks best matching a full-text query (q, plus offset, limit and fields
+// as for /catalog), most relevant first
+static void sendSearch(Connection& conn, const HttpRequest& request) {
+    CatalogQuery query;
+    const char* error = parseCatalogQuery(request.query, query);
+    std::pmr::u8string terms = urlDecode(queryParameter(request.query, "q"), &requestArena());
+    if (!error && terms.empty()) {
+        error = "q is required";
+    }
+    if (error) {
+        sendJsonError(conn, 400, error);
+        return;
+    }
+    std::shared_ptr<const ServerConfig> config = currentConfig();
+    if (queryParameter(request.query, "limit").empty()) {
+        query.limit = config->search_default_limit;
+    }
+    query.limit = std::min(query.limit, config->search_max_limit);
+
+    ListedTracks listed = listedTracks();
+    std::vector<uint32_t> rows;
+    size_t total = listed.search->search(viewUtf8(terms), query.offset, query.limit, rows);
+
+    auto body = std::make_shared<std::string>();
+    *body += '[';
+    for (uint32_t row : rows) {
+        if (body->size() > 1) {
+            *body += ',';
+        }
+        appendTrackJson(*body, *listed.tracks, (*listed.tracks)[row], query.fields);
+    }
+    *body += ']';
+    sendTrackListing(conn, request, listed.etag, std::move(body), total);
+}
+
+// The parts of a request a deferred response still needs once the request itself is gone: the
+// headers that pick the variant, answer conditionals and select ranges. header() works on request
+// as on the original for those.
+struct KeptRequest {
+    std::string values;  // the headers' values back to back, which request's views point into
+    HttpRequest request;
+};
+
+static std::shared_ptr<const KeptRequest> keepRequest(const HttpRequest& request) {
+    static constexpr std::string_view names[] = {"Accept-Encoding", "If-None-Match", "If-Modified-Since", "Range", "If-Range"};
+    auto kept = std::make_shared<KeptRequest>();
+    kept->request.version_minor = request.version_minor;
+    size_t lengths[std::size(names)];
+    for (size_t i = 0; i < std::size(names); ++i) {
+        std::string_view value = request.header(names[i]);
+        kept->values += value;
+        lengths[i] = value.size();
+    }
+    size_t offset = 0;
+    for (size_t i = 0; i < std::size(names); ++i) {
+        if (lengths[i] > 0) {
+            kept->request.headers[kept->request.header_count++] = {names[i], std::string_view(kept->values).substr(offset, lengths[i])};
+        }
+        offset += lengths[i];
+    }
+    return kept;
+}
+
+// Function to answer a conditional request for a description whose body isn't in memory: a 304 if
+// If-None-Match names the identity ETag or one of the compressed variants' (which one the client
+// would get depends on a body not read yet), or if If-Modified-Since is met. Returns false, having
+// sent nothing, otherwise.
+static bool sendNotModifiedVariant(Connection& conn, const HttpRequest& request, std::string_view etag,
+                                   std::string_view cache_control, int64_t last_modified) {
+    for (std::string_view suffix : {"", "-gz", "-br"}) {
+        std::pmr::string variant_etag(etag.substr(0, etag.size() - 1), &requestArena());
+        variant_etag.append(suffix).append("\"");
+        if (notModified(request, variant_etag, last_modified)) {
+            // The same headers sendPrecompressed() gives a 304
+            std::pmr::string headers(&requestArena());
+            headers.append("ETag: ").append(variant_etag).append("\r\n");
+            if (last_modified >= 0) {
+                char date[HTTP_DATE_LENGTH];
+                headers.append("Last-Modified: ").append(formatHttpDate(last_modified, date)).append("\r\n");
+            }
+            headers += "Vary: Accept-Encoding\r\n";
+            headers += cache_control;
+            sendHttpHeader(conn, 304, "application/json", 0, headers);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Function to read a description file on a background worker, keep it in the description cache with
+// its compressed variants, and then answer the deferred request from them. A file too big to keep
+// in memory is queued behind the header as it is instead. Conditional requests were answered already.
+static void sendDescriptionInBackground(Connection& conn, const HttpRequest& request, std::shared_ptr<FileBody> file,
+                                        std::string path, FileStamp stamp, std::string etag, int64_t last_modified) {
+    std::shared_ptr<const ServerConfig> config = currentConfig();
+    std::shared_ptr<DeferredResponse> deferred = conn.defer();
+    std::shared_ptr<const KeptRequest> kept = keepRequest(request);
+
+    runInBackground([=, file = std::move(file), path = std::move(path)]() mutable {
+        uint64_t body_offset = 0;
+        uint64_t file_size = file->size();
+
+        // Check for UTF-8 BOM and skip it if present
+        char bom[3] = {};
+        if (file->readAt(0, bom, 3) == 3 &&
+            bom[0] == (char)0xEF && bom[1] == (char)0xBB && bom[2] == (char)0xBF) {
+            // BOM found, adjust file size
+            body_offset = 3;
+            file_size -= 3;
+        }
+
+        unsigned max_age = config->description_max_age_seconds;
+        if (file_size > config->description_cache_max_file_bytes) {
+            // Too big to keep in memory: queue the file content behind the header as it is
+            deferred->complete([=](Connection& conn) {
+                std::pmr::string headers(&requestArena());
+                appendCacheHeaders(headers, max_age, etag, last_modified);
+                sendHttpHeader(conn, 200, "application/json", file_size, headers);
+                conn.sendFile(file, body_offset, file_size);
+            });
+            return;
+        }
+
+        std::string contents(file_size, '\0');
+        for (uint64_t done = 0; done < file_size;) {
+            int64_t count = file->readAt(body_offset + done, contents.data() + done, file_size - done);
+            if (count <= 0) {
+                deferred->complete([](Connection& conn) { sendJsonError(conn, 500, "Failed to read description file"); });
+                return;
+            }
+            done += count;
+        }
+        std::shared_ptr<const PrecompressedBody> variants = descriptionCache().store(
+            std::move(path), stamp, precompress(std::move(contents), 9, config->description_brotli_quality));
+
+        deferred->complete([=](Connection& conn) {
+            std::pmr::string cache_control(&requestArena());
+            appendCacheHeaders(cache_control, max_age, {}, -1);
+            sendPrecompressed(conn, kept->request, *variants, etag, cache_control, "application/json", last_modified);
+        });
+    });
+}
+
+// Function to send description file for a track with UTF-8 support.
+// Validators come from the catalog's stamp of the file, so If-None-Match and If-Modified-Since are
+// answered without touching it.
+static void sendTrackDescription(Connection& conn, const HttpRequest& request, std::u8string_view track_id) {
+    std::shared_ptr<const CatalogSnapshot> catalog;
+    const TrackRow* entry = findTrack(conn, catalog, viewUtf8(track_id));
+    if (!entry) {
+        // Track not found, unless another node of the cluster has it
+        if (!redirectToHolder(conn, request, viewUtf8(track_id))) {
+            sendJsonError(conn, 404, "Track not found");
+        }
+        return;
+    }
+
+    const TrackRow& track = *entry;
+    if (!track.description_stamp.exists) {
+        // Description file not found
+        sendJsonError(conn, 404, "Description file not found");
+        return;
+    }
+
+    std::shared_ptr<const ServerConfig> config = currentConfig();
+    std::pmr::string etag = fileEtag(track.description_stamp);
+    int64_t last_modified = track.description_stamp.modifiedSeconds();
+    std::pmr::string cache_control(&requestArena());
+    appendCacheHeaders(cache_control, config->description_max_age_seconds, {}, -1);
+
+    // Sidecars parsed by the last catalog load are already in memory with their compressed variants
+    std::string_view description_path = catalog->tracks.text(track.description_path);
+    std::shared_ptr<const PrecompressedBody> variants = descriptionCache().find(description_path, track.description_stamp);
+    if (variants) {
+        sendPrecompressed(conn, request, *variants, etag, cache_control, "application/json", last_modified);
+        return;
+    }
+
+    // Loaded from the catalog index instead, or evicted since. A client whose copy is still current
+    // is answered without touching the file; for anyone else a worker reads and compresses it once.
+    if (sendNotModifiedVariant(conn, request, etag, cache_control, last_modified)) {
+        return;
+    }
+    // Open description file, reusing a cached handle when the catalog says it hasn't changed
+    std::shared_ptr<FileBody> desc_file = openFile(conn, description_path, track.description_stamp);
+    if (!desc_file) {
+        // Failed to open file
+        sendJsonError(conn, 500, "Failed to open description file");
+        return;
+    }
+    sendDescriptionInBackground(conn, request, std::move(desc_file), std::string(description_path),
+                                track.description_stamp, std::string(etag), last_modified);
+}
+
+// Function to send size bytes of file from offset as a whole resource: all of it, or the byte
+// ranges range_header asks for (a 416 if none of them is satisfiable, a multipart body for several).
+// extra_headers go on the 200 and 206 responses after Accept-Ranges.
+static void sendFileBody(Connection& conn, std::shared_ptr<FileBody> file, uint64_t offset, uint64_t size,
+                         std::string_view content_type, std::string_view range_header,
+                         std::string_view extra_headers = {}) {
+    std::pmr::vector<ByteRange> ranges(&requestArena());
+    RangeResult range_result = range_header.empty()
+        ? RangeResult::Ignored
+        : parseRangeHeader(range_header, size, ranges);
+
+    if (range_result == RangeResult::Unsatisfiable) {
+        std::pmr::string content_range("Content-Range: bytes */", &requestArena());
+        appendNumber(content_range, size);
+        content_range += "\r\n";
+        sendText(conn, 416, "text/plain", "Requested range not satisfiable", content_range);
+        return;
+    }
+
+    std::pmr::string headers("Accept-Ranges: bytes\r\n", &requestArena());
+    headers += extra_headers;
+    if (range_result == RangeResult::Ignored) {
+        // Whole file; the event loop streams it as the socket drains
+        sendHttpHeader(conn, 200, content_type, size, headers);
+        conn.sendFile(std::move(file), offset, size);
+        return;
+    }
+
+    char content_range[CONTENT_RANGE_MAX_LENGTH];
+    if (ranges.size() == 1) {
+        const ByteRange& range = ranges.front();
+        headers.append("Content-Range: ").append(formatContentRange(range, size, content_range)).append("\r\n");
+        sendHttpHeader(conn, 206, content_type, range.length(), headers);
+        conn.sendFile(std::move(file), offset + range.first, range.length());
+        return;
+    }
+
+    // Several ranges: multipart/byteranges body, each part a slice of the same open file.
+    // The part headers are queued on the connection, so they go in pooled buffers, not the arena.
+    static const std::string boundary = "CITRON_BYTERANGES";
+    static const std::string multipart_type = "multipart/byteranges; boundary=" + boundary;
+    static const std::string closing = "\r\n--" + boundary + "--\r\n";
+    std::pmr::vector<std::string> part_headers(&requestArena());
+    size_t content_length = 0;
+    for (const ByteRange& range : ranges) {
+        std::string& part = part_headers.emplace_back(bufferPool().take(128));
+        part.append("\r\n--").append(boundary).append("\r\nContent-Type: ").append(content_type);
+        part.append("\r\nContent-Range: ").append(formatContentRange(range, size, content_range)).append("\r\n\r\n");
+        content_length += part.length() + range.length();
+    }
+    content_length += closing.length();
+
+    sendHttpHeader(conn, 206, multipart_type, content_length, headers);
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        conn.send(std::move(part_headers[i]));
+        conn.sendFile(file, offset + ranges[i].first, ranges[i].length());
+    }
+    conn.send(closing.data(), closing.size());
+}
+
+// Function to queue a /stream body: the file from seek_offset on, as the whole resource, paced for
+// bitrate (bits per second, 0 if unknown) when stream pacing is on
+static void sendStreamBody(Connection& conn, const HttpRequest& request, std::shared_ptr<FileBody> file,
+                           uint64_t seek_offset, uint32_t bitrate, std::string_view etag, int64_t last_modified) {
+    std::shared_ptr<const ServerConfig> config = currentConfig();
+    std::pmr::string headers(&requestArena());
+    appendCacheHeaders(headers, config->stream_max_age_seconds, etag, last_modified);
+
+    if (config->stream_pacing_enabled && bitrate > 0) {
+        // Players only need the bitrate; after the burst, deliver at a multiple of it instead of line rate
+        conn.paceFileBodies(static_cast<uint64_t>(bitrate / 8.0 * config->stream_pacing_multiplier),
+                            config->stream_pacing_burst_bytes);
+    }
+
+    // Get file size, less anything skipped by a seek
+    uint64_t file_size = file->size() - seek_offset;
+    sendFileBody(conn, std::move(file), seek_offset, file_size, "audio/mpeg", rangeToServe(request, etag, last_modified),
+                 headers);
+}
+
+// Function to send MP3 file data
+// The request's query may carry t=<seconds>, which starts the stream at the first frame at or after
+// that time; the rest of the file is then treated as the whole resource, so ranges are relative to it.
+// Validators come from the catalog's stamp of the file, so a revalidation is answered without opening it.
+static void sendMp3File(Connection& conn, const HttpRequest& request, std::u8string_view track_id) {
+    std::shared_ptr<const CatalogSnapshot> catalog;
+    const TrackRow* entry = findTrack(conn, catalog, viewUtf8(track_id));
+    if (!entry) {
+        // Track not found, unless another node of the cluster has it
+        if (!redirectToHolder(conn, request, viewUtf8(track_id))) {
+            sendText(conn, 404, "text/plain", "Track not found");
+        }
+        return;
+    }
+
+    const TrackRow& track = *entry;
+    const Mp3SeekIndex& seek_index = catalog->tracks.seekIndex(track);
+    std::string_view filepath = catalog->tracks.text(track.filepath);
+
+    uint32_t seek_ms = 0;
+    std::string_view seek_time = queryParameter(request.query, "t");
+    if (!seek_time.empty() && seek_index.valid()) {
+        double seconds = std::strtod(std::string(seek_time).c_str(), nullptr);
+        if (seconds > 0) {
+            seek_ms = static_cast<uint32_t>(std::min(seconds * 1000, double(seek_index.duration_ms)));
+        }
+    }
+
+    std::shared_ptr<const ServerConfig> config = currentConfig();
+    std::pmr::string etag = fileEtag(track.file_stamp, seek_ms);
+    int64_t last_modified = track.file_stamp.modifiedSeconds();
+    std::pmr::string headers(&requestArena());
+    appendCacheHeaders(headers, config->stream_max_age_seconds, etag, last_modified);
+    if (notModified(request, etag, last_modified)) {
+        sendHttpHeader(conn, 304, "audio/mpeg", 0, headers);
+        return;
+    }
+
+    // Open MP3 file, reusing a cached handle when the catalog says it hasn't changed
+    std::shared_ptr<FileBody> mp3_file = openFile(conn, filepath, track.file_stamp);
+    if (!mp3_file) {
+        if (!fs::exists(filepath)) {
+            // MP3 file not found (removed since the catalog was loaded)
+            sendText(conn, 404, "text/plain", "MP3 file not found");
+            return;
+        }
+        // Failed to open file
+        sendText(conn, 500, "text/plain", "Failed to open MP3 file");
+        return;
+    }
+
+    if (seek_ms == 0 && (seek_index.valid() || !config->stream_pacing_enabled)) {
+        sendStreamBody(conn, request, std::move(mp3_file), 0, seek_index.bitrate, etag, last_modified);
+        return;
+    }
+
+    // Finding the frame a seek starts at, or the bitrate of a file without a seek index, reads the
+    // file: a worker does that, then the body is queued. catalog keeps seek_index alive meanwhile.
+    std::shared_ptr<DeferredResponse> deferred = conn.defer();
+    std::shared_ptr<const KeptRequest> kept = keepRequest(request);
+    runInBackground([deferred, kept, catalog, &seek_index, file = std::move(mp3_file), seek_ms,
+                     etag = std::string(etag), last_modified]() {
+        uint64_t seek_offset = 0;
+        if (seek_ms > 0) {
+            seek_offset = std::min(findMp3FrameBoundary(*file, seek_index, seek_index.offsetAt(seek_ms)), file->size());
+        }
+        uint32_t bitrate = seek_index.valid() ? seek_index.bitrate : probeMp3Bitrate(*file);
+        deferred->complete([=](Connection& conn) {
+            sendStreamBody(conn, kept->request, file, seek_offset, bitrate, etag, last_modified);
+        });
+    });
+}
+
+// Function to find the HLS cut of a track, cutting it now if it isn't cached for this version of the
+// file. A cut reads a frame header per segment, so call it from a background worker.
+static std::shared_ptr<const HlsTrack> hlsTrack(const TrackRow& track, std::string_view filepath, const FileBody& file,
+                                               const Mp3SeekIndex& seek_index) {
+    std::shared_ptr<const HlsTrack> hls = hlsCache().find(filepath, track.file_stamp);
+    if (hls) {
+        return hls;
+    }
+
+    std::shared_ptr<const ServerConfig> config = currentConfig();
+    HlsTrack cut;
+    if (!cutHlsSegments(file, seek_index, config->hls_segment_seconds * 1000, cut.segments)) {
+        return nullptr;
+    }
+    // Anything that moves the cuts gives the segments new URIs, so a cached segment is never stale
+    uint64_t hash = fnv1aHash(std::string_view(reinterpret_cast<const char*>(&track.file_stamp.mtime), sizeof(int64_t)));
+    hash = fnv1aHash(std::string_view(reinterpret_cast<const char*>(&track.file_stamp.size), sizeof(uint64_t)), hash);
+    hash = fnv1aHash(std::string_view(reinterpret_cast<const char*>(&config->hls_segment_seconds), sizeof(unsigned)), hash);
+    char version[17];
+    snprintf(version, sizeof(version), "%016llx", static_cast<unsigned long long>(hash));
+    cut.version = version;
+    // Compressed once per cut, like a description
+    cut.playlist = precompress(renderHlsPlaylist(cut.segments, cut.version), 9, config->description_brotli_quality);
+    return hlsCache().store(std::string(filepath), track.file_stamp, std::move(cut));
+}
+
+// Function to send the playlist of a track's HLS cut, or one of its segments; version and segment
+// are those the segment URI names
+static void sendHlsResource(Connection& conn, const HttpRequest& request, const HlsTrack& hls, std::shared_ptr<FileBody> file,
+                            bool playlist, std::string_view version, size_t segment, int64_t last_modified) {
+    if (playlist) {
+        // Revalidated on every fetch, as it names the segments of the file's current version
+        std::pmr::string etag(&requestArena());
+        etag.append("\"").append(hls.version).append("\"");
+        sendPrecompressed(conn, request, hls.playlist, etag, "Cache-Control: no-cache\r\n",
+                          "application/vnd.apple.mpegurl", last_modified);
+        return;
+    }
+
+    if (version != hls.version || segment >= hls.segments.count()) {
+        // From a playlist for a previous version of the file, or never listed
+        sendText(conn, 404, "text/plain", "Segment not found");
+        return;
+    }
+
+    std::pmr::string etag(&requestArena());
+    etag.append("\"").append(hls.version).append("-");
+    appendNumber(etag, segment);
+    etag += "\"";
+    std::pmr::string headers("Cache-Control: public, max-age=31536000, immutable\r\nETag: ", &requestArena());
+    headers.append(etag).append("\r\n");
+    char date[HTTP_DATE_LENGTH];
+    headers.append("Last-Modified: ").append(formatHttpDate(last_modified, date)).append("\r\n");
+    if (notModified(request, etag, last_modified)) {
+        sendHttpHeader(conn, 304, "audio/mpeg", 0, headers);
+        return;
+    }
+    sendFileBody(conn, std::move(file), hls.segments.offset(segment), hls.segments.length(segment), "audio/mpeg",
+                 rangeToServe(request, etag, last_modified), headers);
+}
+
+
+// Function to send /hls/<id>/playlist.m3u8, the VOD playlist of a track, or /hls/<id>/<version>/<n>.mp3,
+// one of its segments; resource is the path after "/hls/". A segment is a frame-aligned byte range
+// of the track's file, sent from disk like a /stream body but unpaced, and cacheable for good:
+// its URI names the cut it belongs to, so a changed file gets new segment URIs.
+static void sendHls(Connection& conn, std::string_view resource, const HttpRequest& request) {
+    // Track ids may contain '/', so the fixed parts are taken from the end
+    std::string_view encoded_id, version;
+    size_t segment = 0;
+    bool playlist = resource.ends_with("/playlist.m3u8");
+    if (playlist) {
+        encoded_id = resource.substr(0, resource.size() - 14);
+    } else {
+        size_t name_start = resource.rfind('/');
+        size_t version_start = name_start == std::string_view::npos || name_start == 0
+            ? std::string_view::npos
+            : resource.rfind('/', name_start - 1);
+        std::string_view name = resource.substr(name_start + 1);
+        auto [end, ec] = std::from_chars(name.data(), name.data() + name.size(), segment);
+        if (version_start != std::string_view::npos && ec == std::errc() && std::string_view(end, name.data() + name.size()) == ".mp3") {
+            version = resource.substr(version_start + 1, name_start - version_start - 1);
+            encoded_id = resource.substr(0, version_start);
+        }
+    }
+    if (encoded_id.empty()) {
+        sendText(conn, 404, "text/plain", "Not Found");
+        return;
+    }
+
+    std::pmr::u8string track_id = urlDecode(encoded_id, &requestArena());
+    std::shared_ptr<const CatalogSnapshot> catalog;
+    const TrackRow* entry = findTrack(conn, catalog, viewUtf8(track_id));
+    if (!entry) {
+        // Relative segment URIs resolve against the redirected playlist, so they follow it to the other node
+        if (!redirectToHolder(conn, request, viewUtf8(track_id))) {
+            sendText(conn, 404, "text/plain", "Track not found");
+        }
+        return;
+    }
+
+    const TrackRow& track = *entry;
+    const Mp3SeekIndex& seek_index = catalog->tracks.seekIndex(track);
+    if (!seek_index.valid()) {
+        // Only indexed MP3s can be cut at frame boundaries
+        sendText(conn, 404, "text/plain", "Track cannot be segmented");
+        return;
+    }
+
+    // Open MP3 file, reusing a cached handle when the catalog says it hasn't changed
+    std::string_view filepath = catalog->tracks.text(track.filepath);
+    std::shared_ptr<FileBody> mp3_file = openFile(conn, filepath, track.file_stamp);
+    if (!mp3_file) {
+        if (!fs::exists(filepath)) {
+            sendText(conn, 404, "text/plain", "MP3 file not found");
+            return;
+        }
+        sendText(conn, 500, "text/plain", "Failed to open MP3 file");
+        return;
+    }
+
+    int64_t last_modified = track.file_stamp.modifiedSeconds();
+    std::shared_ptr<const HlsTrack> hls = hlsCache().find(filepath, track.file_stamp);
+    if (hls) {
+        sendHlsResource(conn, request, *hls, std::move(mp3_file), playlist, version, segment, last_modified);
+        return;
+    }
+
+    // Not cut yet for this version of the file: a worker cuts it, then the response is queued.
+    // catalog keeps the track's row alive meanwhile.
+    std::shared_ptr<DeferredResponse> deferred = conn.defer();
+    std::shared_ptr<const KeptRequest> kept = keepRequest(request);
+    runInBackground([deferred, kept, catalog, entry, file = std::move(mp3_file), playlist, version = std::string(version),
+                     segment, last_modified]() {
+        std::shared_ptr<const HlsTrack> hls = hlsTrack(*entry, catalog->tracks.text(entry->filepath), *file,
+                                                       catalog->tracks.seekIndex(*entry));
+        deferred->complete([=](Connection& conn) {
+            if (!hls) {
+                sendText(conn, 500, "text/plain", "Failed to segment MP3 file");
+                return;
+            }
+            sendHlsResource(conn, kept->request, *hls, file, playlist, version, segment, last_modified);
+        });
+    });
+}
+
+// Function to send the server's metrics in Prometheus text format
+static void sendMetrics(Connection& conn) {
+    std::string body;
+    body.reserve(16 * 1024);
+    renderMetrics(body);
+
+    FileCache::Stats cache = fileCache().stats();
+    appendMetric(body, "server_file_cache_hits_total", "counter", "Track and description opens served from the file cache.",
+                 static_cast<double>(cache.hits));
+    appendMetric(body, "server_file_cache_misses_total", "counter", "Track and description opens that went to the file system.",
+                 static_cast<double>(cache.misses));
+    appendMetric(body, "server_file_cache_handles", "gauge", "Open files held by the file cache.",
+                 static_cast<double>(cache.handles));
+    appendMetric(body, "server_file_cache_hot_bytes", "gauge", "Bytes of hot tracks mapped into memory.",
+                 static_cast<double>(cache.hot_bytes));
+
+    PrecompressedCache::Stats descriptions = descriptionCache().stats();
+    appendMetric(body, "server_description_cache_hits_total", "counter", "Description requests served from memory.",
+                 static_cast<double>(descriptions.hits));
+    appendMetric(body, "server_description_cache_misses_total", "counter", "Description requests that read and compressed the file.",
+                 static_cast<double>(descriptions.misses));
+    appendMetric(body, "server_description_cache_bytes", "gauge", "Memory held by cached descriptions and their compressed variants.",
+                 static_cast<double>(descriptions.bytes));
+
+    HlsCache::Stats hls = hlsCache().stats();
+    appendMetric(body, "server_hls_cache_hits_total", "counter", "HLS requests served from a cached segment cut.",
+                 static_cast<double>(hls.hits));
+    appendMetric(body, "server_hls_cache_misses_total", "counter", "HLS requests that cut the track into segments.",
+                 static_cast<double>(hls.misses));
+    appendMetric(body, "server_hls_cache_bytes", "gauge", "Memory held by cached segment cuts and playlists.",
+                 static_cast<double>(hls.bytes));
+
+    DiskReader::Stats disk = DiskReader::stats();
+    appendMetric(body, "server_disk_reads_total", "counter", "File body reads completed through io_uring.",
+                 static_cast<double>(disk.reads));
+    appendMetric(body, "server_disk_read_bytes_total", "counter", "Bytes read through io_uring.",
+                 static_cast<double>(disk.bytes));
+    appendMetric(body, "server_disk_read_buffer_waits_total", "counter", "io_uring reads that waited for a free buffer.",
+                 static_cast<double>(disk.buffer_waits));
+
+    if (std::shared_ptr<const ClusterView> cluster = currentClusterView()) {
+        appendMetric(body, "server_cluster_peers_reachable", "gauge", "Cluster peers whose catalog the last sync fetched.",
+                     static_cast<double>(cluster->peers_reachable));
+        appendMetric(body, "server_cluster_remote_tracks", "gauge", "Distinct track ids published by cluster peers.",
+                     static_cast<double>(cluster->remote_tracks.size()));
+    }
+
+    std::shared_ptr<const CatalogSnapshot> catalog = currentCatalog();
+    appendMetric(body, "server_catalog_tracks", "gauge", "Tracks in the published catalog.",
+                 static_cast<double>(catalog->tracks.size()));
+    appendMetric(body, "server_catalog_bytes", "gauge", "Memory held by the published catalog's track table.",
+                 static_cast<double>(catalog->tracks.memoryUsage()));
+    appendMetric(body, "server_search_index_bytes", "gauge", "Memory held by the published catalog's search index.",
+                 static_cast<double>(catalog->search.memoryUsage()));
+    appendMetric(body, "server_search_index_tokens", "gauge", "Distinct tokens in the search index dictionary.",
+                 static_cast<double>(catalog->search.tokenCount()));
+    appendMetric(body, "server_catalog_generation", "gauge", "Generation number of the published catalog.",
+                 static_cast<double>(catalog->generation));
+    appendMetric(body, "server_log_records_dropped_total", "counter", "Log records dropped because the log queue was full.",
+                 static_cast<double>(droppedLogRecords()));
+
+    sendHttpHeader(conn, 200, "text/plain; version=0.0.4", body.length(), "Cache-Control: no-store\r\n");
+    conn.send(std::move(body));
+}
+
+// Function to profile the server for ?seconds=N (default 10) and answer with folded stacks.
+// The profile runs on its own thread, so the response is deferred: the loop carries on serving
+// other connections meanwhile.
+static void sendProfile(Connection& conn, const HttpRequest& request) {
+    std::shared_ptr<const ServerConfig> config = currentConfig();
+    unsigned seconds = 10;
+    std::string_view seconds_text = queryParameter(request.query, "seconds");
+    if (!seconds_text.empty()) {
+        auto [end, error] = std::from_chars(seconds_text.data(), seconds_text.data() + seconds_text.size(), seconds);
+        if (error != std::errc() || end != seconds_text.data() + seconds_text.size() || seconds == 0 ||
+            seconds > config->profile_max_seconds) {
+            sendJsonError(conn, 400, "seconds must be between 1 and profile_max_seconds");
+            return;
+        }
+    }
+    if (!profilerAvailable()) {
+        sendJsonError(conn, 501, "Sampling profiles aren't supported on this platform");
+        return;
+    }
+
+    std::shared_ptr<DeferredResponse> deferred = conn.defer();
+    std::string error;
+    bool started = startProfile(seconds, config->profile_sample_hz, [deferred](ProfileResult result) {
+        deferred->complete([result = std::move(result)](Connection& conn) mutable {
+            if (!result.error.empty()) {
+                sendJsonError(conn, 500, result.error);
+                return;
+            }
+            std::string headers = "Cache-Control: no-store\r\nX-Profile-Samples: " + std::to_string(result.samples) +
+                                  "\r\nX-Profile-Samples-Dropped: " + std::to_string(result.dropped) + "\r\n";
+            sendHttpHeader(conn, 200, "text/plain", result.folded.size(), headers);
+            conn.send(std::move(result.folded));
+        });
+    }, error);
+    if (!started) {
+        conn.deferred.reset();
+        sendJsonError(conn, 409, error);
+    }
+}
+
+// Function to send the slow requests kept while slow_request_ms is set, newest first
+static void sendSlowRequests(Connection& conn) {
+    std::string body;
+    renderSlowRequests(body);
+    sendHttpHeader(conn, 200, "application/json", body.size(), "Cache-Control: no-store\r\n");
+    conn.send(std::move(body));
+}
+
+// Function to check whether the client may use the /debug/ endpoints (debug_access): they profile
+// the whole process and show other clients' addresses and requests
+static bool debugAllowed(const Connection& conn) {
+    const std::string& access = currentConfig()->debug_access;
+    if (access == "any") {
+        return true;
+    }
+    std::string_view ip = conn.clientIp();
+    if (ip.starts_with("::ffff:")) {
+        ip.remove_prefix(7);  // IPv4-mapped
+    }
+    return access == "loopback" && (ip.starts_with("127.") || ip == "::1");
+}
+
+// Function to handle a complete HTTP request buffered on a connection
+void handleHttpRequest(Connection& conn) {
+    const HttpRequest& request = conn.request;
+
+    // HTTP/1.1 connections persist unless the client opts out; HTTP/1.0 ones only if it opts in
+    std::string_view connection_header = request.header("Connection");
+    if (request.version_minor >= 1) {
+        if (headerHasToken(connection_header, "close")) {
+            conn.keep_alive = false;
+        }
+    } else if (!headerHasToken(connection_header, "keep-alive")) {
+        conn.keep_alive = false;
+    }
+
+    // Parse Range header if present; the request itself shows up in the access log once answered
+    std::string_view range_header = request.header("Range");
+    if (!range_header.empty() && logEnabled(LogLevel::Debug)) {
+        logMessage(LogLevel::Debug, "Range request: %.*s", static_cast<int>(range_header.size()), range_header.data());
+    }
+
+    // Debug endpoints are hidden from clients debug_access doesn't admit
+    std::string_view path = request.path;
+    bool debug_path = path.starts_with("/debug/");
+    if (debug_path && !debugAllowed(conn)) {
+        sendText(conn, 404, "text/plain", "Not Found");
+        return;
+    }
+
+    // While the loop is overloaded new work is turned away early, but monitoring still gets through
+    if (conn.overloaded && path != "/metrics" && !debug_path) {
+        conn.endpoint = Endpoint::Shed;
+        conn.keep_alive = false;
+        char retry_after[40];
+        int length = snprintf(retry_after, sizeof(retry_after), "Retry-After: %u\r\n", currentConfig()->retry_after_seconds);
+        sendText(conn, 503, "text/plain", "Service Unavailable", std::string_view(retry_after, length));
+        return;
+    }
+
+    // Handle different paths
+    if (path == "/catalog") {
+        // Return the catalog of available tracks
+        conn.endpoint = Endpoint::Catalog;
+        if (!hasCatalogQueryParameter(request.query)) {
+            sendCatalog(conn, request);
+        } else {
+            sendCatalogQuery(conn, request);
+        }
+    } else if (path.starts_with("/description/")) {
+        // Return the description file for a specific track
+        conn.endpoint = Endpoint::Description;
+        std::pmr::u8string track_id = urlDecode(path.substr(13), &requestArena()); // Decode the track ID to UTF-8
+        sendTrackDescription(conn, request, track_id);
+    } else if (path.starts_with("/stream/")) {
+        // Stream the MP3 file for a specific track
+        conn.endpoint = Endpoint::Stream;
+        std::pmr::u8string track_id = urlDecode(path.substr(8), &requestArena()); // Decode the track ID to UTF-8
+        sendMp3File(conn, request, track_id);
+    } else if (path.starts_with("/hls/")) {
+        // HLS playlist of a track, or one of its segments
+        conn.endpoint = Endpoint::Hls;
+        sendHls(conn, path.substr(5), request);
+    } else if (path == "/search") {
+        // Full-text search over titles, artists and albums
+        conn.endpoint = Endpoint::Search;
+        sendSearch(conn, request);
+    } else if (path == "/cluster/catalog") {
+        // This node's own tracks, which its peers merge into their /catalog
+        conn.endpoint = Endpoint::Cluster;
+        sendCatalog(conn, request, true);
+    } else if (path == "/cluster/status") {
+        // The nodes of the cluster and what was last heard from each
+        conn.endpoint = Endpoint::Cluster;
+        std::shared_ptr<const ClusterView> cluster = currentClusterView();
+        if (cluster) {
+            sendHttpHeader(conn, 200, "application/json", cluster->status->size(), "Cache-Control: no-store\r\n");
+            conn.send(cluster->status);
+        } else {
+            sendJsonError(conn, 404, "Not clustered");
+        }
+    } else if (path == "/reload") {
+        // Force a full rescan in the background; requests keep being served from the current catalog
+        conn.endpoint = Endpoint::Reload;
+        requestCatalogReload();
+        sendText(conn, 202, "application/json", "{\"status\": \"Catalog reload started\"}");
+    } else if (path == "/metrics") {
+        // Counters and latency histograms for monitoring
+        conn.endpoint = Endpoint::Metrics;
+        sendMetrics(conn);
+    } else if (path == "/debug/profile") {
+        // Folded stacks sampled over the next few seconds, for a flame graph
+        conn.endpoint = Endpoint::Debug;
+        sendProfile(conn, request);
+    } else if (path == "/debug/slow") {
+        // The latest requests that crossed slow_request_ms, with their trace spans
+        conn.endpoint = Endpoint::Debug;
+        sendSlowRequests(conn);
+    } else {
+        // Path not found
+        sendText(conn, 404, "text/plain", "Not Found");
+    }
+}
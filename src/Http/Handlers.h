@@ -0,0 +1,13 @@
+#pragma once
+
+#include "Net/Connection.h"
+
+#include <memory_resource>
+
+// Function to URL-decode a string with UTF-8 support, allocating the result from memory
+std::pmr::u8string urlDecode(std::string_view value, std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+
+// Function to handle a complete HTTP request buffered on a connection.
+// Routes /catalog, /search, /description/<id>, /stream/<id>, /hls/<id>/..., /cluster/..., /reload,
+// /metrics and /debug/...; anything else is a 404.
+void handleHttpRequest(Connection& conn);
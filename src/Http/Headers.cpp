@@ -0,0 +1,231 @@
+#include "pch.h"
+#include "Http/Headers.h"
+
+#include <algorithm>
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string_view trimWhitespace(std::string_view value) {
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+        value.remove_prefix(1);
+    }
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+        value.remove_suffix(1);
+    }
+    return value;
+}
+
+bool headerHasToken(std::string_view value, std::string_view token) {
+    while (!value.empty()) {
+        size_t comma = value.find(',');
+        if (equalsIgnoreCase(trimWhitespace(value.substr(0, comma)), token)) {
+            return true;
+        }
+        if (comma == std::string_view::npos) {
+            break;
+        }
+        value.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+// Weight of a q parameter value ("0", "0.5", "1.000") in thousandths; anything malformed counts as 1
+static unsigned parseQuality(std::string_view q) {
+    if (q.empty() || q[0] != '0' || (q.size() > 1 && q[1] != '.')) {
+        return 1000;
+    }
+    unsigned quality = 0, scale = 100;
+    for (size_t i = 2; i < q.size() && i < 5; ++i, scale /= 10) {
+        if (q[i] < '0' || q[i] > '9') {
+            return 1000;
+        }
+        quality += (q[i] - '0') * scale;
+    }
+    return quality;
+}
+
+// Function to split one Accept-Encoding element ("gzip;q=0.5") into its coding and weight
+static std::string_view parseCoding(std::string_view element, unsigned& quality) {
+    quality = 1000;
+    size_t semicolon = element.find(';');
+    std::string_view coding = trimWhitespace(element.substr(0, semicolon));
+    if (semicolon != std::string_view::npos) {
+        std::string_view params = trimWhitespace(element.substr(semicolon + 1));
+        if (params.size() >= 2 && (params[0] == 'q' || params[0] == 'Q') && params[1] == '=') {
+            quality = parseQuality(trimWhitespace(params.substr(2)));
+        }
+    }
+    return coding;
+}
+
+unsigned encodingQuality(std::string_view accept_encoding, std::string_view coding) {
+    unsigned wildcard = 0;
+    while (!accept_encoding.empty()) {
+        size_t comma = accept_encoding.find(',');
+        unsigned quality;
+        std::string_view element = parseCoding(accept_encoding.substr(0, comma), quality);
+        if (equalsIgnoreCase(element, coding)) {
+            return quality;  // an explicit entry wins over "*"
+        }
+        if (element == "*") {
+            wildcard = quality;
+        }
+        if (comma == std::string_view::npos) {
+            break;
+        }
+        accept_encoding.remove_prefix(comma + 1);
+    }
+    return wildcard;
+}
+
+bool acceptsEncoding(std::string_view accept_encoding, std::string_view coding) {
+    return encodingQuality(accept_encoding, coding) > 0;
+}
+
+ContentCoding chooseContentCoding(std::string_view accept_encoding, bool have_gzip, bool have_brotli) {
+    unsigned gzip = have_gzip ? encodingQuality(accept_encoding, "gzip") : 0;
+    unsigned brotli = have_brotli ? encodingQuality(accept_encoding, "br") : 0;
+    if (brotli > 0 && brotli >= gzip) {
+        return ContentCoding::Brotli;
+    }
+    return gzip > 0 ? ContentCoding::Gzip : ContentCoding::Identity;
+}
+
+bool etagMatches(std::string_view if_none_match, std::string_view etag) {
+    if (trimWhitespace(if_none_match) == "*") {
+        return true;
+    }
+    if (etag.substr(0, 2) == "W/") {
+        etag.remove_prefix(2);
+    }
+
+    while (!if_none_match.empty()) {
+        size_t comma = if_none_match.find(',');
+        std::string_view candidate = trimWhitespace(if_none_match.substr(0, comma));
+        if (candidate.substr(0, 2) == "W/") {
+            candidate.remove_prefix(2);
+        }
+        if (candidate == etag) {
+            return true;
+        }
+        if (comma == std::string_view::npos) {
+            break;
+        }
+        if_none_match.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+static const char* const WEEKDAY_NAMES[7] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+static const char* const MONTH_NAMES[12] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+std::string_view formatHttpDate(int64_t seconds, char* buffer) {
+    int64_t day_number = seconds >= 0 ? seconds / 86400 : (seconds - 86399) / 86400;
+    int64_t time_of_day = seconds - day_number * 86400;
+    std::chrono::sys_days days{std::chrono::days(day_number)};
+    std::chrono::year_month_day date{days};
+    int length = snprintf(buffer, HTTP_DATE_LENGTH, "%s, %02u %s %04d %02d:%02d:%02d GMT",
+                          WEEKDAY_NAMES[std::chrono::weekday(days).c_encoding()], static_cast<unsigned>(date.day()),
+                          MONTH_NAMES[static_cast<unsigned>(date.month()) - 1], static_cast<int>(date.year()),
+                          static_cast<int>(time_of_day / 3600), static_cast<int>(time_of_day / 60 % 60),
+                          static_cast<int>(time_of_day % 60));
+    return std::string_view(buffer, std::clamp(length, 0, static_cast<int>(HTTP_DATE_LENGTH) - 1));
+}
+
+// Consume exactly digits decimal digits (or, with space_padded, a space then one fewer) from text
+static bool takeNumber(std::string_view& text, size_t digits, int& value, bool space_padded = false) {
+    if (space_padded && !text.empty() && text[0] == ' ') {
+        text.remove_prefix(1);
+        digits--;
+    }
+    if (text.size() < digits) {
+        return false;
+    }
+    value = 0;
+    for (size_t i = 0; i < digits; ++i) {
+        if (text[i] < '0' || text[i] > '9') {
+            return false;
+        }
+        value = value * 10 + (text[i] - '0');
+    }
+    text.remove_prefix(digits);
+    return true;
+}
+
+static bool takeLiteral(std::string_view& text, std::string_view literal) {
+    if (!text.starts_with(literal)) {
+        return false;
+    }
+    text.remove_prefix(literal.size());
+    return true;
+}
+
+static bool takeMonth(std::string_view& text, int& month) {
+    for (int i = 0; i < 12; ++i) {
+        if (takeLiteral(text, MONTH_NAMES[i])) {
+            month = i + 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+// "HH:MM:SS"
+static bool takeTime(std::string_view& text, int& hour, int& minute, int& second) {
+    return takeNumber(text, 2, hour) && takeLiteral(text, ":") && takeNumber(text, 2, minute) &&
+           takeLiteral(text, ":") && takeNumber(text, 2, second);
+}
+
+bool parseHttpDate(std::string_view value, int64_t& seconds) {
+    value = trimWhitespace(value);
+    int year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0;
+    size_t comma = value.find(',');
+    bool parsed;
+    if (comma == 3) {
+        // IMF-fixdate: "Sun, 06 Nov 1994 08:49:37 GMT"
+        std::string_view text = value.substr(4);
+        parsed = takeLiteral(text, " ") && takeNumber(text, 2, day) && takeLiteral(text, " ") && takeMonth(text, month) &&
+                 takeLiteral(text, " ") && takeNumber(text, 4, year) && takeLiteral(text, " ") &&
+                 takeTime(text, hour, minute, second) && text == " GMT";
+    } else if (comma != std::string_view::npos) {
+        // RFC 850: "Sunday, 06-Nov-94 08:49:37 GMT", the two-digit year taken as the closest to now
+        std::string_view text = value.substr(comma + 1);
+        parsed = takeLiteral(text, " ") && takeNumber(text, 2, day) && takeLiteral(text, "-") && takeMonth(text, month) &&
+                 takeLiteral(text, "-") && takeNumber(text, 2, year) && takeLiteral(text, " ") &&
+                 takeTime(text, hour, minute, second) && text == " GMT";
+        year += year < 70 ? 2000 : 1900;
+    } else {
+        // asctime: "Sun Nov  6 08:49:37 1994"
+        std::string_view text = value.size() > 4 ? value.substr(4) : std::string_view();
+        parsed = takeMonth(text, month) && takeLiteral(text, " ") && takeNumber(text, 2, day, true) &&
+                 takeLiteral(text, " ") && takeTime(text, hour, minute, second) && takeLiteral(text, " ") &&
+                 takeNumber(text, 4, year) && text.empty();
+    }
+
+    std::chrono::year_month_day date{std::chrono::year(year), std::chrono::month(month), std::chrono::day(day)};
+    if (!parsed || !date.ok() || hour > 23 || minute > 59 || second > 60) {
+        return false;
+    }
+    seconds = int64_t(std::chrono::sys_days(date).time_since_epoch().count()) * 86400 + hour * 3600 + minute * 60 + second;
+    return true;
+}
+
+bool ifRangeMatches(std::string_view if_range, std::string_view etag, int64_t last_modified) {
+    if_range = trimWhitespace(if_range);
+    if (if_range.starts_with("\"") || if_range.starts_with("W/")) {
+        // Strong comparison: a weak tag never matches
+        return !etag.empty() && !etag.starts_with("W/") && if_range == etag;
+    }
+    int64_t date;
+    return last_modified >= 0 && parseHttpDate(if_range, date) && date == last_modified;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string_view>
+
+// ASCII case-insensitive comparison, as used for header names and tokens
+bool equalsIgnoreCase(std::string_view a, std::string_view b);
+
+// Strip leading and trailing spaces and tabs
+std::string_view trimWhitespace(std::string_view value);
+
+// True if a comma-separated header value ("keep-alive, Upgrade") contains token
+bool headerHasToken(std::string_view value, std::string_view token);
+
+// Weight an Accept-Encoding value gives coding, in thousandths (q=0.5 is 500); 0 if it isn't acceptable.
+// Honours "*"; an empty value accepts nothing but identity.
+unsigned encodingQuality(std::string_view accept_encoding, std::string_view coding);
+
+// True if an Accept-Encoding value allows coding (honours q=0 and "*")
+bool acceptsEncoding(std::string_view accept_encoding, std::string_view coding);
+
+enum class ContentCoding { Identity, Gzip, Brotli };
+
+// Coding to send a body in, given which compressed variants of it exist: the accepted one with the
+// highest weight, Brotli when they tie as it is the smaller, and identity when neither is accepted
+ContentCoding chooseContentCoding(std::string_view accept_encoding, bool have_gzip, bool have_brotli);
+
+// True if an If-None-Match value ("*" or a list of entity tags) matches etag, using weak comparison
+bool etagMatches(std::string_view if_none_match, std::string_view etag);
+
+// Room for an HTTP-date ("Sun, 06 Nov 1994 08:49:37 GMT") and its terminating NUL
+constexpr size_t HTTP_DATE_LENGTH = 30;
+
+// IMF-fixdate for a Unix time, written into buffer (HTTP_DATE_LENGTH bytes)
+std::string_view formatHttpDate(int64_t seconds, char* buffer);
+
+// Parse an HTTP-date in any of the three formats recipients must accept (IMF-fixdate, RFC 850 and
+// asctime) into a Unix time; false if value is none of them
+bool parseHttpDate(std::string_view value, int64_t& seconds);
+
+// True if an If-Range value still matches the representation, so its Range applies: a strong,
+// exactly equal entity tag, or an HTTP-date exactly equal to last_modified (-1 when there is none)
+bool ifRangeMatches(std::string_view if_range, std::string_view etag, int64_t last_modified);
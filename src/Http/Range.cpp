@@ -0,0 +1,119 @@
+#include "pch.h"
+#include "Http/Range.h"
+#include "Http/Headers.h"
+
+#include <algorithm>
+#include <charconv>
+
+// Parse a non-empty run of decimal digits; rejects signs, spaces and overflow
+static bool parseDecimal(std::string_view text, uint64_t& result) {
+    if (text.empty()) {
+        return false;
+    }
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), result);
+    return ec == std::errc() && end == text.data() + text.size();
+}
+
+RangeResult parseRangeHeader(std::string_view value, uint64_t resource_size, std::pmr::vector<ByteRange>& ranges) {
+    ranges.clear();
+
+    value = trimWhitespace(value);
+    constexpr std::string_view unit = "bytes=";
+    if (value.size() < unit.size() || !equalsIgnoreCase(value.substr(0, unit.size()), unit)) {
+        return RangeResult::Ignored;  // unknown range unit
+    }
+    value.remove_prefix(unit.size());
+
+    size_t spec_count = 0;
+    bool any_spec = false;
+    while (!value.empty()) {
+        size_t comma = value.find(',');
+        std::string_view spec = trimWhitespace(value.substr(0, comma));
+        value = comma == std::string_view::npos ? std::string_view() : value.substr(comma + 1);
+
+        if (spec.empty()) {
+            continue;  // RFC 7230 list syntax allows empty elements
+        }
+        if (++spec_count > MAX_BYTE_RANGES) {
+            ranges.clear();
+            return RangeResult::Ignored;
+        }
+        any_spec = true;
+
+        size_t dash = spec.find('-');
+        if (dash == std::string_view::npos) {
+            ranges.clear();
+            return RangeResult::Ignored;
+        }
+        std::string_view first_text = spec.substr(0, dash);
+        std::string_view last_text = spec.substr(dash + 1);
+
+        if (first_text.empty()) {
+            // Suffix range: the final N bytes
+            uint64_t suffix_length;
+            if (!parseDecimal(last_text, suffix_length)) {
+                ranges.clear();
+                return RangeResult::Ignored;
+            }
+            if (suffix_length == 0 || resource_size == 0) {
+                continue;  // unsatisfiable, but other specs may still match
+            }
+            uint64_t length = std::min(suffix_length, resource_size);
+            ranges.push_back({resource_size - length, resource_size - 1});
+            continue;
+        }
+
+        uint64_t first;
+        if (!parseDecimal(first_text, first)) {
+            ranges.clear();
+            return RangeResult::Ignored;
+        }
+
+        uint64_t last = UINT64_MAX;
+        if (!last_text.empty()) {
+            if (!parseDecimal(last_text, last) || last < first) {
+                ranges.clear();
+                return RangeResult::Ignored;
+            }
+        }
+
+        if (first >= resource_size) {
+            continue;
+        }
+        ranges.push_back({first, std::min(last, resource_size - 1)});
+    }
+
+    if (!any_spec) {
+        return RangeResult::Ignored;
+    }
+    if (ranges.empty()) {
+        return RangeResult::Unsatisfiable;
+    }
+
+    // Coalesce overlapping and adjacent ranges so no byte is sent twice
+    std::sort(ranges.begin(), ranges.end(), [](const ByteRange& a, const ByteRange& b) {
+        return a.first < b.first;
+    });
+    size_t merged = 0;
+    for (size_t i = 1; i < ranges.size(); ++i) {
+        if (ranges[i].first <= ranges[merged].last + 1) {
+            ranges[merged].last = std::max(ranges[merged].last, ranges[i].last);
+        } else {
+            ranges[++merged] = ranges[i];
+        }
+    }
+    ranges.resize(merged + 1);
+
+    return RangeResult::Satisfiable;
+}
+
+std::string_view formatContentRange(const ByteRange& range, uint64_t resource_size, char* buffer) {
+    char* end = buffer + CONTENT_RANGE_MAX_LENGTH;
+    char* out = std::copy_n("bytes ", 6, buffer);
+    out = std::to_chars(out, end, range.first).ptr;
+    *out++ = '-';
+    out = std::to_chars(out, end, range.last).ptr;
+    *out++ = '/';
+    out = std::to_chars(out, end, resource_size).ptr;
+    return std::string_view(buffer, out - buffer);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <memory_resource>
+#include <string_view>
+
+// Inclusive byte range within a resource
+struct ByteRange {
+    uint64_t first;
+    uint64_t last;
+
+    uint64_t length() const { return last - first + 1; }
+};
+
+enum class RangeResult {
+    Ignored,        // no usable Range header; serve the full resource with 200
+    Satisfiable,    // ranges holds at least one range to serve with 206
+    Unsatisfiable   // none of the ranges overlap the resource; reply 416
+};
+
+// Maximum number of byte-range-specs accepted before the header is ignored
+constexpr size_t MAX_BYTE_RANGES = 16;
+
+// Parse an RFC 7233 Range header value ("bytes=0-499,-500") against a resource of resource_size bytes.
+// Satisfiable ranges are clamped to the resource, sorted and coalesced into ranges.
+RangeResult parseRangeHeader(std::string_view value, uint64_t resource_size, std::pmr::vector<ByteRange>& ranges);
+
+// Room for the longest Content-Range value
+constexpr size_t CONTENT_RANGE_MAX_LENGTH = 6 + 3 * 20 + 2;
+
+// "bytes first-last/size" for a Content-Range header, written into buffer (CONTENT_RANGE_MAX_LENGTH bytes)
+std::string_view formatContentRange(const ByteRange& range, uint64_t resource_size, char* buffer);
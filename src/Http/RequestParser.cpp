@@ -0,0 +1,119 @@
+#include "pch.h"
+#include "Http/RequestParser.h"
+#include "Http/Headers.h"
+
+#include <charconv>
+
+std::string_view HttpRequest::header(std::string_view name) const {
+    for (size_t i = 0; i < header_count; ++i) {
+        if (equalsIgnoreCase(headers[i].name, name)) {
+            return headers[i].value;
+        }
+    }
+    return {};
+}
+
+RequestParser::Result RequestParser::parse(std::string_view input, HttpRequest& request) {
+    // Clients may send stray CRLFs between pipelined requests
+    size_t start = 0;
+    while (input.substr(start, 2) == "\r\n") {
+        start += 2;
+    }
+
+    // Resume a few bytes back in case the previous read ended inside the blank line
+    size_t from = std::max(start, scanned >= 3 ? scanned - 3 : 0);
+    size_t head_end = input.find("\r\n\r\n", from);
+    if (head_end == std::string_view::npos) {
+        scanned = input.size();
+        return input.size() >= max_head_bytes ? Result::TooLarge : Result::Incomplete;
+    }
+    scanned = head_end;
+
+    size_t head_length = head_end + 4;
+    if (head_length > max_head_bytes) {
+        return Result::TooLarge;
+    }
+    request.head_length = head_length;
+    return parseHead(input.substr(start, head_end + 2 - start), request);
+}
+
+// Token characters allowed in methods and header names (RFC 7230 tchar)
+static bool isTokenChar(char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || std::strchr("!#$%&'*+-.^_`|~", c) != nullptr;
+}
+
+// head holds the request line and header lines, each terminated by CRLF
+RequestParser::Result RequestParser::parseHead(std::string_view head, HttpRequest& request) {
+    // Request line: method SP request-target SP HTTP-version
+    size_t line_end = head.find("\r\n");
+    std::string_view line = head.substr(0, line_end);
+    head.remove_prefix(line_end + 2);
+
+    size_t method_end = line.find(' ');
+    size_t target_end = method_end == std::string_view::npos ? method_end : line.find(' ', method_end + 1);
+    if (method_end == 0 || target_end == std::string_view::npos || target_end == method_end + 1) {
+        return Result::Invalid;
+    }
+    request.method = line.substr(0, method_end);
+    request.target = line.substr(method_end + 1, target_end - method_end - 1);
+    std::string_view version = line.substr(target_end + 1);
+
+    for (char c : request.method) {
+        if (!isTokenChar(c)) {
+            return Result::Invalid;
+        }
+    }
+    if (version.size() != 8 || version.substr(0, 7) != "HTTP/1." || !std::isdigit(static_cast<unsigned char>(version[7]))) {
+        return Result::Invalid;
+    }
+    request.version_minor = version[7] - '0';
+
+    size_t query_start = request.target.find('?');
+    request.path = request.target.substr(0, query_start);
+    request.query = query_start == std::string_view::npos ? std::string_view() : request.target.substr(query_start + 1);
+
+    // Header fields: name ":" OWS value OWS
+    request.header_count = 0;
+    request.content_length = 0;
+    request.chunked = false;
+    bool has_content_length = false;
+
+    while (!head.empty()) {
+        line_end = head.find("\r\n");
+        line = head.substr(0, line_end);
+        head.remove_prefix(line_end + 2);
+
+        size_t colon = line.find(':');
+        if (colon == 0 || colon == std::string_view::npos) {
+            return Result::Invalid;  // also rejects obsolete line folding
+        }
+        std::string_view name = line.substr(0, colon);
+        for (char c : name) {
+            if (!isTokenChar(c)) {
+                return Result::Invalid;
+            }
+        }
+        if (request.header_count == MAX_REQUEST_HEADERS) {
+            return Result::TooLarge;
+        }
+        HttpHeader& header = request.headers[request.header_count++];
+        header.name = name;
+        header.value = trimWhitespace(line.substr(colon + 1));
+
+        // Framing headers are interpreted here so the event loop can find the end of the request
+        if (equalsIgnoreCase(name, "Content-Length")) {
+            uint64_t length = 0;
+            const char* end = header.value.data() + header.value.size();
+            auto [ptr, ec] = std::from_chars(header.value.data(), end, length);
+            if (ec != std::errc() || ptr != end || (has_content_length && length != request.content_length)) {
+                return Result::Invalid;
+            }
+            request.content_length = length;
+            has_content_length = true;
+        } else if (equalsIgnoreCase(name, "Transfer-Encoding")) {
+            request.chunked = true;
+        }
+    }
+
+    return Result::Complete;
+}
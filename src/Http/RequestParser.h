@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string_view>
+
+struct HttpHeader {
+    std::string_view name;
+    std::string_view value;  // without surrounding whitespace
+};
+
+// Maximum number of header fields in one request; more is answered with 431
+constexpr size_t MAX_REQUEST_HEADERS = 64;
+
+// A parsed request head. All views point into the buffer that was parsed (the connection's
+// input), so they are only valid until that buffer is modified.
+struct HttpRequest {
+    std::string_view method;
+    std::string_view target;  // request-target as sent, e.g. "/stream/Some%20Track?t=30"
+    std::string_view path;    // target up to '?'
+    std::string_view query;   // after '?', empty if none
+    int version_minor = 1;    // HTTP/1.<version_minor>
+
+    HttpHeader headers[MAX_REQUEST_HEADERS];
+    size_t header_count = 0;
+
+    uint64_t content_length = 0;
+    bool chunked = false;  // any Transfer-Encoding, which we don't decode
+
+    size_t head_length = 0;  // bytes up to and including the blank line
+
+    // Value of the first header with this name (case-insensitive); empty if absent
+    std::string_view header(std::string_view name) const;
+};
+
+// Incremental parser for the request at the front of a buffer.
+// Call parse() again whenever more bytes arrive: the search for the end of the head resumes
+// where the previous call left off, and nothing is allocated.
+class RequestParser {
+public:
+    enum class Result {
+        Incomplete,  // the head hasn't fully arrived yet
+        Complete,    // request holds the parsed head
+        Invalid,     // malformed; answer 400 and close
+        TooLarge     // head longer than max_head_bytes or too many headers; answer 431 and close
+    };
+
+    // Request line plus headers; the connection sets it to its request buffer size
+    size_t max_head_bytes = 8192;
+
+    Result parse(std::string_view input, HttpRequest& request);
+
+    // Forget the current request; call once it has been removed from the front of the buffer
+    void reset() { scanned = 0; }
+
+private:
+    Result parseHead(std::string_view head, HttpRequest& request);
+
+    size_t scanned = 0;  // bytes already searched for the blank line
+};
@@ -0,0 +1,50 @@
+#include "pch.h"
+#include "Media/Hls.h"
+#include "Net/FileBody.h"
+
+bool cutHlsSegments(const FileBody& file, const Mp3SeekIndex& index, uint32_t segment_ms, HlsSegments& segments) {
+    segments = HlsSegments();
+    if (!index.valid() || segment_ms == 0) {
+        return false;
+    }
+
+    segments.boundaries.push_back(index.audio_start);
+    segments.start_ms.push_back(0);
+    for (uint64_t time_ms = segment_ms; time_ms < index.duration_ms; time_ms += segment_ms) {
+        uint64_t cut = findMp3FrameBoundary(file, index, index.offsetAt(static_cast<uint32_t>(time_ms)));
+        if (cut <= segments.boundaries.back() || cut >= index.audio_end) {
+            continue;  // found no frame apart from the last cut's; this segment runs on to the next cut
+        }
+        segments.boundaries.push_back(cut);
+        segments.start_ms.push_back(static_cast<uint32_t>(time_ms));
+    }
+    segments.boundaries.push_back(index.audio_end);
+    segments.start_ms.push_back(index.duration_ms);
+    return true;
+}
+
+static void appendSeconds(std::string& out, uint32_t milliseconds) {
+    char text[16];
+    snprintf(text, sizeof(text), "%u.%03u", milliseconds / 1000, milliseconds % 1000);
+    out += text;
+}
+
+std::string renderHlsPlaylist(const HlsSegments& segments, std::string_view version) {
+    // EXT-X-TARGETDURATION must be at least every segment's duration rounded to the nearest second
+    uint32_t target_seconds = 1;
+    for (size_t i = 0; i < segments.count(); ++i) {
+        target_seconds = std::max(target_seconds, (segments.durationMs(i) + 500) / 1000);
+    }
+
+    std::string playlist = "#EXTM3U\n#EXT-X-VERSION:3\n#EXT-X-PLAYLIST-TYPE:VOD\n#EXT-X-INDEPENDENT-SEGMENTS\n";
+    playlist += "#EXT-X-TARGETDURATION:" + std::to_string(target_seconds) + "\n";
+    playlist += "#EXT-X-MEDIA-SEQUENCE:0\n";
+    for (size_t i = 0; i < segments.count(); ++i) {
+        playlist += "#EXTINF:";
+        appendSeconds(playlist, segments.durationMs(i));
+        playlist += ",\n";
+        playlist.append(version).append("/").append(std::to_string(i)).append(".mp3\n");
+    }
+    playlist += "#EXT-X-ENDLIST\n";
+    return playlist;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "Media/Mp3.h"
+
+#include <string_view>
+
+// An MP3 cut into HLS media segments at frame boundaries. Every segment is a byte range of the
+// original file, so it is served straight from disk like any other file body: no remuxing, no copy.
+struct HlsSegments {
+    // Segment i is the bytes [boundaries[i], boundaries[i + 1]) of the file and starts at
+    // start_ms[i] into the track; both have one entry more than there are segments
+    std::vector<uint64_t> boundaries;
+    std::vector<uint32_t> start_ms;
+
+    size_t count() const { return boundaries.empty() ? 0 : boundaries.size() - 1; }
+    uint64_t offset(size_t segment) const { return boundaries[segment]; }
+    uint64_t length(size_t segment) const { return boundaries[segment + 1] - boundaries[segment]; }
+    uint32_t durationMs(size_t segment) const { return start_ms[segment + 1] - start_ms[segment]; }
+};
+
+// Cut the audio described by index into segments of about segment_ms each, the cuts placed on
+// the first frame at or after each multiple of segment_ms. One short read of file per cut.
+// Returns false (leaving segments empty) if the index is invalid.
+bool cutHlsSegments(const FileBody& file, const Mp3SeekIndex& index, uint32_t segment_ms, HlsSegments& segments);
+
+// Render the VOD media playlist for segments. Segment URIs are relative,
+// "<version>/<n>.mp3", so they resolve next to wherever the playlist was fetched from.
+std::string renderHlsPlaylist(const HlsSegments& segments, std::string_view version);
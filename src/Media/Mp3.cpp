@@ -0,0 +1,319 @@
+#include "pch.h"
+#include "Media/Mp3.h"
+#include "Net/FileBody.h"
+
+// Layer III bitrates in kbit/s by header index; index 0 is "free format" and 15 is invalid
+static const uint16_t MPEG1_BITRATES[16] = {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0};
+static const uint16_t MPEG2_BITRATES[16] = {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0};
+static const uint32_t SAMPLE_RATES[3][3] = {
+    {44100, 48000, 32000},  // MPEG 1
+    {22050, 24000, 16000},  // MPEG 2
+    {11025, 12000, 8000}    // MPEG 2.5
+};
+
+// How far past the audio start to look for the first frame
+static constexpr size_t PROBE_BYTES = 8192;
+
+static uint32_t readBigEndian32(const unsigned char* bytes) {
+    return (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) | (uint32_t(bytes[2]) << 8) | bytes[3];
+}
+
+bool parseMp3FrameHeader(const unsigned char* bytes, Mp3FrameHeader& header) {
+    // 11-bit frame sync
+    if (bytes[0] != 0xFF || (bytes[1] & 0xE0) != 0xE0) {
+        return false;
+    }
+
+    int version_bits = (bytes[1] >> 3) & 0x03;
+    int layer_bits = (bytes[1] >> 1) & 0x03;
+    int bitrate_index = bytes[2] >> 4;
+    int sample_rate_index = (bytes[2] >> 2) & 0x03;
+    if (version_bits == 1 || layer_bits != 1 || bitrate_index == 0 || bitrate_index == 15 || sample_rate_index == 3) {
+        return false;  // reserved version, not Layer III, free format or reserved values
+    }
+
+    bool padding = (bytes[2] >> 1) & 0x01;
+    header.mpeg_version = version_bits == 3 ? 1 : version_bits == 2 ? 2 : 25;
+    bool mpeg1 = header.mpeg_version == 1;
+    header.bitrate = (mpeg1 ? MPEG1_BITRATES : MPEG2_BITRATES)[bitrate_index] * 1000u;
+    header.sample_rate = SAMPLE_RATES[mpeg1 ? 0 : header.mpeg_version == 2 ? 1 : 2][sample_rate_index];
+    header.samples = mpeg1 ? 1152 : 576;
+    header.mono = (bytes[3] >> 6) == 3;
+    header.frame_length = (mpeg1 ? 144 : 72) * header.bitrate / header.sample_rate + (padding ? 1 : 0);
+    return true;
+}
+
+uint64_t mp3AudioStart(const FileBody& file) {
+    unsigned char id3[10];
+    if (file.readAt(0, reinterpret_cast<char*>(id3), sizeof(id3)) != sizeof(id3) ||
+        memcmp(id3, "ID3", 3) != 0) {
+        return 0;
+    }
+    // Tag size is a 28-bit "syncsafe" integer, excluding the 10-byte header and optional footer
+    uint64_t size = (uint64_t(id3[6] & 0x7F) << 21) | (uint64_t(id3[7] & 0x7F) << 14) |
+                    (uint64_t(id3[8] & 0x7F) << 7) | uint64_t(id3[9] & 0x7F);
+    bool has_footer = (id3[5] & 0x10) != 0;
+    return 10 + size + (has_footer ? 10 : 0);
+}
+
+// Two headers belong to the same stream if version and sample rate agree
+static bool sameStream(const Mp3FrameHeader& a, const Mp3FrameHeader& b) {
+    return a.mpeg_version == b.mpeg_version && a.sample_rate == b.sample_rate;
+}
+
+// Find the first frame in buffer whose successor (if it is inside buffer) is a frame of the same
+// stream; random data matches a sync word now and then, a chain of two much less often
+static bool findFirstFrame(const unsigned char* buffer, size_t length, size_t& offset, Mp3FrameHeader& header) {
+    for (size_t i = 0; i + 4 <= length; ++i) {
+        if (!parseMp3FrameHeader(buffer + i, header)) {
+            continue;
+        }
+        size_t next = i + header.frame_length;
+        Mp3FrameHeader next_header;
+        if (next + 4 <= length && (!parseMp3FrameHeader(buffer + next, next_header) || !sameStream(header, next_header))) {
+            continue;
+        }
+        offset = i;
+        return true;
+    }
+    return false;
+}
+
+// Totals from a Xing/Info or VBRI header in the first frame, if it has one
+struct VbrHeader {
+    bool found = false;
+    bool constant = false;  // "Info" is written by encoders for CBR files
+    uint32_t frames = 0;
+    uint64_t bytes = 0;
+    const unsigned char* toc = nullptr;  // Xing: 100 entries, each 1/256ths of bytes
+};
+
+static VbrHeader parseVbrHeader(const unsigned char* frame, size_t available, const Mp3FrameHeader& header) {
+    VbrHeader vbr;
+    size_t side_info = header.mpeg_version == 1 ? (header.mono ? 17 : 32) : (header.mono ? 9 : 17);
+    size_t xing = 4 + side_info;
+    if (available >= xing + 8 && (memcmp(frame + xing, "Xing", 4) == 0 || memcmp(frame + xing, "Info", 4) == 0)) {
+        vbr.found = true;
+        vbr.constant = memcmp(frame + xing, "Info", 4) == 0;
+        uint32_t flags = readBigEndian32(frame + xing + 4);
+        size_t field = xing + 8;
+        if ((flags & 0x01) && available >= field + 4) {
+            vbr.frames = readBigEndian32(frame + field);
+            field += 4;
+        }
+        if ((flags & 0x02) && available >= field + 4) {
+            vbr.bytes = readBigEndian32(frame + field);
+            field += 4;
+        }
+        if ((flags & 0x04) && available >= field + 100) {
+            vbr.toc = frame + field;
+        }
+    } else if (available >= 36 + 18 && memcmp(frame + 36, "VBRI", 4) == 0) {
+        vbr.found = true;
+        vbr.bytes = readBigEndian32(frame + 36 + 10);
+        vbr.frames = readBigEndian32(frame + 36 + 14);
+    }
+    return vbr;
+}
+
+uint32_t probeMp3Bitrate(const FileBody& file) {
+    // Called per stream request, so it reads into the stack rather than allocating
+    uint64_t audio_start = mp3AudioStart(file);
+    unsigned char buffer[PROBE_BYTES];
+    int64_t length = file.readAt(audio_start, reinterpret_cast<char*>(buffer), sizeof(buffer));
+    size_t offset;
+    Mp3FrameHeader header;
+    if (length < 4 || !findFirstFrame(buffer, static_cast<size_t>(length), offset, header)) {
+        return 0;
+    }
+
+    // VBR files carry the frame and byte totals in their first frame
+    VbrHeader vbr = parseVbrHeader(&buffer[offset], static_cast<size_t>(length) - offset, header);
+    if (vbr.frames > 0) {
+        uint64_t bytes = vbr.bytes > 0 ? vbr.bytes : file.size() - audio_start - offset;
+        double seconds = double(vbr.frames) * header.samples / header.sample_rate;
+        return seconds > 0 ? static_cast<uint32_t>(bytes * 8 / seconds) : header.bitrate;
+    }
+    return header.bitrate;
+}
+
+uint64_t Mp3SeekIndex::offsetAt(uint32_t time_ms) const {
+    if (!valid() || time_ms == 0) {
+        return audio_start;
+    }
+    uint64_t audio_size = audio_end - audio_start;
+    if (time_ms >= duration_ms) {
+        return audio_end;
+    }
+
+    double position = double(time_ms) / duration_ms;
+    if (points.empty()) {
+        return audio_start + static_cast<uint64_t>(position * audio_size);
+    }
+
+    // Interpolate between the two surrounding points
+    double scaled = position * POINTS;
+    size_t i = std::min(static_cast<size_t>(scaled), POINTS - 1);
+    double low = points[i];
+    double high = i + 1 < points.size() ? points[i + 1] : static_cast<double>(audio_size);
+    return audio_start + static_cast<uint64_t>(low + (high - low) * (scaled - i));
+}
+
+// Walk every frame from audio_start, sampling the offset of roughly every 1/POINTS of the audio
+static bool scanFrames(const FileBody& file, Mp3SeekIndex& index, const Mp3FrameHeader& first) {
+    struct Sample {
+        uint64_t samples;
+        uint64_t offset;
+    };
+    std::vector<Sample> samples;
+
+    std::vector<unsigned char> buffer(64 * 1024);
+    uint64_t buffer_start = 0;
+    size_t buffer_length = 0;
+
+    uint64_t offset = index.audio_start;
+    uint64_t total_samples = 0;
+    Mp3FrameHeader header = first;
+    while (offset + 4 <= index.audio_end) {
+        if (offset < buffer_start || offset + 4 > buffer_start + buffer_length) {
+            int64_t length = file.readAt(offset, reinterpret_cast<char*>(buffer.data()), buffer.size());
+            if (length < 4) {
+                break;
+            }
+            buffer_start = offset;
+            buffer_length = static_cast<size_t>(length);
+        }
+        if (!parseMp3FrameHeader(&buffer[offset - buffer_start], header) || !sameStream(header, first)) {
+            break;  // end of the audio, or damage we can't step over
+        }
+        // About one sample a second keeps this small however long the track is
+        if (samples.empty() || total_samples - samples.back().samples >= first.sample_rate) {
+            samples.push_back({total_samples, offset - index.audio_start});
+        }
+        total_samples += header.samples;
+        offset += header.frame_length;
+    }
+
+    if (total_samples == 0) {
+        return false;
+    }
+    index.audio_end = std::min(offset, index.audio_end);
+    index.duration_ms = static_cast<uint32_t>(total_samples * 1000 / first.sample_rate);
+
+    // Resample to POINTS evenly spaced times
+    index.points.resize(Mp3SeekIndex::POINTS);
+    size_t next = 0;
+    for (size_t i = 0; i < Mp3SeekIndex::POINTS; ++i) {
+        uint64_t target = total_samples * i / Mp3SeekIndex::POINTS;
+        while (next + 1 < samples.size() && samples[next + 1].samples <= target) {
+            next++;
+        }
+        index.points[i] = static_cast<uint32_t>(samples[next].offset);
+    }
+    return true;
+}
+
+bool buildMp3SeekIndex(const FileBody& file, Mp3SeekIndex& index) {
+    index = Mp3SeekIndex();
+    uint64_t audio_start = mp3AudioStart(file);
+    uint64_t audio_end = file.size();
+
+    // ID3v1 tag: the last 128 bytes, starting with "TAG"
+    char tag[3];
+    if (audio_end >= audio_start + 128 && file.readAt(audio_end - 128, tag, 3) == 3 && memcmp(tag, "TAG", 3) == 0) {
+        audio_end -= 128;
+    }
+    if (audio_end - audio_start > UINT32_MAX) {
+        return false;  // offsets are stored as 32 bits
+    }
+
+    std::vector<unsigned char> buffer(PROBE_BYTES);
+    int64_t length = file.readAt(audio_start, reinterpret_cast<char*>(buffer.data()), buffer.size());
+    size_t first_offset;
+    Mp3FrameHeader first;
+    if (length < 4 || !findFirstFrame(buffer.data(), static_cast<size_t>(length), first_offset, first)) {
+        return false;
+    }
+
+    index.sample_rate = first.sample_rate;
+    index.mpeg_version = static_cast<uint8_t>(first.mpeg_version);
+    index.audio_start = audio_start + first_offset;
+    index.audio_end = audio_end;
+    uint64_t audio_size = index.audio_end - index.audio_start;
+
+    VbrHeader vbr = parseVbrHeader(&buffer[first_offset], static_cast<size_t>(length) - first_offset, first);
+    if (vbr.found && vbr.frames > 0 && (vbr.constant || vbr.toc)) {
+        // Encoder-written totals; the Xing TOC maps percent of duration to 1/256ths of the size
+        uint64_t total_samples = uint64_t(vbr.frames) * first.samples;
+        index.duration_ms = static_cast<uint32_t>(total_samples * 1000 / first.sample_rate);
+        if (vbr.toc && !vbr.constant) {
+            uint64_t bytes = vbr.bytes > 0 ? std::min<uint64_t>(vbr.bytes, audio_size) : audio_size;
+            index.points.resize(Mp3SeekIndex::POINTS);
+            for (size_t i = 0; i < Mp3SeekIndex::POINTS; ++i) {
+                index.points[i] = static_cast<uint32_t>(vbr.toc[i] * bytes / 256);
+            }
+        }
+    } else if (!vbr.found) {
+        // No header: constant bitrate if the frames all agree, otherwise walk the file
+        bool constant = true;
+        size_t frames_checked = 0;
+        Mp3FrameHeader header;
+        for (size_t offset = first_offset; offset + 4 <= static_cast<size_t>(length) && frames_checked < 32;
+             offset += header.frame_length, ++frames_checked) {
+            if (!parseMp3FrameHeader(&buffer[offset], header) || header.bitrate != first.bitrate) {
+                constant = false;
+                break;
+            }
+        }
+        // Files that change bitrate only later on are common too; sample a few frames further in
+        for (int eighth = 1; constant && eighth < 8; ++eighth) {
+            uint64_t probe = findMp3FrameBoundary(file, index, index.audio_start + audio_size * eighth / 8);
+            unsigned char bytes[4];
+            if (file.readAt(probe, reinterpret_cast<char*>(bytes), 4) == 4 && parseMp3FrameHeader(bytes, header) &&
+                header.bitrate != first.bitrate) {
+                constant = false;
+            }
+        }
+        if (constant) {
+            index.duration_ms = static_cast<uint32_t>(audio_size * 8 * 1000 / first.bitrate);
+        } else if (!scanFrames(file, index, first)) {
+            return false;
+        }
+    } else if (!scanFrames(file, index, first)) {
+        // VBRI or a Xing header without a TOC
+        return false;
+    }
+
+    if (index.duration_ms == 0) {
+        index = Mp3SeekIndex();
+        return false;
+    }
+    index.bitrate = static_cast<uint32_t>((index.audio_end - index.audio_start) * 8 * 1000 / index.duration_ms);
+    return true;
+}
+
+uint64_t findMp3FrameBoundary(const FileBody& file, const Mp3SeekIndex& index, uint64_t offset) {
+    unsigned char buffer[PROBE_BYTES];
+    int64_t length = file.readAt(offset, reinterpret_cast<char*>(buffer), sizeof(buffer));
+    if (length < 4) {
+        return offset;
+    }
+
+    Mp3FrameHeader expected;
+    expected.mpeg_version = index.mpeg_version;
+    expected.sample_rate = index.sample_rate;
+    for (size_t i = 0; i + 4 <= static_cast<size_t>(length); ++i) {
+        Mp3FrameHeader header;
+        if (!parseMp3FrameHeader(&buffer[i], header) || !sameStream(header, expected)) {
+            continue;
+        }
+        size_t next = i + header.frame_length;
+        Mp3FrameHeader next_header;
+        if (next + 4 <= static_cast<size_t>(length) &&
+            (!parseMp3FrameHeader(&buffer[next], next_header) || !sameStream(next_header, expected))) {
+            continue;
+        }
+        return offset + i;
+    }
+    return offset;
+}
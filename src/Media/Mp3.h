@@ -0,0 +1,54 @@
+#pragma once
+
+class FileBody;
+
+// MPEG audio Layer III frame header (the 4 bytes in front of every frame)
+struct Mp3FrameHeader {
+    int mpeg_version;       // 1, 2, or 25 for MPEG 2.5
+    uint32_t bitrate;       // bits per second
+    uint32_t sample_rate;   // Hz
+    uint32_t samples;       // samples per frame
+    bool mono;
+    uint32_t frame_length;  // bytes, header included
+};
+
+// Decode a frame header; false if bytes[0..3] isn't a valid Layer III header
+bool parseMp3FrameHeader(const unsigned char* bytes, Mp3FrameHeader& header);
+
+// Byte offset of the audio data, i.e. just past an ID3v2 tag if the file starts with one
+uint64_t mp3AudioStart(const FileBody& file);
+
+// Average bitrate of the file in bits per second, from a Xing/Info or VBRI header when present and
+// from the first frame otherwise; 0 if no frame is found near the start of the audio
+uint32_t probeMp3Bitrate(const FileBody& file);
+
+// Byte offsets at evenly spaced times through an MP3, for time-based seeking without reading
+// the file. Built once per track at catalog load and kept in the catalog index.
+struct Mp3SeekIndex {
+    static constexpr size_t POINTS = 100;
+
+    uint32_t duration_ms = 0;  // 0 if the file isn't an MP3 we could index
+    uint32_t bitrate = 0;      // average, bits per second
+    uint32_t sample_rate = 0;  // of the first frame; frames found when seeking must match it
+    uint8_t mpeg_version = 0;
+    uint64_t audio_start = 0;  // first frame
+    uint64_t audio_end = 0;    // end of the audio, before any trailing ID3v1 tag
+
+    // points[i] is the offset from audio_start of the audio at i/POINTS of the duration.
+    // Empty for constant-bitrate files, where offsets are proportional to time.
+    std::vector<uint32_t> points;
+
+    bool valid() const { return duration_ms > 0; }
+
+    // Approximate byte offset of time_ms into the track; may land inside a frame
+    uint64_t offsetAt(uint32_t time_ms) const;
+};
+
+// Build the seek index for file: from a Xing/Info or VBRI header when there is one, by
+// assuming constant bitrate when the first frames agree, and by walking every frame otherwise.
+// Returns false (leaving index invalid) if no MP3 audio is found.
+bool buildMp3SeekIndex(const FileBody& file, Mp3SeekIndex& index);
+
+// Offset of the first frame that starts at or after offset and matches the index's stream
+// (checked against the frame that follows it too); returns offset unchanged if none is near
+uint64_t findMp3FrameBoundary(const FileBody& file, const Mp3SeekIndex& index, uint64_t offset);
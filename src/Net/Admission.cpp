@@ -0,0 +1,55 @@
+#include "pch.h"
+#include "Net/Admission.h"
+#include "Utils/Hash.h"
+
+namespace {
+
+// Addresses are counted whether or not max_per_ip is set, so a reload can turn the cap on
+// without miscounting the connections already open. Sharded like the caches, since every accept
+// and close takes one of the locks.
+constexpr size_t SHARD_COUNT = 8;
+
+struct Shard {
+    std::mutex mutex;
+    std::unordered_map<std::string, unsigned, StringHash, std::equal_to<>> connections;
+};
+
+Shard shards[SHARD_COUNT];
+std::atomic<size_t> admitted{0};
+
+Shard& shardFor(const std::string& client_ip) {
+    return shards[StringHash()(client_ip) % SHARD_COUNT];
+}
+
+}
+
+bool admitConnection(const std::string& client_ip, unsigned max_total, unsigned max_per_ip) {
+    if (admitted.fetch_add(1, std::memory_order_relaxed) >= max_total && max_total > 0) {
+        admitted.fetch_sub(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    Shard& shard = shardFor(client_ip);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    unsigned& open = shard.connections[client_ip];
+    if (max_per_ip > 0 && open >= max_per_ip) {
+        admitted.fetch_sub(1, std::memory_order_relaxed);
+        return false;
+    }
+    open++;
+    return true;
+}
+
+void releaseConnection(const std::string& client_ip) {
+    admitted.fetch_sub(1, std::memory_order_relaxed);
+    Shard& shard = shardFor(client_ip);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.connections.find(client_ip);
+    if (it != shard.connections.end() && --it->second == 0) {
+        shard.connections.erase(it);
+    }
+}
+
+size_t admittedConnections() {
+    return admitted.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+
+// Admission control for client connections: caps on the connections open at once, for the whole
+// server and per client address, checked when a connection is accepted. Over a cap the connection
+// gets a canned 503 and is closed before any state is allocated for it.
+
+// Function to count a new connection from client_ip unless max_total connections are open already,
+// or max_per_ip from that address (0 = no cap). Returns false, counting nothing, when one is reached.
+// Every admitted connection is released once with releaseConnection().
+bool admitConnection(const std::string& client_ip, unsigned max_total, unsigned max_per_ip);
+void releaseConnection(const std::string& client_ip);
+
+// Connections admitted and not yet released
+size_t admittedConnections();
@@ -0,0 +1,103 @@
+#include "pch.h"
+#include "ServerConfig.h"
+#include "Net/Bandwidth.h"
+
+TokenBucket::TokenBucket(uint64_t rate, uint64_t capacity, uint64_t initial_tokens)
+    : rate(static_cast<double>(rate)),
+      capacity(static_cast<double>(std::max(capacity, initial_tokens))),
+      tokens(static_cast<double>(initial_tokens)),
+      last_refill(clock::now()) {
+}
+
+uint64_t TokenBucket::available(clock::time_point now) {
+    if (unlimited()) {
+        return UINT64_MAX;
+    }
+    if (now > last_refill) {
+        tokens = std::min(capacity, tokens + rate * std::chrono::duration<double>(now - last_refill).count());
+        last_refill = now;
+    }
+    return tokens > 0 ? static_cast<uint64_t>(tokens) : 0;
+}
+
+void TokenBucket::consume(uint64_t bytes) {
+    if (!unlimited()) {
+        tokens -= static_cast<double>(bytes);
+    }
+}
+
+void TokenBucket::refund(uint64_t bytes) {
+    if (!unlimited()) {
+        tokens = std::min(capacity, tokens + static_cast<double>(bytes));
+    }
+}
+
+TokenBucket::clock::duration TokenBucket::timeUntil(uint64_t bytes) const {
+    double missing = static_cast<double>(bytes) - tokens;
+    if (unlimited() || missing <= 0) {
+        return clock::duration::zero();
+    }
+    return std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(missing / rate));
+}
+
+SharedTokenBucket::SharedTokenBucket(uint64_t rate, uint64_t capacity)
+    : bucket(rate, capacity, capacity) {
+}
+
+uint64_t SharedTokenBucket::take(uint64_t wanted, TokenBucket::clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex);
+    uint64_t granted = std::min(wanted, bucket.available(now));
+    bucket.consume(granted);
+    return granted;
+}
+
+void SharedTokenBucket::refund(uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    bucket.refund(bytes);
+}
+
+TokenBucket::clock::duration SharedTokenBucket::timeUntil(uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return bucket.timeUntil(bytes);
+}
+
+// Shared caps hold a quarter second of traffic so they smooth bursts without starving anyone
+static uint64_t sharedCapacity(uint64_t rate) {
+    return std::max<uint64_t>(rate / 4, 64 * 1024);
+}
+
+std::shared_ptr<SharedTokenBucket> clientBandwidthBucket(const std::string& client_ip) {
+    // A start-up setting, so it is read once
+    static const uint64_t rate = currentConfig()->max_client_bytes_per_second;
+    if (rate == 0) {
+        return nullptr;
+    }
+
+    static std::mutex clients_mutex;
+    static std::unordered_map<std::string, std::weak_ptr<SharedTokenBucket>> clients;
+    static size_t prune_at = 1024;
+
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    std::shared_ptr<SharedTokenBucket> bucket = clients[client_ip].lock();
+    if (!bucket) {
+        bucket = std::make_shared<SharedTokenBucket>(rate, sharedCapacity(rate));
+        clients[client_ip] = bucket;
+    }
+
+    // Forget addresses with no open connections once the table has grown
+    if (clients.size() >= prune_at) {
+        for (auto it = clients.begin(); it != clients.end();) {
+            it = it->second.expired() ? clients.erase(it) : std::next(it);
+        }
+        prune_at = std::max<size_t>(1024, clients.size() * 2);
+    }
+    return bucket;
+}
+
+SharedTokenBucket* globalBandwidthBucket() {
+    static std::unique_ptr<SharedTokenBucket> bucket = [] {
+        uint64_t rate = currentConfig()->max_total_bytes_per_second;
+        return rate == 0 ? nullptr : std::make_unique<SharedTokenBucket>(rate, sharedCapacity(rate));
+    }();
+    return bucket.get();
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+// Token bucket: refills at rate bytes per second and holds at most capacity bytes.
+// Not thread-safe; see SharedTokenBucket for buckets used by several connections.
+class TokenBucket {
+public:
+    using clock = std::chrono::steady_clock;
+
+    // rate 0 makes the bucket unlimited
+    TokenBucket(uint64_t rate = 0, uint64_t capacity = 0, uint64_t initial_tokens = 0);
+
+    bool unlimited() const { return rate == 0; }
+
+    // Whole bytes available now (refills first)
+    uint64_t available(clock::time_point now);
+    void consume(uint64_t bytes);
+    void refund(uint64_t bytes);
+
+    // How long until bytes are available, assuming nothing else consumes them
+    clock::duration timeUntil(uint64_t bytes) const;
+
+private:
+    double rate;
+    double capacity;
+    double tokens;
+    clock::time_point last_refill;
+};
+
+// Bucket shared across connections and event loop threads, for the per-IP and global caps
+class SharedTokenBucket {
+public:
+    SharedTokenBucket(uint64_t rate, uint64_t capacity);
+
+    // Take up to wanted bytes; returns how many were granted
+    uint64_t take(uint64_t wanted, TokenBucket::clock::time_point now);
+    void refund(uint64_t bytes);
+    TokenBucket::clock::duration timeUntil(uint64_t bytes);
+
+private:
+    std::mutex mutex;
+    TokenBucket bucket;
+};
+
+// Cap on the file bytes sent to one client address; nullptr when max_client_bytes_per_second is 0.
+// Connections from the same address share one bucket.
+std::shared_ptr<SharedTokenBucket> clientBandwidthBucket(const std::string& client_ip);
+
+// Cap on all file bytes the server sends; nullptr when max_total_bytes_per_second is 0
+SharedTokenBucket* globalBandwidthBucket();
@@ -0,0 +1,30 @@
+#include "pch.h"
+#include "Net/BufferPool.h"
+
+std::string BufferPool::take(size_t capacity) {
+    std::vector<std::string>& list = capacity <= SMALL_CAPACITY ? small : large;
+    std::string buffer;
+    if (!list.empty()) {
+        buffer = std::move(list.back());
+        list.pop_back();
+    }
+    buffer.reserve(capacity);
+    return buffer;
+}
+
+void BufferPool::give(std::string&& buffer) {
+    size_t capacity = buffer.capacity();
+    if (capacity <= std::string().capacity() || capacity > MAX_CAPACITY) {
+        return;  // nothing worth keeping (short string storage), or too big to keep around
+    }
+    std::vector<std::string>& list = capacity <= SMALL_CAPACITY ? small : large;
+    if (list.size() < MAX_POOLED_PER_LIST) {
+        buffer.clear();
+        list.push_back(std::move(buffer));
+    }
+}
+
+BufferPool& bufferPool() {
+    thread_local BufferPool pool;
+    return pool;
+}
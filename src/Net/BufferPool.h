@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+
+// Recycled byte buffers for connection I/O: response headers and small bodies queued on a
+// connection, request input and file staging chunks. Handing a buffer back keeps its capacity for
+// the next response, so steady-state serving reuses the same few allocations. Small buffers
+// (headers) and large ones (input and chunks) are kept apart, and both lists are bounded in count
+// and in the capacity they keep, so a burst of connections doesn't leave memory pinned.
+// Not thread-safe; each thread has its own, see bufferPool().
+class BufferPool {
+public:
+    // An empty buffer with room for at least capacity bytes
+    std::string take(size_t capacity);
+
+    // Return a buffer for reuse; its contents are discarded
+    void give(std::string&& buffer);
+
+    size_t pooledBuffers() const { return small.size() + large.size(); }
+
+private:
+    static constexpr size_t SMALL_CAPACITY = 2048;          // headers and error bodies
+    static constexpr size_t MAX_CAPACITY = 64 * 1024;       // larger buffers are freed, not kept
+    static constexpr size_t MAX_POOLED_PER_LIST = 256;
+
+    std::vector<std::string> small;
+    std::vector<std::string> large;
+};
+
+// The calling thread's pool. A connection is only ever driven by its event loop's thread, so
+// the buffers it takes and gives back stay within that loop.
+BufferPool& bufferPool();
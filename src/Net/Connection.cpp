@@ -0,0 +1,430 @@
+#include "pch.h"
+#include "ServerConfig.h"
+#include "Net/Connection.h"
+#include "Net/DiskReader.h"
+#include "Net/BufferPool.h"
+#include "Net/Poller.h"
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
+// Smallest send a throttled connection waits for, so pacing doesn't degrade into tiny packets
+static constexpr uint64_t PACING_QUANTUM_BYTES = 16 * 1024;
+
+Connection::Connection(socket_t socket, std::string client_ip)
+    : client_socket(socket), client_ip(std::move(client_ip)),
+      client_bucket(clientBandwidthBucket(this->client_ip)) {
+    std::shared_ptr<const ServerConfig> config = currentConfig();
+    buffer_size = config->buffer_size;
+    sendfile_chunk_size = config->sendfile_chunk_size;
+    parser.max_head_bytes = buffer_size;
+}
+
+void DeferredResponse::complete(std::function<void(Connection&)> respond_later) {
+    std::lock_guard<std::mutex> lock(mutex);
+    respond = std::move(respond_later);
+    if (poller) {
+        poller->wakeup();
+    }
+}
+
+std::shared_ptr<DeferredResponse> Connection::defer() {
+    deferred = std::make_shared<DeferredResponse>();
+    return deferred;
+}
+
+Connection::~Connection() {
+    if (deferred) {
+        std::lock_guard<std::mutex> lock(deferred->mutex);
+        deferred->poller = nullptr;
+    }
+    if (disk_reader) {
+        disk_reader->forget(*this);
+        if (chunk_buffer >= 0) {
+            disk_reader->release(chunk_buffer);
+        }
+    }
+    while (hasPendingOutput()) {
+        popSegment();
+    }
+    BufferPool& pool = bufferPool();
+    pool.give(std::move(input));
+    pool.give(std::move(file_chunk));
+    CLOSE_SOCKET(client_socket);
+}
+
+void Connection::send(std::string data) {
+    if (data.empty()) {
+        return;
+    }
+    response_bytes += data.size();
+    OutputSegment& segment = output.emplace_back();
+    segment.data = std::move(data);
+}
+
+void Connection::send(const char* data, size_t length) {
+    std::string buffer = bufferPool().take(length);
+    buffer.assign(data, length);
+    send(std::move(buffer));
+}
+
+void Connection::send(std::shared_ptr<const std::string> data) {
+    if (!data || data->empty()) {
+        return;
+    }
+    response_bytes += data->size();
+    OutputSegment& segment = output.emplace_back();
+    segment.shared_data = std::move(data);
+}
+
+void Connection::sendFile(std::shared_ptr<FileBody> file, uint64_t offset, uint64_t length) {
+    if (!file || length == 0) {
+        return;
+    }
+    response_bytes += length;
+    OutputSegment& segment = output.emplace_back();
+    segment.file = std::move(file);
+    segment.file_offset = offset;
+    segment.file_remaining = length;
+}
+
+// Retire the segment at the front of the queue, recycling its buffer
+void Connection::popSegment() {
+    OutputSegment& segment = output[output_head];
+    bufferPool().give(std::move(segment.data));
+    segment = OutputSegment();
+    if (++output_head == output.size()) {
+        output.clear();
+        output_head = 0;
+    }
+}
+
+void Connection::releaseIdleBuffers() {
+    BufferPool& pool = bufferPool();
+    if (input.empty()) {
+        pool.give(std::exchange(input, std::string()));
+    }
+    pool.give(std::exchange(file_chunk, std::string()));
+}
+
+bool Connection::readAvailable() {
+    char buffer[16 * 1024];
+
+    if (input.empty() && input.capacity() < buffer_size) {
+        input = bufferPool().take(buffer_size);
+    }
+
+    // Stop once a full request buffer is waiting; the loop decides what to do with it
+    bool request_pending = !input.empty();
+    while (input.size() < buffer_size) {
+        size_t wanted = std::min(sizeof(buffer), buffer_size - input.size());
+        int bytes_received = recv(client_socket, buffer, static_cast<int>(wanted), 0);
+        if (bytes_received > 0) {
+            input.append(buffer, bytes_received);
+            last_activity = std::chrono::steady_clock::now();
+            if (!request_pending) {
+                request_begun = last_activity;
+                request_pending = true;
+            }
+            continue;
+        }
+        if (bytes_received == 0) {
+            // Peer closed its side, perhaps right after sending a request: answer what arrived first
+            peer_closed = true;
+            return !input.empty();
+        }
+        return SOCKET_WOULD_BLOCK(SOCKET_LAST_ERROR);
+    }
+    return true;
+}
+
+bool Connection::fillFileChunk(OutputSegment& segment) {
+    if (file_chunk.size() < buffer_size) {
+        if (file_chunk.capacity() < buffer_size) {
+            file_chunk = bufferPool().take(buffer_size);
+        }
+        file_chunk.resize(buffer_size);
+    }
+
+    size_t to_read = static_cast<size_t>(std::min<uint64_t>(segment.file_remaining, buffer_size));
+    int64_t bytes_read = segment.file->readAt(segment.file_offset, file_chunk.data(), to_read);
+    if (bytes_read <= 0) {
+        // File is shorter than announced or unreadable
+        return false;
+    }
+
+    chunk_offset = 0;
+    chunk_length = static_cast<size_t>(bytes_read);
+    segment.file_offset += chunk_length;
+    segment.file_remaining -= chunk_length;
+    return true;
+}
+
+void Connection::fileChunkRead(int buffer, int64_t bytes_read) {
+    waiting_for_disk = false;
+    if (buffer < 0) {
+        // File is shorter than announced or unreadable
+        disk_read_failed = true;
+        return;
+    }
+
+    OutputSegment& segment = frontSegment();
+    chunk_buffer = buffer;
+    chunk_offset = 0;
+    chunk_length = static_cast<size_t>(bytes_read);
+    segment.file_offset += chunk_length;
+    segment.file_remaining -= std::min<uint64_t>(segment.file_remaining, chunk_length);
+}
+
+// Send the staged DiskReader chunk, or start reading the next one once it has all gone out
+int64_t Connection::writeDiskChunk(OutputSegment& segment, uint64_t max_bytes) {
+    if (chunk_offset == chunk_length) {
+        if (disk_read_failed) {
+            return -1;
+        }
+        if (!waiting_for_disk) {
+            waiting_for_disk = true;
+            disk_reader->read(*this, segment.file, segment.file_offset,
+                              static_cast<size_t>(std::min<uint64_t>(segment.file_remaining, disk_reader->bufferSize())));
+        }
+        return 0;
+    }
+
+    size_t count = static_cast<size_t>(std::min<uint64_t>(chunk_length - chunk_offset, max_bytes));
+    int bytes_sent = ::send(client_socket, disk_reader->buffer(chunk_buffer) + chunk_offset, static_cast<int>(count), MSG_NOSIGNAL);
+    if (bytes_sent < 0) {
+        return SOCKET_WOULD_BLOCK(SOCKET_LAST_ERROR) ? 0 : -1;
+    }
+    chunk_offset += bytes_sent;
+    if (chunk_offset == chunk_length) {
+        // Free the buffer for other connections while this one waits for its next read
+        disk_reader->release(chunk_buffer);
+        chunk_buffer = -1;
+    }
+    return bytes_sent;
+}
+
+void Connection::paceFileBodies(uint64_t bytes_per_second, uint64_t burst_bytes) {
+    stream_bucket = TokenBucket(bytes_per_second, burst_bytes, burst_bytes);
+}
+
+uint64_t Connection::claimBandwidth(uint64_t wanted) {
+    SharedTokenBucket* global_bucket = globalBandwidthBucket();
+    if (stream_bucket.unlimited() && !client_bucket && !global_bucket) {
+        return wanted;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    uint64_t minimum = std::min(wanted, PACING_QUANTUM_BYTES);
+    uint64_t claimed = std::min(wanted, stream_bucket.available(now));
+
+    // Take the same amount from each shared bucket, handing it back if any of them is short
+    uint64_t client_granted = 0;
+    if (claimed >= minimum && client_bucket) {
+        client_granted = client_bucket->take(claimed, now);
+        claimed = client_granted;
+    }
+    if (claimed >= minimum && global_bucket) {
+        uint64_t global_granted = global_bucket->take(claimed, now);
+        if (client_bucket && global_granted < client_granted) {
+            client_bucket->refund(client_granted - global_granted);
+            client_granted = global_granted;
+        }
+        claimed = global_granted;
+        if (claimed < minimum) {
+            global_bucket->refund(claimed);
+        }
+    }
+    if (claimed >= minimum) {
+        return claimed;
+    }
+
+    if (client_bucket) {
+        client_bucket->refund(client_granted);
+    }
+    auto wait = stream_bucket.timeUntil(minimum);
+    if (client_bucket) {
+        wait = std::max(wait, client_bucket->timeUntil(minimum));
+    }
+    if (global_bucket) {
+        wait = std::max(wait, global_bucket->timeUntil(minimum));
+    }
+    throttled = true;
+    resume_at = now + std::max<std::chrono::steady_clock::duration>(wait, std::chrono::milliseconds(1));
+    return 0;
+}
+
+void Connection::settleBandwidth(uint64_t claimed, uint64_t sent) {
+    stream_bucket.consume(sent);
+    uint64_t unused = claimed > sent ? claimed - sent : 0;
+    if (unused > 0) {
+        if (client_bucket) {
+            client_bucket->refund(unused);
+        }
+        if (SharedTokenBucket* global_bucket = globalBandwidthBucket()) {
+            global_bucket->refund(unused);
+        }
+    }
+}
+
+int64_t Connection::writeFileSegment(OutputSegment& segment, uint64_t max_bytes) {
+    if (disk_reader) {
+        return writeDiskChunk(segment, max_bytes);
+    }
+#ifdef __linux__
+    // Zero-copy: the kernel moves page cache pages straight to the socket
+    off_t offset = static_cast<off_t>(segment.file_offset);
+    size_t count = static_cast<size_t>(std::min<uint64_t>({segment.file_remaining, sendfile_chunk_size, max_bytes}));
+    ssize_t bytes_sent = sendfile(client_socket, segment.file->nativeHandle(), &offset, count);
+    if (bytes_sent > 0) {
+        segment.file_offset += bytes_sent;
+        segment.file_remaining -= bytes_sent;
+        return bytes_sent;
+    }
+    if (bytes_sent == 0) {
+        return -1;  // file shrank underneath us; the announced length can't be met
+    }
+    return (SOCKET_WOULD_BLOCK(errno) || errno == EINTR) ? 0 : -1;
+#else
+    if (segment.file->isMapped()) {
+        // Hot track: send straight out of the mapping, without a read or a staging copy
+        const char* data = segment.file->contents().data() + segment.file_offset;
+        size_t count = static_cast<size_t>(std::min<uint64_t>({segment.file_remaining, sendfile_chunk_size, max_bytes}));
+        int bytes_sent = ::send(client_socket, data, static_cast<int>(count), MSG_NOSIGNAL);
+        if (bytes_sent < 0) {
+            return SOCKET_WOULD_BLOCK(SOCKET_LAST_ERROR) ? 0 : -1;
+        }
+        segment.file_offset += bytes_sent;
+        segment.file_remaining -= bytes_sent;
+        return bytes_sent;
+    }
+
+    if (chunk_offset == chunk_length && !fillFileChunk(segment)) {
+        return -1;
+    }
+
+    size_t count = static_cast<size_t>(std::min<uint64_t>(chunk_length - chunk_offset, max_bytes));
+    int bytes_sent = ::send(client_socket, file_chunk.data() + chunk_offset, static_cast<int>(count), MSG_NOSIGNAL);
+    if (bytes_sent < 0) {
+        return SOCKET_WOULD_BLOCK(SOCKET_LAST_ERROR) ? 0 : -1;
+    }
+    chunk_offset += bytes_sent;
+    return bytes_sent;
+#endif
+}
+
+int64_t Connection::writeBufferedSegments() {
+    // Gather the run of in-memory segments at the front of the queue
+    constexpr size_t MAX_GATHER = 16;
+#ifdef _WIN32
+    WSABUF buffers[MAX_GATHER];
+#else
+    iovec buffers[MAX_GATHER];
+#endif
+    size_t count = 0;
+    bool file_follows = false;
+    for (size_t i = output_head; i < output.size(); ++i) {
+        const OutputSegment& segment = output[i];
+        if (segment.file) {
+            file_follows = true;
+            break;
+        }
+        if (count == MAX_GATHER) {
+            break;
+        }
+        const std::string& buffer = segment.buffer();
+#ifdef _WIN32
+        buffers[count].buf = const_cast<char*>(buffer.data()) + segment.offset;
+        buffers[count].len = static_cast<ULONG>(buffer.size() - segment.offset);
+#else
+        buffers[count].iov_base = const_cast<char*>(buffer.data()) + segment.offset;
+        buffers[count].iov_len = buffer.size() - segment.offset;
+#endif
+        count++;
+    }
+
+#ifdef _WIN32
+    (void)file_follows;
+    DWORD bytes_sent = 0;
+    if (WSASend(client_socket, buffers, static_cast<DWORD>(count), &bytes_sent, 0, NULL, NULL) == SOCKET_ERROR) {
+        return SOCKET_WOULD_BLOCK(SOCKET_LAST_ERROR) ? 0 : -1;
+    }
+    return bytes_sent;
+#else
+    msghdr message = {};
+    message.msg_iov = buffers;
+    message.msg_iovlen = count;
+    int flags = MSG_NOSIGNAL;
+#ifdef MSG_MORE
+    // The body follows with sendfile(); hold back a partial packet so the headers leave with it
+    if (file_follows) {
+        flags |= MSG_MORE;
+    }
+#else
+    (void)file_follows;
+#endif
+    ssize_t bytes_sent = sendmsg(client_socket, &message, flags);
+    if (bytes_sent < 0) {
+        return (SOCKET_WOULD_BLOCK(errno) || errno == EINTR) ? 0 : -1;
+    }
+    return bytes_sent;
+#endif
+}
+
+bool Connection::writePending() {
+    throttled = false;
+    while (hasPendingOutput()) {
+        if (frontSegment().file) {
+            OutputSegment& segment = frontSegment();
+            uint64_t staged = chunk_length - chunk_offset;
+            uint64_t claimed = claimBandwidth(std::min<uint64_t>(staged > 0 ? staged : segment.file_remaining,
+                                                                 sendfile_chunk_size));
+            if (claimed == 0) {
+                return true;  // throttled until resume_at
+            }
+            int64_t written = writeFileSegment(segment, claimed);
+            settleBandwidth(claimed, written > 0 ? static_cast<uint64_t>(written) : 0);
+            if (written < 0) {
+                return false;
+            }
+            if (written == 0) {
+                return true;  // socket would block, or the next chunk is being read
+            }
+            last_activity = std::chrono::steady_clock::now();
+            recordBytesSent(written);
+            if (segment.file_remaining == 0 && chunk_offset == chunk_length) {
+                chunk_offset = chunk_length = 0;
+                popSegment();
+            }
+            continue;
+        }
+
+        int64_t written = writeBufferedSegments();
+        if (written < 0) {
+            return false;
+        }
+        if (written == 0) {
+            return true;  // socket would block
+        }
+        last_activity = std::chrono::steady_clock::now();
+        recordBytesSent(written);
+
+        // Retire the segments the write covered; the last one may be partially sent
+        size_t remaining = static_cast<size_t>(written);
+        while (remaining > 0) {
+            OutputSegment& segment = frontSegment();
+            size_t unsent = segment.buffer().size() - segment.offset;
+            if (remaining < unsent) {
+                segment.offset += remaining;
+                break;
+            }
+            remaining -= unsent;
+            popSegment();
+        }
+    }
+    return true;
+}
@@ -0,0 +1,196 @@
+#pragma once
+
+#include "Net/FileBody.h"
+#include "Net/Bandwidth.h"
+#include "Http/RequestParser.h"
+#include "Utils/Metrics.h"
+#include "Utils/Trace.h"
+
+class DiskReader;
+class Poller;
+class Connection;
+
+// Response to a request that another thread produces, such as one that takes seconds to gather.
+// The handler takes one with Connection::defer() and hands it to that thread, which completes it;
+// the connection's loop then queues the response on its own thread.
+class DeferredResponse {
+public:
+    // Function to finish the response: respond runs on the connection's loop and queues the response
+    // as a request handler would, without the request, which is gone by then. Nothing happens if the
+    // connection has closed meanwhile.
+    void complete(std::function<void(Connection&)> respond);
+
+private:
+    friend class EventLoop;
+    friend class Connection;
+
+    std::mutex mutex;
+    std::function<void(Connection&)> respond;  // set once complete() is called
+    Poller* poller = nullptr;  // of the loop holding the connection, woken by complete(); null once it's gone
+};
+
+// One piece of a queued response: an owned buffer, a shared immutable buffer or a region of an open file
+struct OutputSegment {
+    std::string data;
+    std::shared_ptr<const std::string> shared_data;  // used instead of data when set
+    size_t offset = 0;  // bytes of data already sent
+
+    const std::string& buffer() const { return shared_data ? *shared_data : data; }
+
+    std::shared_ptr<FileBody> file;
+    uint64_t file_offset = 0;  // next byte of the file to send
+    uint64_t file_remaining = 0;
+};
+
+// Per-client state machine driven by the EventLoop that owns it
+class Connection {
+public:
+    enum class State {
+        ReadingRequest,   // waiting for a complete request in input
+        WritingResponse,  // flushing the queued response to the current request
+        Closing           // done, waiting to be torn down by the loop
+    };
+
+    Connection(socket_t socket, std::string client_ip);
+    ~Connection();
+
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    socket_t socket() const { return client_socket; }
+    const std::string& clientIp() const { return client_ip; }
+
+    State state = State::ReadingRequest;
+
+    // Request bytes received so far; may hold several pipelined requests
+    std::string input;
+
+    // The request currently being handled, parsed in place at the front of input
+    HttpRequest request;
+    RequestParser parser;
+    size_t request_length = 0;  // head plus body
+
+    // Whether the connection stays open after the current response.
+    // The loop sets it before calling the request handler; the handler may clear it.
+    bool keep_alive = true;
+    bool peer_closed = false;  // the client shut down its side; requests already buffered are still answered
+    unsigned requests_served = 0;
+    // What the Keep-Alive response header announces, from the settings the loop applied
+    int keep_alive_timeout = 0;
+    unsigned keep_alive_remaining = 0;
+
+    // Last time the socket made progress in either direction
+    std::chrono::steady_clock::time_point last_activity = std::chrono::steady_clock::now();
+    // When the first byte of the request in input arrived; bounds how long a client may take to send it
+    std::chrono::steady_clock::time_point request_begun;
+
+    // Set by the loop before calling the request handler while it is overloaded; new work is turned away
+    bool overloaded = false;
+
+    // Access log details for the response in flight; response_status is 0 when there is none
+    std::string log_method;
+    std::string log_target;
+    int response_status = 0;
+    Endpoint endpoint = Endpoint::NotFound;  // set by the handler for metrics
+    uint64_t response_bytes = 0;  // queued so far, headers included
+    std::chrono::steady_clock::time_point request_started;
+    RequestTrace trace;  // enabled by the loop while slow requests are traced
+
+    // Whether the loop is currently polling for writability instead of readability
+    bool polling_write = false;
+    // Whether the loop stopped polling the socket while a response waits for bandwidth or a file read
+    bool polling_paused = false;
+
+    // Set when writePending stopped because a bandwidth bucket ran dry; the loop resumes it at resume_at
+    bool throttled = false;
+    std::chrono::steady_clock::time_point resume_at;
+
+    // Set by defer(): the loop stops polling until the response is completed
+    std::shared_ptr<DeferredResponse> deferred;
+
+    // Function for a request handler to leave the response to another thread instead of queueing one
+    std::shared_ptr<DeferredResponse> defer();
+
+    // Queue response data behind everything queued before it. Buffers taken from bufferPool()
+    // go back to it once sent; the pointer-and-length form copies into one.
+    void send(std::string data);
+    void send(const char* data, size_t length);
+
+    // Queue a buffer shared with other connections (e.g. a cached response body) without copying it
+    void send(std::shared_ptr<const std::string> data);
+
+    // Queue length bytes of file starting at offset.
+    // Sent with sendfile() on Linux; elsewhere, or with a DiskReader, the bytes are staged through a
+    // user-space chunk.
+    void sendFile(std::shared_ptr<FileBody> file, uint64_t offset, uint64_t length);
+
+    // Shape the file bodies of the current response to bytes_per_second once burst_bytes have gone out.
+    // The client and global caps apply to file bodies regardless.
+    void paceFileBodies(uint64_t bytes_per_second, uint64_t burst_bytes);
+    void resetPacing() { stream_bucket = TokenBucket(); }
+
+    bool hasPendingOutput() const { return output_head < output.size(); }
+
+    // Hand the request and staging buffers back to the loop's pool while the connection is idle
+    void releaseIdleBuffers();
+
+    // Read file bodies through the loop's DiskReader instead of sendfile() or blocking reads.
+    // Set by the loop before anything is queued.
+    void useDiskReader(DiskReader* reader) { disk_reader = reader; }
+
+    // Whether writePending stopped to wait for a DiskReader read; the loop stops polling meanwhile
+    bool waitingForDisk() const { return waiting_for_disk; }
+
+    // Called by the DiskReader when the read for the front file segment finishes: buffer now
+    // holds bytes_read bytes, or is -1 when bytes_read is an error or an unexpected end of file
+    void fileChunkRead(int buffer, int64_t bytes_read);
+
+    // Append everything the socket has available to input.
+    // Returns false once the peer has closed or the socket failed.
+    bool readAvailable();
+
+    // Write queued output until it is drained or the socket would block.
+    // Consecutive buffers (e.g. headers and a cached body) go out in one gather write.
+    // Returns false if the socket failed.
+    bool writePending();
+
+private:
+    // Returns bytes written (at most max_bytes), 0 if the socket would block, -1 on error
+    int64_t writeFileSegment(OutputSegment& segment, uint64_t max_bytes);
+    int64_t writeBufferedSegments();
+    bool fillFileChunk(OutputSegment& segment);
+    int64_t writeDiskChunk(OutputSegment& segment, uint64_t max_bytes);
+
+    OutputSegment& frontSegment() { return output[output_head]; }
+    void popSegment();
+
+    // Bytes of file body the buckets allow right now, up to wanted; 0 sets throttled and resume_at
+    uint64_t claimBandwidth(uint64_t wanted);
+    // Account for a write made against a claim; unused bytes go back to the shared buckets
+    void settleBandwidth(uint64_t claimed, uint64_t sent);
+
+    socket_t client_socket;
+    std::string client_ip;
+
+    // Start-up settings, copied so the write path never looks them up
+    size_t buffer_size;
+    size_t sendfile_chunk_size;
+
+    // Queued segments from output_head on; the vector keeps its capacity from response to response
+    std::vector<OutputSegment> output;
+    size_t output_head = 0;
+
+    TokenBucket stream_bucket;  // unlimited unless the response is paced
+    std::shared_ptr<SharedTokenBucket> client_bucket;  // shared with other connections from this address
+
+    // Staging buffer for the file segment at the front of the queue (copying path only), from the pool
+    std::string file_chunk;
+    size_t chunk_offset = 0;
+    size_t chunk_length = 0;
+
+    // With a DiskReader, one of its buffers takes file_chunk's place while it holds unsent bytes
+    DiskReader* disk_reader = nullptr;
+    int chunk_buffer = -1;
+    bool waiting_for_disk = false;
+    bool disk_read_failed = false;
+};
@@ -0,0 +1,282 @@
+#include "pch.h"
+#include "Net/DiskReader.h"
+#include "Net/Connection.h"
+
+#ifdef SERVER_HAS_IO_URING
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+static std::atomic<uint64_t> read_count{0};
+static std::atomic<uint64_t> byte_count{0};
+static std::atomic<uint64_t> buffer_wait_count{0};
+
+DiskReader::Stats DiskReader::stats() {
+    return {read_count.load(std::memory_order_relaxed), byte_count.load(std::memory_order_relaxed),
+            buffer_wait_count.load(std::memory_order_relaxed)};
+}
+
+void DiskReader::read(Connection& conn, std::shared_ptr<FileBody> file, uint64_t offset, size_t length) {
+    if (free_buffers.empty()) {
+        buffer_wait_count.fetch_add(1, std::memory_order_relaxed);
+        waiting.push_back({&conn, std::move(file), offset, length});
+        return;
+    }
+    int index = free_buffers.back();
+    free_buffers.pop_back();
+    start(index, conn, std::move(file), offset, length);
+}
+
+void DiskReader::release(int index) {
+    if (waiting.empty()) {
+        free_buffers.push_back(index);
+        return;
+    }
+    WaitingRead next = std::move(waiting.front());
+    waiting.pop_front();
+    start(index, *next.conn, std::move(next.file), next.offset, next.length);
+}
+
+void DiskReader::forget(Connection& conn) {
+    for (Slot& slot : slots) {
+        if (slot.conn == &conn) {
+            slot.conn = nullptr;  // the buffer comes back when the read completes
+        }
+    }
+    for (auto it = waiting.begin(); it != waiting.end();) {
+        it = it->conn == &conn ? waiting.erase(it) : it + 1;
+    }
+}
+
+#ifdef SERVER_HAS_IO_URING
+
+static int ioUringSetup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int ioUringEnter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+static int ioUringRegister(int ring_fd, unsigned opcode, const void* arg, unsigned count) {
+    return static_cast<int>(syscall(__NR_io_uring_register, ring_fd, opcode, arg, count));
+}
+
+// The ring indices are shared with the kernel: read its side with acquire, publish ours with release
+static unsigned loadAcquire(unsigned* value) {
+    return std::atomic_ref<unsigned>(*value).load(std::memory_order_acquire);
+}
+
+static void storeRelease(unsigned* value, unsigned new_value) {
+    std::atomic_ref<unsigned>(*value).store(new_value, std::memory_order_release);
+}
+
+std::unique_ptr<DiskReader> DiskReader::create(unsigned buffer_count, size_t buffer_size, std::string& error) {
+    std::unique_ptr<DiskReader> reader(new DiskReader());
+
+    // One submission per buffer at most, and twice that many completion slots, so neither side can overflow
+    io_uring_params params = {};
+    reader->ring_fd = ioUringSetup(buffer_count, &params);
+    if (reader->ring_fd < 0) {
+        error = std::string("io_uring_setup: ") + strerror(errno);
+        return nullptr;
+    }
+
+    reader->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    reader->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        reader->sq_ring_size = reader->cq_ring_size = std::max(reader->sq_ring_size, reader->cq_ring_size);
+    }
+    void* sq_ring = mmap(nullptr, reader->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         reader->ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) {
+        error = std::string("mapping the submission ring: ") + strerror(errno);
+        return nullptr;
+    }
+    reader->sq_ring = sq_ring;
+    if (single_mmap) {
+        reader->cq_ring = sq_ring;
+    } else {
+        void* cq_ring = mmap(nullptr, reader->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             reader->ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED) {
+            error = std::string("mapping the completion ring: ") + strerror(errno);
+            return nullptr;
+        }
+        reader->cq_ring = cq_ring;
+    }
+    reader->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, reader->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      reader->ring_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        error = std::string("mapping the submission entries: ") + strerror(errno);
+        return nullptr;
+    }
+    reader->sqes = sqes;
+
+    char* sq = static_cast<char*>(reader->sq_ring);
+    reader->sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    reader->sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    reader->sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    reader->sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    char* cq = static_cast<char*>(reader->cq_ring);
+    reader->cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    reader->cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    reader->cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    reader->cqes = cq + params.cq_off.cqes;
+
+    reader->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (reader->event_fd < 0 || ioUringRegister(reader->ring_fd, IORING_REGISTER_EVENTFD, &reader->event_fd, 1) < 0) {
+        error = std::string("registering the eventfd: ") + strerror(errno);
+        return nullptr;
+    }
+
+    void* buffers = mmap(nullptr, static_cast<size_t>(buffer_count) * buffer_size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffers == MAP_FAILED) {
+        error = std::string("allocating read buffers: ") + strerror(errno);
+        return nullptr;
+    }
+    reader->buffers = static_cast<char*>(buffers);
+    reader->buffer_size = buffer_size;
+
+    // Registration pins the buffers and may exceed a small RLIMIT_MEMLOCK on older kernels;
+    // plain reads into the same memory still work then, just with the pinning done per read
+    std::vector<iovec> iovecs(buffer_count);
+    for (unsigned i = 0; i < buffer_count; ++i) {
+        iovecs[i].iov_base = reader->buffers + static_cast<size_t>(i) * buffer_size;
+        iovecs[i].iov_len = buffer_size;
+    }
+    reader->buffers_registered = ioUringRegister(reader->ring_fd, IORING_REGISTER_BUFFERS, iovecs.data(), buffer_count) == 0;
+
+    reader->slots.resize(buffer_count);
+    for (unsigned i = buffer_count; i-- > 0;) {
+        reader->free_buffers.push_back(static_cast<int>(i));
+    }
+    return reader;
+}
+
+DiskReader::~DiskReader() {
+    // The kernel may still be writing into the buffers; wait for it before unmapping them
+    while (ring_fd >= 0 && in_flight > 0) {
+        if (ioUringEnter(ring_fd, unsubmitted, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+            break;
+        }
+        unsubmitted = 0;
+        unsigned head = *cq_head;
+        unsigned tail = loadAcquire(cq_tail);
+        in_flight -= std::min(in_flight, tail - head);
+        storeRelease(cq_head, tail);
+    }
+
+    if (buffers) {
+        munmap(buffers, slots.size() * buffer_size);
+    }
+    if (sqes) {
+        munmap(sqes, sqes_size);
+    }
+    if (cq_ring && cq_ring != sq_ring) {
+        munmap(cq_ring, cq_ring_size);
+    }
+    if (sq_ring) {
+        munmap(sq_ring, sq_ring_size);
+    }
+    if (event_fd >= 0) {
+        close(event_fd);
+    }
+    if (ring_fd >= 0) {
+        close(ring_fd);
+    }
+}
+
+void DiskReader::start(int index, Connection& conn, std::shared_ptr<FileBody> file, uint64_t offset, size_t length) {
+    unsigned tail = *sq_tail;
+    unsigned position = tail & *sq_mask;
+    io_uring_sqe& sqe = static_cast<io_uring_sqe*>(sqes)[position];
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = buffers_registered ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe.fd = file->nativeHandle();
+    sqe.off = offset;
+    sqe.addr = reinterpret_cast<uint64_t>(buffers + static_cast<size_t>(index) * buffer_size);
+    sqe.len = static_cast<uint32_t>(std::min(length, buffer_size));
+    sqe.buf_index = static_cast<uint16_t>(index);
+    sqe.user_data = static_cast<uint64_t>(index);
+    sq_array[position] = position;
+    storeRelease(sq_tail, tail + 1);
+
+    slots[index].conn = &conn;
+    slots[index].file = std::move(file);
+    unsubmitted++;
+    in_flight++;
+}
+
+void DiskReader::submit() {
+    while (unsubmitted > 0) {
+        int submitted = ioUringEnter(ring_fd, unsubmitted, 0, 0);
+        if (submitted < 0) {
+            // EINTR, or EAGAIN/EBUSY while the kernel is short of memory or completions: retry next iteration
+            return;
+        }
+        unsubmitted -= std::min<unsigned>(unsubmitted, static_cast<unsigned>(submitted));
+        if (submitted == 0) {
+            return;
+        }
+    }
+}
+
+void DiskReader::complete(std::vector<Connection*>& ready) {
+    uint64_t signalled;
+    while (::read(event_fd, &signalled, sizeof(signalled)) > 0) {
+    }
+
+    unsigned head = *cq_head;
+    unsigned tail = loadAcquire(cq_tail);
+    unsigned mask = *cq_mask;
+    for (; head != tail; ++head) {
+        const io_uring_cqe& cqe = static_cast<const io_uring_cqe*>(cqes)[head & mask];
+        int index = static_cast<int>(cqe.user_data);
+        int result = cqe.res;
+        in_flight--;
+
+        Slot& slot = slots[index];
+        Connection* conn = slot.conn;
+        slot.conn = nullptr;
+        slot.file.reset();
+        if (result > 0) {
+            read_count.fetch_add(1, std::memory_order_relaxed);
+            byte_count.fetch_add(static_cast<uint64_t>(result), std::memory_order_relaxed);
+        }
+        if (!conn || result <= 0) {
+            release(index);
+        }
+        if (conn) {
+            conn->fileChunkRead(result > 0 ? index : -1, result);
+            ready.push_back(conn);
+        }
+    }
+    storeRelease(cq_head, head);
+}
+
+#else
+
+std::unique_ptr<DiskReader> DiskReader::create(unsigned, size_t, std::string& error) {
+    error = "built without io_uring support";
+    return nullptr;
+}
+
+DiskReader::~DiskReader() = default;
+
+void DiskReader::start(int, Connection&, std::shared_ptr<FileBody>, uint64_t, size_t) {
+}
+
+void DiskReader::submit() {
+}
+
+void DiskReader::complete(std::vector<Connection*>&) {
+}
+
+#endif
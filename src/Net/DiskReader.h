@@ -0,0 +1,99 @@
+#pragma once
+
+#include "Net/FileBody.h"
+
+class Connection;
+
+// Asynchronous file reads for one event loop, on io_uring (Linux).
+// Reads queued during an iteration of the loop go to the kernel together in one system call and
+// complete in the background, signalling an eventfd the loop polls. A read that has to wait for the
+// disk therefore holds up only the connection that asked for it, where sendfile() or pread() would
+// stall the whole loop. Each read fills one of a fixed set of buffers registered with the kernel up
+// front (sparing it pinning the pages on every read); the connection keeps the buffer until it has
+// sent the bytes, and a read waits when every buffer is taken.
+// Used only from the loop's own thread.
+class DiskReader {
+public:
+    // Returns nullptr, with the reason in error, where io_uring can't be used: not built in, a
+    // kernel without it, or a sandbox that blocks it
+    static std::unique_ptr<DiskReader> create(unsigned buffer_count, size_t buffer_size, std::string& error);
+
+    ~DiskReader();
+
+    DiskReader(const DiskReader&) = delete;
+    DiskReader& operator=(const DiskReader&) = delete;
+
+    // Becomes readable whenever reads have completed
+    int eventFd() const { return event_fd; }
+
+    size_t bufferSize() const { return buffer_size; }
+    const char* buffer(int index) const { return buffers + static_cast<size_t>(index) * buffer_size; }
+
+    // Queue a read of up to bufferSize() bytes of file at offset for conn. The outcome is delivered
+    // to Connection::fileChunkRead() by complete().
+    void read(Connection& conn, std::shared_ptr<FileBody> file, uint64_t offset, size_t length);
+
+    // Give back a buffer whose bytes have been sent
+    void release(int index);
+
+    // Drop every reference to conn, which is going away; a read in flight for it is discarded
+    void forget(Connection& conn);
+
+    // Hand the reads queued since the last call to the kernel
+    void submit();
+
+    // Deliver finished reads, appending the connections that got one to ready
+    void complete(std::vector<Connection*>& ready);
+
+    // Process-wide totals across all loops' readers
+    struct Stats {
+        uint64_t reads;
+        uint64_t bytes;
+        uint64_t buffer_waits;  // reads that had to wait for a free buffer
+    };
+    static Stats stats();
+
+private:
+    DiskReader() = default;
+
+    struct Slot {
+        Connection* conn = nullptr;      // nullptr once forgotten
+        std::shared_ptr<FileBody> file;  // held open until the kernel is done with the read
+    };
+    struct WaitingRead {
+        Connection* conn;
+        std::shared_ptr<FileBody> file;
+        uint64_t offset;
+        size_t length;
+    };
+
+    void start(int index, Connection& conn, std::shared_ptr<FileBody> file, uint64_t offset, size_t length);
+
+    int ring_fd = -1;
+    int event_fd = -1;
+    char* buffers = nullptr;  // buffer_count * buffer_size bytes
+    size_t buffer_size = 0;
+    bool buffers_registered = false;
+
+    // Ring memory shared with the kernel
+    void* sq_ring = nullptr;
+    size_t sq_ring_size = 0;
+    void* cq_ring = nullptr;
+    size_t cq_ring_size = 0;
+    void* sqes = nullptr;
+    size_t sqes_size = 0;
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_mask = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned* cq_mask = nullptr;
+    void* cqes = nullptr;
+
+    std::vector<Slot> slots;  // one per buffer
+    std::vector<int> free_buffers;
+    std::deque<WaitingRead> waiting;
+    unsigned unsubmitted = 0;
+    unsigned in_flight = 0;
+};
@@ -0,0 +1,730 @@
+#include "pch.h"
+#include "ServerConfig.h"
+#include "Net/EventLoop.h"
+#include "Net/Admission.h"
+#include "Utils/Logger.h"
+#include "Utils/Arena.h"
+
+#include "Net/Listener.h"
+
+#ifndef _WIN32
+#include <netinet/tcp.h>
+#endif
+#ifdef __linux__
+#include <sched.h>
+#include <pthread.h>
+#endif
+
+// Timeout for Poller::wait so idle connections are swept even when nothing happens
+static constexpr int IDLE_SWEEP_INTERVAL_MS = 1000;
+
+// Connections accepted per listener wakeup before the loop gets back to the ones it already has
+static constexpr int ACCEPT_BATCH = 64;
+
+// Canned replies for requests the parser rejects; the connection is closed after sending them
+static const char BAD_REQUEST_RESPONSE[] =
+    "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+static const char HEAD_TOO_LARGE_RESPONSE[] =
+    "HTTP/1.1 431 Request Header Fields Too Large\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+// Sent when a client takes longer than request_header_timeout_seconds to send its request
+static const char REQUEST_TIMEOUT_RESPONSE[] =
+    "HTTP/1.1 408 Request Timeout\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+// Weight of the latest wakeup in the loop's smoothed time per wakeup (shed_loop_lag_ms)
+static constexpr double LOOP_LAG_SMOOTHING = 0.2;
+
+EventLoop::EventLoop(int index, RequestHandler handler)
+    : loop_index(index), request_handler(std::move(handler)) {
+}
+
+EventLoop::~EventLoop() {
+    stop();
+    if (listen_socket != INVALID_SOCKET) {
+        CLOSE_SOCKET(listen_socket);
+    }
+}
+
+void EventLoop::start() {
+    running = true;
+    thread = std::thread(&EventLoop::run, this);
+}
+
+void EventLoop::stop() {
+    // A draining loop is left to finish by its deadline
+    if (!drain_requested.load(std::memory_order_acquire)) {
+        if (!running.exchange(false)) {
+            return;
+        }
+        poller.wakeup();
+    }
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void EventLoop::drain(std::chrono::steady_clock::time_point deadline) {
+    drain_deadline = deadline;
+    drain_requested.store(true, std::memory_order_release);
+    poller.wakeup();
+}
+
+void EventLoop::addConnection(socket_t socket, std::string client_ip) {
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        pending_connections.emplace_back(socket, std::move(client_ip));
+    }
+    poller.wakeup();
+}
+
+void EventLoop::listenOn(socket_t listener) {
+    listen_socket = listener;
+    setSocketNonBlocking(listen_socket);
+    poller.add(listen_socket, true, false);
+}
+
+void EventLoop::pinToCpu(int cpu) {
+    pinned_cpu = cpu;
+}
+
+#ifdef __linux__
+// Function to pin the calling thread to the n-th CPU (wrapping around) the process may run on
+static bool pinCurrentThread(int n) {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0) {
+        return false;
+    }
+    int remaining = n % CPU_COUNT(&allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &allowed) && remaining-- == 0) {
+            cpu_set_t one;
+            CPU_ZERO(&one);
+            CPU_SET(cpu, &one);
+            return pthread_setaffinity_np(pthread_self(), sizeof(one), &one) == 0;
+        }
+    }
+    return false;
+}
+#else
+static bool pinCurrentThread(int) {
+    return false;
+}
+#endif
+
+void EventLoop::adoptConnection(socket_t socket, std::string client_ip, const ServerConfig& config) {
+    if (!admitConnection(client_ip, config.max_connections, config.max_connections_per_ip)) {
+        // Best effort: the socket is fresh, so a reply this small fits its send buffer
+        char response[128];
+        int length = snprintf(response, sizeof(response),
+                              "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nRetry-After: %u\r\n"
+                              "Connection: close\r\n\r\n", config.retry_after_seconds);
+        ::send(socket, response, length, MSG_NOSIGNAL);
+        CLOSE_SOCKET(socket);
+        recordConnectionRejected();
+        logMessage(LogLevel::Debug, "Client rejected over the connection limit: %s", client_ip.c_str());
+        return;
+    }
+
+    // Responses are coalesced into whole writes already, so Nagle would only add delayed-ACK stalls
+    int nodelay = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&nodelay), sizeof(nodelay));
+    if (config.socket_send_buffer > 0) {
+        setsockopt(socket, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&config.socket_send_buffer),
+                   sizeof(config.socket_send_buffer));
+    }
+
+    std::pmr::polymorphic_allocator<> allocator(&connection_memory);
+    std::unique_ptr<Connection, ConnectionDeleter> conn(allocator.new_object<Connection>(socket, std::move(client_ip)),
+                                                        ConnectionDeleter{&connection_memory});
+    if (disk_reader) {
+        conn->useDiskReader(disk_reader.get());
+    }
+    connections[socket] = std::move(conn);
+    recordConnectionOpened();
+    poller.add(socket, true, false);
+}
+
+void EventLoop::adoptPendingConnections() {
+    std::vector<std::pair<socket_t, std::string>> adopted;
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        adopted.swap(pending_connections);
+    }
+    if (adopted.empty()) {
+        return;
+    }
+
+    std::shared_ptr<const ServerConfig> config = currentConfig();
+    for (auto& pending : adopted) {
+        socket_t socket = pending.first;
+        if (!setSocketNonBlocking(socket)) {
+            logMessage(LogLevel::Error, "Failed to make client socket non-blocking");
+            CLOSE_SOCKET(socket);
+            continue;
+        }
+        adoptConnection(socket, std::move(pending.second), *config);
+    }
+}
+
+void EventLoop::acceptConnections() {
+    std::shared_ptr<const ServerConfig> config = currentConfig();
+    std::string client_ip;
+    for (int i = 0; i < ACCEPT_BATCH; ++i) {
+        bool would_block;
+        socket_t socket = acceptClient(listen_socket, true, client_ip, would_block);
+        if (socket == INVALID_SOCKET) {
+            if (!would_block) {
+                // Typically out of descriptors; the connection stays queued and is retried next wakeup
+                logMessage(LogLevel::Warning, "Failed to accept client connection");
+            }
+            return;
+        }
+        logMessage(LogLevel::Debug, "Client connected: %s", client_ip.c_str());
+        adoptConnection(socket, client_ip, *config);
+    }
+}
+
+void EventLoop::run() {
+    if (pinned_cpu >= 0 && !pinCurrentThread(pinned_cpu)) {
+        logMessage(LogLevel::Warning, "Could not pin event loop %d to a CPU", loop_index);
+    }
+
+    std::shared_ptr<const ServerConfig> config = currentConfig();
+    trace_requests = config->slow_request_ms > 0;
+    slow_request_threshold = std::chrono::milliseconds(config->slow_request_ms);
+    shed_queue_depth = config->shed_queue_depth;
+    shed_loop_lag = std::chrono::milliseconds(config->shed_loop_lag_ms);
+    if (config->io_uring_file_reads) {
+        std::string error;
+        disk_reader = DiskReader::create(config->io_uring_buffer_count, config->io_uring_buffer_size, error);
+        if (disk_reader) {
+            poller.add(disk_reader->eventFd(), true, false);
+        } else {
+            logMessage(LogLevel::Warning, "Event loop %d can't read files through io_uring, using sendfile(): %s",
+                       loop_index, error.c_str());
+        }
+    }
+    config.reset();
+
+    std::vector<PollEvent> events;
+
+    while (running) {
+        if (disk_reader) {
+            disk_reader->submit();  // every read queued since the last wait, in one system call
+        }
+        poller.wait(events, nextWaitTimeout());
+        auto woken = std::chrono::steady_clock::now();
+        shedding = (shed_queue_depth > 0 && events.size() > shed_queue_depth) ||
+                   (shed_loop_lag.count() > 0 && loop_lag > shed_loop_lag);
+        if (!draining && drain_requested.load(std::memory_order_acquire)) {
+            beginDrain();
+        }
+        adoptPendingConnections();
+
+        for (const PollEvent& event : events) {
+            if (event.socket == listen_socket) {
+                acceptConnections();
+                continue;
+            }
+            if (disk_reader && event.socket == disk_reader->eventFd()) {
+                completeDiskReads();
+                continue;
+            }
+            auto it = connections.find(event.socket);
+            if (it == connections.end()) {
+                continue;
+            }
+            Connection& conn = *it->second;
+
+            if (event.readable || event.error) {
+                onReadable(conn);
+            }
+            if (conn.state != Connection::State::Closing && event.writable) {
+                onWritable(conn);
+            }
+            if (conn.state == Connection::State::Closing) {
+                closeConnection(event.socket);
+            }
+        }
+
+        resumeThrottledConnections();
+        completeDeferredResponses();
+
+        auto now = std::chrono::steady_clock::now();
+        loop_lag += std::chrono::duration_cast<std::chrono::steady_clock::duration>((now - woken - loop_lag) * LOOP_LAG_SMOOTHING);
+        if (now - last_idle_sweep >= std::chrono::milliseconds(IDLE_SWEEP_INTERVAL_MS)) {
+            last_idle_sweep = now;
+            closeIdleConnections();
+        }
+
+        if (draining && (connections.empty() || now >= drain_deadline)) {
+            if (!connections.empty()) {
+                logMessage(LogLevel::Warning, "Event loop %d cut %zu connections short at the drain deadline",
+                           loop_index, connections.size());
+            }
+            break;
+        }
+    }
+
+    // Tear down whatever is still open when the loop is stopped
+    for (auto& entry : connections) {
+        poller.remove(entry.first);
+        releaseConnection(entry.second->clientIp());
+        recordConnectionClosed();
+    }
+    connections.clear();
+    if (disk_reader) {
+        poller.remove(disk_reader->eventFd());
+        disk_reader.reset();
+    }
+}
+
+// Resume the connections whose file reads have finished
+void EventLoop::completeDiskReads() {
+    disk_ready.clear();
+    disk_reader->complete(disk_ready);
+    for (Connection* conn : disk_ready) {
+        socket_t socket = conn->socket();
+        onWritable(*conn);
+        if (conn->state == Connection::State::Closing) {
+            closeConnection(socket);
+        }
+    }
+}
+
+void EventLoop::onReadable(Connection& conn) {
+    if (conn.state != Connection::State::ReadingRequest) {
+        // Reads aren't polled while a response is in flight, so this is a hang-up or socket error
+        conn.state = Connection::State::Closing;
+        return;
+    }
+
+    if (!conn.readAvailable()) {
+        conn.state = Connection::State::Closing;
+        return;
+    }
+
+    processRequests(conn);
+}
+
+void EventLoop::onWritable(Connection& conn) {
+    if (flushResponse(conn)) {
+        // Response finished; serve any requests that were pipelined behind it
+        processRequests(conn);
+    }
+}
+
+void EventLoop::processRequests(Connection& conn) {
+    // Buffered requests are served strictly one after another: the next one is only handled
+    // once the previous response is fully written, which keeps responses in order and bounds output
+    while (conn.state == Connection::State::ReadingRequest) {
+        auto parse_started = trace_requests ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+        RequestParser::Result result = conn.parser.parse(conn.input, conn.request);
+        if (trace_requests) {
+            conn.trace.add(TraceSpan::Parse, std::chrono::steady_clock::now() - parse_started);
+        }
+        if (result == RequestParser::Result::Incomplete) {
+            if (conn.peer_closed) {
+                // Nothing more is coming to complete it
+                conn.state = Connection::State::Closing;
+                return;
+            }
+            if (conn.input.empty()) {
+                conn.releaseIdleBuffers();
+            }
+            setWriteInterest(conn, false);
+            return;
+        }
+        if (result != RequestParser::Result::Complete) {
+            bool invalid = result == RequestParser::Result::Invalid;
+            conn.log_method.clear();
+            conn.log_target.clear();
+            conn.response_status = invalid ? 400 : 431;
+            conn.endpoint = Endpoint::BadRequest;
+            conn.response_bytes = 0;
+            conn.request_started = std::chrono::steady_clock::now();
+            conn.send(invalid ? BAD_REQUEST_RESPONSE : HEAD_TOO_LARGE_RESPONSE);
+            conn.keep_alive = false;
+            conn.state = Connection::State::WritingResponse;
+            flushResponse(conn);
+            return;
+        }
+
+        // No route accepts a body. Skip a small Content-Length body; anything we can't frame
+        // (chunked, or larger than the buffer) is answered and then the connection is closed.
+        std::shared_ptr<const ServerConfig> config = currentConfig();
+        bool must_close = false;
+        size_t length = conn.request.head_length;
+        if (conn.request.chunked || conn.request.content_length > config->buffer_size - length) {
+            must_close = true;
+        } else if (conn.request.content_length > 0) {
+            if (conn.input.size() < length + conn.request.content_length) {
+                if (conn.peer_closed) {
+                    conn.state = Connection::State::Closing;
+                    return;
+                }
+                setWriteInterest(conn, false);
+                return;
+            }
+            length += static_cast<size_t>(conn.request.content_length);
+        }
+
+        conn.request_length = length;
+        // A client that has shut down its side gets the requests it sent answered, then the connection closes
+        bool last_from_peer = conn.peer_closed && conn.input.size() == length;
+        conn.keep_alive = !must_close && !draining && !last_from_peer &&
+                          conn.requests_served + 1 < config->max_keepalive_requests;
+        conn.requests_served++;
+        conn.keep_alive_timeout = config->keepalive_timeout_seconds;
+        conn.keep_alive_remaining = conn.keep_alive ? config->max_keepalive_requests - conn.requests_served : 0;
+
+        // Copied because the request views die with the input once it's consumed; assign() reuses capacity
+        conn.log_method.assign(conn.request.method);
+        conn.log_target.assign(conn.request.target);
+        conn.response_status = 0;
+        conn.response_bytes = 0;
+        conn.endpoint = Endpoint::NotFound;
+        conn.resetPacing();
+        conn.trace.enabled = trace_requests;
+        conn.overloaded = shedding;
+        conn.request_started = std::chrono::steady_clock::now();
+
+        try {
+            request_handler(conn);
+            auto handled = std::chrono::steady_clock::now();
+            recordHandlerTime(conn.endpoint, handled - conn.request_started);
+            if (conn.trace.enabled) {
+                conn.trace.add(TraceSpan::Handler, handled - conn.request_started);
+                conn.trace.handler_done = handled;
+            }
+        }
+        catch (const std::exception& e) {
+            logMessage(LogLevel::Error, "Error handling request: %s", e.what());
+            requestArena().reset();
+            conn.state = Connection::State::Closing;
+            return;
+        }
+        // Whatever the handler built for itself is dead now; its response lives on the connection
+        requestArena().reset();
+
+        conn.input.erase(0, length);
+        conn.request_length = 0;
+        if (!conn.input.empty()) {
+            // A pipelined request: its header timeout runs from when it is first looked at
+            conn.request_begun = std::chrono::steady_clock::now();
+        }
+        conn.parser.reset();
+        conn.state = Connection::State::WritingResponse;
+
+        if (conn.deferred) {
+            parkDeferred(conn);
+            return;
+        }
+        if (!flushResponse(conn)) {
+            return;
+        }
+    }
+}
+
+// Write out the current response. Returns true once it is complete and the connection
+// is ready for its next request.
+bool EventLoop::flushResponse(Connection& conn) {
+    if (!conn.writePending()) {
+        responseFinished(conn, false);
+        conn.state = Connection::State::Closing;
+        return false;
+    }
+
+    if (conn.hasPendingOutput()) {
+        if (conn.throttled) {
+            // Out of bandwidth: stop polling until the buckets have refilled
+            pausePolling(conn);
+            throttled_connections.push_back(conn.socket());
+        } else if (conn.waitingForDisk()) {
+            // Nothing to send until the read completes
+            pausePolling(conn);
+        } else {
+            setWriteInterest(conn, true);
+        }
+        return false;
+    }
+    responseFinished(conn, true);
+
+    if (!conn.keep_alive) {
+        conn.state = Connection::State::Closing;
+        return false;
+    }
+
+    conn.state = Connection::State::ReadingRequest;
+    return true;
+}
+
+// Access log record and metrics for the response in flight, once it completes or is abandoned
+void EventLoop::responseFinished(Connection& conn, bool completed) {
+    if (conn.response_status == 0) {
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    auto duration = now - conn.request_started;
+    recordResponse(conn.endpoint, conn.response_status, duration, completed);
+    logAccess(conn.clientIp(), conn.log_method, conn.log_target, conn.response_status, conn.response_bytes,
+              std::chrono::duration_cast<std::chrono::microseconds>(duration).count(), completed);
+    if (conn.trace.enabled) {
+        conn.trace.add(TraceSpan::Send, now - conn.trace.handler_done);
+        if (conn.trace[TraceSpan::Parse] + conn.trace[TraceSpan::Handler] >= slow_request_threshold) {
+            recordSlowRequest(conn.clientIp(), conn.log_method, conn.log_target, conn.response_status, conn.endpoint,
+                              conn.trace);
+        }
+    }
+    conn.trace.reset(false);
+    conn.response_status = 0;
+}
+
+void EventLoop::setWriteInterest(Connection& conn, bool want_write) {
+    if (conn.polling_write != want_write || conn.polling_paused) {
+        conn.polling_write = want_write;
+        conn.polling_paused = false;
+        poller.modify(conn.socket(), !want_write, want_write);
+    }
+}
+
+void EventLoop::pausePolling(Connection& conn) {
+    if (!conn.polling_paused) {
+        // Errors and hang-ups are still reported
+        conn.polling_paused = true;
+        poller.modify(conn.socket(), false, false);
+    }
+}
+
+void EventLoop::resumeThrottledConnections() {
+    if (throttled_connections.empty()) {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    std::vector<socket_t> due;
+    for (size_t i = 0; i < throttled_connections.size();) {
+        auto it = connections.find(throttled_connections[i]);
+        if (it == connections.end() || !it->second->throttled) {
+            // Closed meanwhile (the socket may even belong to a new connection by now)
+            throttled_connections[i] = throttled_connections.back();
+            throttled_connections.pop_back();
+        } else if (it->second->resume_at <= now) {
+            due.push_back(throttled_connections[i]);
+            throttled_connections[i] = throttled_connections.back();
+            throttled_connections.pop_back();
+        } else {
+            ++i;
+        }
+    }
+
+    for (socket_t socket : due) {
+        Connection& conn = *connections[socket];
+        conn.throttled = false;
+        onWritable(conn);
+        if (conn.state == Connection::State::Closing) {
+            closeConnection(socket);
+        }
+    }
+}
+
+// Stop polling a connection whose handler deferred its response until another thread completes it
+void EventLoop::parkDeferred(Connection& conn) {
+    pausePolling(conn);
+    deferred_connections.emplace_back(conn.socket(), conn.deferred.get());
+    std::lock_guard<std::mutex> lock(conn.deferred->mutex);
+    conn.deferred->poller = &poller;
+    if (conn.deferred->respond) {
+        poller.wakeup();  // completed already
+    }
+}
+
+// Queue the deferred responses that have been completed and write them out
+void EventLoop::completeDeferredResponses() {
+    if (deferred_connections.empty()) {
+        return;
+    }
+
+    std::vector<std::pair<socket_t, std::function<void(Connection&)>>> due;
+    for (size_t i = 0; i < deferred_connections.size();) {
+        auto it = connections.find(deferred_connections[i].first);
+        if (it == connections.end() || it->second->deferred.get() != deferred_connections[i].second) {
+            // Closed meanwhile (the socket may even belong to a new connection by now)
+            deferred_connections[i] = deferred_connections.back();
+            deferred_connections.pop_back();
+            continue;
+        }
+        DeferredResponse& deferred = *it->second->deferred;
+        std::function<void(Connection&)> respond;
+        {
+            std::lock_guard<std::mutex> lock(deferred.mutex);
+            respond.swap(deferred.respond);
+            if (respond) {
+                deferred.poller = nullptr;
+            }
+        }
+        if (!respond) {
+            ++i;
+            continue;
+        }
+        due.emplace_back(deferred_connections[i].first, std::move(respond));
+        deferred_connections[i] = deferred_connections.back();
+        deferred_connections.pop_back();
+    }
+
+    for (auto& [socket, respond] : due) {
+        Connection& conn = *connections[socket];
+        conn.deferred.reset();
+        try {
+            respond(conn);
+        }
+        catch (const std::exception& e) {
+            logMessage(LogLevel::Error, "Error completing deferred response: %s", e.what());
+            conn.state = Connection::State::Closing;
+        }
+        requestArena().reset();
+        if (conn.state != Connection::State::Closing) {
+            onWritable(conn);
+        }
+        if (conn.state == Connection::State::Closing) {
+            closeConnection(socket);
+        }
+    }
+}
+
+// Poll timeout: the idle sweep interval, or sooner if a throttled connection or the drain deadline is due
+int EventLoop::nextWaitTimeout() const {
+    int timeout_ms = IDLE_SWEEP_INTERVAL_MS;
+    auto now = std::chrono::steady_clock::now();
+    if (draining) {
+        auto wait = std::chrono::ceil<std::chrono::milliseconds>(drain_deadline - now).count();
+        timeout_ms = static_cast<int>(std::clamp<int64_t>(wait, 0, timeout_ms));
+    }
+    if (throttled_connections.empty()) {
+        return timeout_ms;
+    }
+
+    for (socket_t socket : throttled_connections) {
+        auto it = connections.find(socket);
+        if (it == connections.end()) {
+            continue;
+        }
+        auto wait = std::chrono::ceil<std::chrono::milliseconds>(it->second->resume_at - now).count();
+        timeout_ms = static_cast<int>(std::clamp<int64_t>(wait, 0, timeout_ms));
+    }
+    return timeout_ms;
+}
+
+// Close the connections that sat idle between requests past keepalive_timeout_seconds, that are
+// trickling in a request slower than request_header_timeout_seconds allows, or whose client has
+// stopped reading a response for send_timeout_seconds
+void EventLoop::closeIdleConnections() {
+    std::shared_ptr<const ServerConfig> config = currentConfig();
+    auto now = std::chrono::steady_clock::now();
+    auto idle_deadline = now - std::chrono::seconds(config->keepalive_timeout_seconds);
+    auto header_deadline = now - std::chrono::seconds(config->request_header_timeout_seconds);
+    auto send_deadline = now - std::chrono::seconds(config->send_timeout_seconds);
+    trace_requests = config->slow_request_ms > 0;
+    slow_request_threshold = std::chrono::milliseconds(config->slow_request_ms);
+    shed_queue_depth = config->shed_queue_depth;
+    shed_loop_lag = std::chrono::milliseconds(config->shed_loop_lag_ms);
+
+    std::vector<socket_t> idle;
+    std::vector<socket_t> timed_out;
+    for (const auto& entry : connections) {
+        const Connection& conn = *entry.second;
+        if (conn.state == Connection::State::ReadingRequest) {
+            if (conn.input.empty() ? conn.last_activity < idle_deadline : conn.request_begun < header_deadline) {
+                (conn.input.empty() ? idle : timed_out).push_back(entry.first);
+            }
+        } else if (conn.state == Connection::State::WritingResponse && !conn.deferred && !conn.throttled &&
+                   !conn.waitingForDisk() && conn.last_activity < send_deadline) {
+            timed_out.push_back(entry.first);
+        }
+    }
+
+    for (socket_t socket : idle) {
+        closeConnection(socket);
+    }
+    for (socket_t socket : timed_out) {
+        Connection& conn = *connections[socket];
+        if (conn.state == Connection::State::ReadingRequest) {
+            // Best effort, like the other canned replies; a client this slow may never read it
+            ::send(socket, REQUEST_TIMEOUT_RESPONSE, sizeof(REQUEST_TIMEOUT_RESPONSE) - 1, MSG_NOSIGNAL);
+        }
+        logMessage(LogLevel::Debug, "Client timed out: %s", conn.clientIp().c_str());
+        recordConnectionTimedOut();
+        closeConnection(socket);
+    }
+}
+
+// Stop accepting, and close the connections that are between requests: a client whose request is
+// already on its way sees the close and retries on a new connection. The rest are closed as their
+// responses finish, since processRequests() keeps none alive while draining.
+void EventLoop::beginDrain() {
+    draining = true;
+    if (listen_socket != INVALID_SOCKET) {
+        poller.remove(listen_socket);
+        CLOSE_SOCKET(listen_socket);
+        listen_socket = INVALID_SOCKET;
+    }
+
+    std::vector<socket_t> idle;
+    for (const auto& entry : connections) {
+        const Connection& conn = *entry.second;
+        if (conn.state == Connection::State::ReadingRequest && conn.input.empty()) {
+            idle.push_back(entry.first);
+        }
+    }
+    for (socket_t socket : idle) {
+        closeConnection(socket);
+    }
+}
+
+void EventLoop::closeConnection(socket_t socket) {
+    auto it = connections.find(socket);
+    if (it != connections.end()) {
+        // A response still in flight was cut short by the client
+        responseFinished(*it->second, false);
+        releaseConnection(it->second->clientIp());
+        recordConnectionClosed();
+    }
+    poller.remove(socket);
+    connections.erase(socket);
+}
+
+EventLoopPool::EventLoopPool(unsigned worker_count, RequestHandler handler) {
+    if (worker_count == 0) {
+        worker_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (unsigned i = 0; i < worker_count; ++i) {
+        loops.push_back(std::make_unique<EventLoop>(static_cast<int>(i), handler));
+    }
+}
+
+EventLoopPool::~EventLoopPool() {
+    stop();
+}
+
+void EventLoopPool::start() {
+    for (auto& loop : loops) {
+        loop->start();
+    }
+}
+
+void EventLoopPool::stop() {
+    for (auto& loop : loops) {
+        loop->stop();
+    }
+}
+
+void EventLoopPool::drain(std::chrono::steady_clock::time_point deadline) {
+    for (auto& loop : loops) {
+        loop->drain(deadline);
+    }
+}
+
+void EventLoopPool::dispatch(socket_t socket, std::string client_ip) {
+    size_t index = next_loop.fetch_add(1, std::memory_order_relaxed) % loops.size();
+    loops[index]->addConnection(socket, std::move(client_ip));
+}
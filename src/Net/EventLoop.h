@@ -0,0 +1,140 @@
+#pragma once
+
+#include "Net/Poller.h"
+#include "Net/Connection.h"
+#include "Net/DiskReader.h"
+
+#include <memory_resource>
+
+struct ServerConfig;
+
+// Called once a complete request is available as Connection::request().
+// The handler queues its response on the connection and must not block on the socket.
+using RequestHandler = std::function<void(Connection&)>;
+
+// Single-threaded event loop that owns a set of non-blocking connections
+class EventLoop {
+public:
+    EventLoop(int index, RequestHandler handler);
+    ~EventLoop();
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    void start();
+    void stop();
+
+    // Function to stop accepting and let the open connections finish: idle ones are closed, responses
+    // in flight run to completion, and none is kept alive after its current response. The loop's
+    // thread exits once the last connection is gone or at deadline, whichever is first; stop() then
+    // waits for that instead of cutting the connections off. Safe to call from any thread.
+    void drain(std::chrono::steady_clock::time_point deadline);
+
+    // Hand an accepted socket over to this loop; safe to call from any thread
+    void addConnection(socket_t socket, std::string client_ip);
+
+    // Accept connections from listener on this loop's own thread instead of having them handed
+    // over; the loop takes ownership of the socket. Call before start().
+    void listenOn(socket_t listener);
+
+    // Run the loop's thread on one CPU: the cpu-th (wrapping around) of those the process may use.
+    // Call before start(); ignored where threads can't be pinned.
+    void pinToCpu(int cpu);
+
+    int index() const { return loop_index; }
+
+private:
+    void run();
+    void adoptPendingConnections();
+    void adoptConnection(socket_t socket, std::string client_ip, const ServerConfig& config);
+    void acceptConnections();
+    void completeDiskReads();
+    void onReadable(Connection& conn);
+    void onWritable(Connection& conn);
+    void processRequests(Connection& conn);
+    bool flushResponse(Connection& conn);
+    void responseFinished(Connection& conn, bool completed);
+    void setWriteInterest(Connection& conn, bool want_write);
+    void pausePolling(Connection& conn);
+    void resumeThrottledConnections();
+    void parkDeferred(Connection& conn);
+    void completeDeferredResponses();
+    int nextWaitTimeout() const;
+    void closeIdleConnections();
+    void closeConnection(socket_t socket);
+    void beginDrain();
+
+    int loop_index;
+    RequestHandler request_handler;
+    socket_t listen_socket = INVALID_SOCKET;
+    int pinned_cpu = -1;
+    Poller poller;
+
+    // Connection objects and the map's nodes come from a pool owned by the loop, which keeps the
+    // slots of closed connections for the next ones instead of going back to the heap
+    struct ConnectionDeleter {
+        std::pmr::memory_resource* memory;
+        void operator()(Connection* conn) const { std::pmr::polymorphic_allocator<>(memory).delete_object(conn); }
+    };
+    std::pmr::unsynchronized_pool_resource connection_memory;
+    std::pmr::unordered_map<socket_t, std::unique_ptr<Connection, ConnectionDeleter>> connections{&connection_memory};
+
+    // File reads for this loop's connections when io_uring_file_reads is on and available
+    std::unique_ptr<DiskReader> disk_reader;
+    std::vector<Connection*> disk_ready;
+
+    // Connections whose response is waiting for bandwidth, retried at their resume_at
+    std::vector<socket_t> throttled_connections;
+
+    // Connections whose response another thread is producing (Connection::defer)
+    std::vector<std::pair<socket_t, DeferredResponse*>> deferred_connections;
+
+    std::mutex pending_mutex;
+    std::vector<std::pair<socket_t, std::string>> pending_connections;
+
+    std::chrono::steady_clock::time_point last_idle_sweep = std::chrono::steady_clock::now();
+
+    // Whether requests are traced (slow_request_ms), refreshed from the config at every idle sweep
+    bool trace_requests = false;
+    std::chrono::milliseconds slow_request_threshold{0};
+
+    // Load shedding (shed_queue_depth, shed_loop_lag_ms), thresholds refreshed at every idle sweep.
+    // loop_lag is the smoothed time the loop spends handling one wakeup's events; while either is
+    // over its threshold, shedding is set and requests get an early 503.
+    size_t shed_queue_depth = 0;
+    std::chrono::milliseconds shed_loop_lag{0};
+    std::chrono::steady_clock::duration loop_lag{0};
+    bool shedding = false;
+
+    // Set by drain(); the deadline is written before the flag is
+    std::atomic<bool> drain_requested{false};
+    std::chrono::steady_clock::time_point drain_deadline;
+    bool draining = false;  // loop thread's view: drain_requested has been seen and acted on
+
+    std::thread thread;
+    std::atomic<bool> running{false};
+};
+
+// Fixed set of event loops. Either each loop accepts from its own listener, or one accept
+// thread spreads connections across them round-robin with dispatch().
+class EventLoopPool {
+public:
+    // worker_count == 0 sizes the pool to the number of hardware threads
+    EventLoopPool(unsigned worker_count, RequestHandler handler);
+    ~EventLoopPool();
+
+    void start();
+    void stop();
+
+    // Function to drain every loop (see EventLoop::drain); stop() then waits for them
+    void drain(std::chrono::steady_clock::time_point deadline);
+
+    void dispatch(socket_t socket, std::string client_ip);
+
+    size_t size() const { return loops.size(); }
+    EventLoop& operator[](size_t index) { return *loops[index]; }
+
+private:
+    std::vector<std::unique_ptr<EventLoop>> loops;
+    std::atomic<size_t> next_loop{0};
+};
@@ -0,0 +1,76 @@
+#include "pch.h"
+#include "Net/FileBody.h"
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+std::shared_ptr<FileBody> FileBody::open(const std::string& path, bool map_contents) {
+    std::shared_ptr<FileBody> body(new FileBody());
+
+#ifdef _WIN32
+    // Paths are UTF-8; go through the wide API so non-ASCII names open correctly
+    std::filesystem::path native_path(std::u8string(reinterpret_cast<const char8_t*>(path.c_str())));
+    body->handle = CreateFileW(native_path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                               NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (body->handle == INVALID_HANDLE_VALUE) {
+        return nullptr;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(body->handle, &size)) {
+        return nullptr;
+    }
+    body->file_size = static_cast<uint64_t>(size.QuadPart);
+#else
+    body->fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (body->fd == -1) {
+        return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(body->fd, &st) != 0) {
+        return nullptr;
+    }
+    body->file_size = static_cast<uint64_t>(st.st_size);
+#endif
+
+    // A failed mapping is not fatal; the body is then read like any other file
+    if (map_contents && (!body->mapping.open(path) || body->mapping.data().size() != body->file_size)) {
+        body->mapping.close();
+    }
+
+    return body;
+}
+
+FileBody::~FileBody() {
+#ifdef _WIN32
+    if (handle != INVALID_HANDLE_VALUE) {
+        CloseHandle(handle);
+    }
+#else
+    if (fd != -1) {
+        close(fd);
+    }
+#endif
+}
+
+int64_t FileBody::readAt(uint64_t offset, char* buffer, size_t length) const {
+#ifdef _WIN32
+    OVERLAPPED overlapped = {};
+    overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+    DWORD bytes_read = 0;
+    if (!ReadFile(handle, buffer, static_cast<DWORD>(length), &bytes_read, &overlapped)) {
+        return GetLastError() == ERROR_HANDLE_EOF ? 0 : -1;
+    }
+    return bytes_read;
+#else
+    ssize_t bytes_read;
+    do {
+        bytes_read = pread(fd, buffer, length, static_cast<off_t>(offset));
+    } while (bytes_read == -1 && errno == EINTR);
+    return bytes_read;
+#endif
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Utils/MappedFile.h"
+
+#include <string_view>
+
+// Read-only file used as a response body.
+// Reads are positional and the object never changes once opened, so one instance can be
+// shared by any number of connections.
+class FileBody {
+public:
+    // Returns nullptr if the file can't be opened.
+    // map_contents also maps the whole file into memory so it can be sent without reads.
+    static std::shared_ptr<FileBody> open(const std::string& path, bool map_contents = false);
+
+    ~FileBody();
+
+    FileBody(const FileBody&) = delete;
+    FileBody& operator=(const FileBody&) = delete;
+
+    uint64_t size() const { return file_size; }
+
+    // The whole file, if it was opened with map_contents; empty otherwise
+    std::string_view contents() const { return mapping.data(); }
+    bool isMapped() const { return mapping.isOpen(); }
+
+    // Read up to length bytes starting at offset; returns bytes read, or -1 on error
+    int64_t readAt(uint64_t offset, char* buffer, size_t length) const;
+
+#ifdef _WIN32
+    HANDLE nativeHandle() const { return handle; }
+#else
+    int nativeHandle() const { return fd; }
+#endif
+
+private:
+    FileBody() = default;
+
+#ifdef _WIN32
+    HANDLE handle = INVALID_HANDLE_VALUE;
+#else
+    int fd = -1;
+#endif
+    uint64_t file_size = 0;
+    MappedFile mapping;
+};
@@ -0,0 +1,116 @@
+#include "pch.h"
+#include "ServerConfig.h"
+#include "Net/FileCache.h"
+
+FileCache::FileCache(size_t max_handles, uint64_t hot_budget_bytes, unsigned hot_threshold)
+    : max_handles_per_shard(std::max<size_t>(1, max_handles / SHARD_COUNT)),
+      hot_budget(hot_budget_bytes),
+      hot_threshold(hot_threshold) {
+}
+
+bool FileCache::shouldMap(const Entry& entry) const {
+#ifdef __linux__
+    // sendfile() already serves straight from the page cache; a mapping would only cost address space
+    (void)entry;
+    return false;
+#else
+    return hot_budget > 0 && !entry.body->isMapped() && entry.hits >= hot_threshold &&
+           hot_bytes.load(std::memory_order_relaxed) + entry.body->size() <= hot_budget;
+#endif
+}
+
+std::shared_ptr<FileBody> FileCache::open(std::string_view path, const FileStamp& stamp) {
+    Shard& shard = shards[StringHash()(path) % SHARD_COUNT];
+
+    std::shared_ptr<FileBody> cached;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto found = shard.entries.find(path);
+        if (found != shard.entries.end()) {
+            auto it = found->second;
+            if (it->stamp == stamp) {
+                it->hits++;
+                shard.lru.splice(shard.lru.begin(), shard.lru, it);
+                hit_count.fetch_add(1, std::memory_order_relaxed);
+
+                if (!shouldMap(*it)) {
+                    return it->body;
+                }
+                cached = it->body;
+            } else {
+                // The file changed since it was cached
+                evict(shard, it);
+            }
+        }
+    }
+
+    if (cached) {
+        // Became hot: map it outside the lock, like the open below, then swap the mapped instance
+        // in if the entry is still this one. Connections holding the old instance keep it.
+        std::shared_ptr<FileBody> mapped = FileBody::open(std::string(path), true);
+        if (!mapped || !mapped->isMapped() || mapped->size() != cached->size()) {
+            return cached;
+        }
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto found = shard.entries.find(path);
+        if (found == shard.entries.end() || !(found->second->stamp == stamp)) {
+            return cached;  // evicted or replaced meanwhile
+        }
+        if (found->second->body != cached || !shouldMap(*found->second)) {
+            return found->second->body;  // another loop mapped it first, or the budget filled up
+        }
+        hot_bytes.fetch_add(mapped->size(), std::memory_order_relaxed);
+        found->second->body = mapped;
+        return mapped;
+    }
+
+    // Open outside the lock so a slow disk doesn't stall other lookups in the shard
+    miss_count.fetch_add(1, std::memory_order_relaxed);
+    std::shared_ptr<FileBody> body = FileBody::open(std::string(path));
+    if (!body) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto found = shard.entries.find(path);
+    if (found != shard.entries.end()) {
+        // Another loop won the race; keep its entry if it matches
+        if (found->second->stamp == stamp) {
+            return found->second->body;
+        }
+        evict(shard, found->second);
+    }
+
+    shard.lru.push_front(Entry{std::string(path), stamp, body, 1});
+    shard.entries.emplace(shard.lru.front().path, shard.lru.begin());
+    while (shard.lru.size() > max_handles_per_shard) {
+        evict(shard, std::prev(shard.lru.end()));
+    }
+    return body;
+}
+
+void FileCache::evict(Shard& shard, std::list<Entry>::iterator it) {
+    if (it->body->isMapped()) {
+        hot_bytes.fetch_sub(it->body->size(), std::memory_order_relaxed);
+    }
+    shard.entries.erase(it->path);
+    shard.lru.erase(it);
+}
+
+FileCache::Stats FileCache::stats() const {
+    Stats result{hit_count.load(), miss_count.load(), 0, hot_bytes.load()};
+    for (const Shard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        result.handles += shard.lru.size();
+    }
+    return result;
+}
+
+FileCache& fileCache() {
+    static FileCache cache = [] {
+        std::shared_ptr<const ServerConfig> config = currentConfig();
+        return FileCache(config->file_cache_max_handles, config->hot_cache_budget_bytes, config->hot_track_threshold);
+    }();
+    return cache;
+}
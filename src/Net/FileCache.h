@@ -0,0 +1,56 @@
+#pragma once
+
+#include "TrackInfo.h"
+#include "Net/FileBody.h"
+#include "Utils/Hash.h"
+
+// LRU cache of open response files shared by every event loop.
+// Entries are keyed by path and tied to the catalog's FileStamp for that path, so a file
+// that changed on disk (and therefore in the catalog) is reopened rather than served stale.
+// Files requested often enough are reopened memory-mapped, within a global byte budget,
+// where the platform has no sendfile() to serve them from the page cache directly.
+class FileCache {
+public:
+    FileCache(size_t max_handles, uint64_t hot_budget_bytes, unsigned hot_threshold);
+
+    // Open path, reusing a cached handle when it was opened for the same stamp; nullptr on failure
+    std::shared_ptr<FileBody> open(std::string_view path, const FileStamp& stamp);
+
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        size_t handles;
+        uint64_t hot_bytes;
+    };
+    Stats stats() const;
+
+private:
+    struct Entry {
+        std::string path;
+        FileStamp stamp;
+        std::shared_ptr<FileBody> body;
+        unsigned hits = 0;
+    };
+
+    // Independent LRU lists so loops opening different files rarely contend on one lock
+    struct Shard {
+        mutable std::mutex mutex;
+        std::list<Entry> lru;  // most recently used first
+        std::unordered_map<std::string, std::list<Entry>::iterator, StringHash, std::equal_to<>> entries;
+    };
+    static constexpr size_t SHARD_COUNT = 8;
+
+    void evict(Shard& shard, std::list<Entry>::iterator it);
+    bool shouldMap(const Entry& entry) const;
+
+    Shard shards[SHARD_COUNT];
+    size_t max_handles_per_shard;
+    uint64_t hot_budget;
+    unsigned hot_threshold;
+    std::atomic<uint64_t> hot_bytes{0};
+    std::atomic<uint64_t> hit_count{0};
+    std::atomic<uint64_t> miss_count{0};
+};
+
+// Process-wide cache used by the request handlers
+FileCache& fileCache();
@@ -0,0 +1,152 @@
+#include "pch.h"
+#include "Net/Handoff.h"
+
+#include <charconv>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+// How the replacement finds its inherited descriptors: a comma-separated list of listener fds, and
+// the write end of a pipe it reports readiness on
+static const std::string LISTEN_FDS_ENV = "SERVER_LISTEN_FDS";
+static const std::string READY_FD_ENV = "SERVER_READY_FD";
+
+// Function to read the descriptor numbers listed in an environment variable and remove the
+// variable, so nothing this process starts later takes them for its own
+static std::vector<int> takeDescriptors(const std::string& name) {
+    std::vector<int> descriptors;
+    const char* value = getenv(name.c_str());
+    if (value == nullptr) {
+        return descriptors;
+    }
+    std::string_view list = value;
+    while (!list.empty()) {
+        size_t comma = list.find(',');
+        std::string_view item = list.substr(0, comma);
+        int descriptor;
+        auto [end, failure] = std::from_chars(item.data(), item.data() + item.size(), descriptor);
+        if (failure == std::errc() && end == item.data() + item.size() && descriptor >= 0) {
+            descriptors.push_back(descriptor);
+        }
+        list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+    }
+    unsetenv(name.c_str());
+    return descriptors;
+}
+
+std::vector<socket_t> takeInheritedListeners(int port) {
+    std::vector<socket_t> listeners;
+    for (int descriptor : takeDescriptors(LISTEN_FDS_ENV)) {
+        int accepting = 0;
+        socklen_t length = sizeof(accepting);
+        if (getsockopt(descriptor, SOL_SOCKET, SO_ACCEPTCONN, &accepting, &length) != 0) {
+            continue;  // not a socket; nothing of ours
+        }
+        sockaddr_in address;
+        socklen_t address_length = sizeof(address);
+        if (!accepting || getsockname(descriptor, (struct sockaddr*)&address, &address_length) != 0 ||
+            address.sin_family != AF_INET || ntohs(address.sin_port) != port) {
+            CLOSE_SOCKET(descriptor);
+            continue;
+        }
+        // Passed on explicitly by the next restart, never by accident
+        fcntl(descriptor, F_SETFD, FD_CLOEXEC);
+        listeners.push_back(descriptor);
+    }
+    return listeners;
+}
+
+void reportReplacementReady() {
+    for (int descriptor : takeDescriptors(READY_FD_ENV)) {
+        char ready = 1;
+        if (write(descriptor, &ready, 1) != 1) {
+            // The old process gave up waiting; it kills the replacement itself
+        }
+        close(descriptor);
+    }
+}
+
+bool startReplacement(const char* program, char* const* argv, const std::vector<socket_t>& listeners,
+                      int timeout_ms, std::string& error) {
+    int ready_pipe[2];
+    if (pipe(ready_pipe) != 0) {
+        error = "Failed to create a pipe";
+        return false;
+    }
+    fcntl(ready_pipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(ready_pipe[1], F_SETFD, FD_CLOEXEC);
+
+    // Everything the child needs is built before fork(): a multithreaded process may only make
+    // async-signal-safe calls in the child until it execs
+    std::string listen_fds = LISTEN_FDS_ENV + "=";
+    for (size_t i = 0; i < listeners.size(); ++i) {
+        listen_fds += (i > 0 ? "," : "") + std::to_string(listeners[i]);
+    }
+    std::string ready_fd = READY_FD_ENV + "=" + std::to_string(ready_pipe[1]);
+    std::vector<char*> environment;
+    for (char** entry = environ; *entry != nullptr; ++entry) {
+        std::string_view variable = *entry;
+        if (!variable.starts_with(LISTEN_FDS_ENV + "=") && !variable.starts_with(READY_FD_ENV + "=")) {
+            environment.push_back(*entry);
+        }
+    }
+    environment.push_back(listen_fds.data());
+    environment.push_back(ready_fd.data());
+    environment.push_back(nullptr);
+
+    pid_t child = fork();
+    if (child < 0) {
+        close(ready_pipe[0]);
+        close(ready_pipe[1]);
+        error = "Failed to fork";
+        return false;
+    }
+    if (child == 0) {
+        for (socket_t listener : listeners) {
+            fcntl(listener, F_SETFD, 0);
+        }
+        fcntl(ready_pipe[1], F_SETFD, 0);
+        environ = environment.data();
+        execvp(program, argv);
+        _exit(127);
+    }
+    close(ready_pipe[1]);
+
+    // The replacement loads its catalog before it accepts; meanwhile new connections wait in the
+    // listeners' queues, and this process keeps serving the ones it has
+    pollfd waiting{ready_pipe[0], POLLIN, 0};
+    int polled;
+    do {
+        polled = poll(&waiting, 1, timeout_ms);
+    } while (polled < 0 && errno == EINTR);
+    char ready = 0;
+    bool started = polled > 0 && read(ready_pipe[0], &ready, 1) == 1;
+    close(ready_pipe[0]);
+    if (!started) {
+        error = polled == 0 ? "Replacement did not start accepting in time" : "Replacement exited during start-up";
+        kill(child, SIGKILL);
+        waitpid(child, nullptr, 0);
+        return false;
+    }
+    return true;
+}
+
+#else
+
+std::vector<socket_t> takeInheritedListeners(int) {
+    return {};
+}
+
+void reportReplacementReady() {
+}
+
+bool startReplacement(const char*, char* const*, const std::vector<socket_t>&, int, std::string& error) {
+    error = "Restarting in place is not supported on this platform";
+    return false;
+}
+
+#endif
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Zero-downtime restarts (POSIX). On SIGUSR2 the running server starts its binary again and the new
+// process inherits the listening sockets, so their accept queues carry over and no connection attempt
+// is refused. Once the new process reports that it is accepting, the old one closes its copies of the
+// sockets and drains the connections it already has.
+
+// Function to take the listening sockets inherited from the process that started this one, keeping
+// those bound to port (a replacement may have been configured for another one); empty when the
+// server was started normally. Call once, before opening any listener.
+std::vector<socket_t> takeInheritedListeners(int port);
+
+// Function to tell the process that started this one that it is accepting connections now; does
+// nothing when the server was started normally
+void reportReplacementReady();
+
+// Function to start program with argv as a replacement for this process, passing it listeners, and
+// wait up to timeout_ms for it to report that it is accepting. Returns false with error if it exits
+// or times out first, in which case it has been killed and this process should carry on serving.
+bool startReplacement(const char* program, char* const* argv, const std::vector<socket_t>& listeners,
+                      int timeout_ms, std::string& error);
@@ -0,0 +1,13 @@
+#include "pch.h"
+#include "ServerConfig.h"
+#include "Net/HlsCache.h"
+
+size_t HlsTrack::memoryUsage() const {
+    return segments.boundaries.capacity() * sizeof(uint64_t) + segments.start_ms.capacity() * sizeof(uint32_t) +
+           version.capacity() + playlist.memoryUsage();
+}
+
+HlsCache& hlsCache() {
+    static HlsCache cache(currentConfig()->hls_cache_budget_bytes);
+    return cache;
+}
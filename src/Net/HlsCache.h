@@ -0,0 +1,22 @@
+#pragma once
+
+#include "Net/StampedCache.h"
+#include "Media/Hls.h"
+#include "Utils/Compression.h"
+
+// A track's HLS segment cut with its rendered playlist, built on the first /hls request for it
+struct HlsTrack {
+    HlsSegments segments;
+    std::string version;         // names this cut in segment URIs; changes with the file and segment length
+    PrecompressedBody playlist;  // with compressed variants
+
+    size_t memoryUsage() const;
+};
+
+// HlsTracks by path, so only the first playlist request for a track reads the file to find its
+// cuts and every later playlist or segment request is a lookup. A changed file is cut again
+// rather than served from stale offsets.
+using HlsCache = StampedCache<HlsTrack>;
+
+// Process-wide cache of segment cuts for /hls
+HlsCache& hlsCache();
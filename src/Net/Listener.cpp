@@ -0,0 +1,82 @@
+#include "pch.h"
+#include "Net/Listener.h"
+#include "Net/Poller.h"
+
+bool reusePortBalances() {
+#if defined(__linux__) && defined(SO_REUSEPORT)
+    return true;
+#else
+    return false;
+#endif
+}
+
+socket_t openListener(int port, int backlog, bool reuse_port, std::string& error) {
+    socket_t listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listener == INVALID_SOCKET) {
+        error = "Failed to create socket.";
+        return INVALID_SOCKET;
+    }
+
+    auto fail = [&](std::string message) {
+        error = std::move(message);
+        CLOSE_SOCKET(listener);
+        return INVALID_SOCKET;
+    };
+
+    // Enable socket reuse option
+    int reuse = 1;
+    if (setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse)) == SOCKET_ERROR_CODE) {
+        return fail("Failed to set socket options.");
+    }
+#ifdef SO_REUSEPORT
+    if (reuse_port && setsockopt(listener, SOL_SOCKET, SO_REUSEPORT, (const char*)&reuse, sizeof(reuse)) == SOCKET_ERROR_CODE) {
+        return fail("Failed to set SO_REUSEPORT.");
+    }
+#else
+    (void)reuse_port;
+#endif
+
+    // Bind socket to address and port
+    sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = INADDR_ANY;
+    server_addr.sin_port = htons(static_cast<uint16_t>(port));
+    if (bind(listener, (struct sockaddr*)&server_addr, sizeof(server_addr)) == SOCKET_ERROR_CODE) {
+        return fail("Failed to bind socket to port " + std::to_string(port));
+    }
+
+    // Listen for incoming connections
+    if (listen(listener, backlog) == SOCKET_ERROR_CODE) {
+        return fail("Failed to listen on socket.");
+    }
+    return listener;
+}
+
+socket_t acceptClient(socket_t listener, bool nonblocking, std::string& client_ip, bool& would_block) {
+    sockaddr_in client_addr;
+    socklen_t client_addr_len = sizeof(client_addr);
+#ifdef __linux__
+    // One call instead of accept() plus fcntl()
+    socket_t client = accept4(listener, (struct sockaddr*)&client_addr, &client_addr_len,
+                              SOCK_CLOEXEC | (nonblocking ? SOCK_NONBLOCK : 0));
+#else
+    socket_t client = accept(listener, (struct sockaddr*)&client_addr, &client_addr_len);
+    if (client != INVALID_SOCKET && nonblocking && !setSocketNonBlocking(client)) {
+        CLOSE_SOCKET(client);
+        would_block = false;
+        return INVALID_SOCKET;
+    }
+#endif
+    if (client == INVALID_SOCKET) {
+        would_block = SOCKET_WOULD_BLOCK(SOCKET_LAST_ERROR);
+        return INVALID_SOCKET;
+    }
+
+    // Get client IP address
+    char address[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &(client_addr.sin_addr), address, INET_ADDRSTRLEN);
+    client_ip = address;
+    would_block = false;
+    return client;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+
+// True where the kernel spreads incoming connections across sockets bound with SO_REUSEPORT
+// (Linux 3.9+). Elsewhere the option either doesn't exist or hands every connection to one socket.
+bool reusePortBalances();
+
+// Function to open a TCP socket listening on port on all interfaces. With reuse_port, further
+// sockets can be bound to the same port and share its connections. error says what failed.
+socket_t openListener(int port, int backlog, bool reuse_port, std::string& error);
+
+// Function to accept one connection from a listener; INVALID_SOCKET when none is waiting (or on
+// error, in which case would_block is false). The new socket is non-blocking if nonblocking is set.
+socket_t acceptClient(socket_t listener, bool nonblocking, std::string& client_ip, bool& would_block);
@@ -0,0 +1,208 @@
+#include "pch.h"
+#include "Net/Poller.h"
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+#ifdef _WIN32
+#define POLL_SOCKETS WSAPoll
+#else
+#define POLL_SOCKETS poll
+#endif
+
+bool setSocketNonBlocking(socket_t socket) {
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket(socket, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(socket, F_GETFL, 0);
+    if (flags == -1) {
+        return false;
+    }
+    return fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+#ifdef __linux__
+
+static uint32_t epollMask(bool want_read, bool want_write) {
+    uint32_t mask = 0;
+    if (want_read) mask |= EPOLLIN | EPOLLRDHUP;
+    if (want_write) mask |= EPOLLOUT;
+    return mask;
+}
+
+Poller::Poller() : ready(MAX_EVENTS) {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd == -1 || wake_fd == -1) {
+        throw std::runtime_error("Failed to create epoll instance");
+    }
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = wake_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+}
+
+Poller::~Poller() {
+    close(wake_fd);
+    close(epoll_fd);
+}
+
+void Poller::add(socket_t socket, bool want_read, bool want_write) {
+    epoll_event ev{};
+    ev.events = epollMask(want_read, want_write);
+    ev.data.fd = socket;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, socket, &ev);
+}
+
+void Poller::modify(socket_t socket, bool want_read, bool want_write) {
+    epoll_event ev{};
+    ev.events = epollMask(want_read, want_write);
+    ev.data.fd = socket;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, socket, &ev);
+}
+
+void Poller::remove(socket_t socket) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, socket, nullptr);
+}
+
+void Poller::wait(std::vector<PollEvent>& events, int timeout_ms) {
+    events.clear();
+
+    int count = epoll_wait(epoll_fd, ready.data(), static_cast<int>(ready.size()), timeout_ms);
+    for (int i = 0; i < count; ++i) {
+        const epoll_event& ev = ready[i];
+        if (ev.data.fd == wake_fd) {
+            drainWakeup();
+            continue;
+        }
+
+        PollEvent event;
+        event.socket = ev.data.fd;
+        event.readable = (ev.events & (EPOLLIN | EPOLLRDHUP)) != 0;
+        event.writable = (ev.events & EPOLLOUT) != 0;
+        event.error = (ev.events & (EPOLLERR | EPOLLHUP)) != 0;
+        events.push_back(event);
+    }
+}
+
+void Poller::wakeup() {
+    uint64_t one = 1;
+    ssize_t written = write(wake_fd, &one, sizeof(one));
+    (void)written;
+}
+
+void Poller::drainWakeup() {
+    uint64_t value;
+    ssize_t bytes_read = read(wake_fd, &value, sizeof(value));
+    (void)bytes_read;
+}
+
+#else // poll() / WSAPoll() backend
+
+static short pollMask(bool want_read, bool want_write) {
+    short mask = 0;
+    if (want_read) mask |= POLLIN;
+    if (want_write) mask |= POLLOUT;
+    return mask;
+}
+
+Poller::Poller() {
+    // A UDP socket connected to itself serves as a portable self-pipe for wakeups
+    wake_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (wake_socket == INVALID_SOCKET) {
+        throw std::runtime_error("Failed to create wakeup socket");
+    }
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t addr_len = sizeof(addr);
+    if (bind(wake_socket, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR_CODE ||
+        getsockname(wake_socket, (struct sockaddr*)&addr, &addr_len) == SOCKET_ERROR_CODE ||
+        connect(wake_socket, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR_CODE) {
+        CLOSE_SOCKET(wake_socket);
+        throw std::runtime_error("Failed to set up wakeup socket");
+    }
+    setSocketNonBlocking(wake_socket);
+
+    add(wake_socket, true, false);
+}
+
+Poller::~Poller() {
+    CLOSE_SOCKET(wake_socket);
+}
+
+void Poller::add(socket_t socket, bool want_read, bool want_write) {
+    fd_index[socket] = fds.size();
+    fds.push_back({});
+    fds.back().fd = socket;
+    fds.back().events = pollMask(want_read, want_write);
+}
+
+void Poller::modify(socket_t socket, bool want_read, bool want_write) {
+    auto it = fd_index.find(socket);
+    if (it != fd_index.end()) {
+        fds[it->second].events = pollMask(want_read, want_write);
+    }
+}
+
+void Poller::remove(socket_t socket) {
+    auto it = fd_index.find(socket);
+    if (it == fd_index.end()) {
+        return;
+    }
+
+    // Swap the last entry into the freed slot to keep the array dense
+    size_t slot = it->second;
+    fd_index.erase(it);
+    if (slot != fds.size() - 1) {
+        fds[slot] = fds.back();
+        fd_index[fds[slot].fd] = slot;
+    }
+    fds.pop_back();
+}
+
+void Poller::wait(std::vector<PollEvent>& events, int timeout_ms) {
+    events.clear();
+
+    int count = POLL_SOCKETS(fds.data(), static_cast<unsigned long>(fds.size()), timeout_ms);
+    if (count <= 0) {
+        return;
+    }
+
+    for (const auto& pfd : fds) {
+        if (pfd.revents == 0) {
+            continue;
+        }
+        if (pfd.fd == wake_socket) {
+            drainWakeup();
+            continue;
+        }
+
+        PollEvent event;
+        event.socket = pfd.fd;
+        event.readable = (pfd.revents & POLLIN) != 0;
+        event.writable = (pfd.revents & POLLOUT) != 0;
+        event.error = (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) != 0;
+        events.push_back(event);
+    }
+}
+
+void Poller::wakeup() {
+    char byte = 1;
+    ::send(wake_socket, &byte, 1, 0);
+}
+
+void Poller::drainWakeup() {
+    char buffer[64];
+    while (recv(wake_socket, buffer, sizeof(buffer), 0) > 0) {
+    }
+}
+
+#endif
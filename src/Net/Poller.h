@@ -0,0 +1,59 @@
+#pragma once
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#elif !defined(_WIN32)
+#include <poll.h>
+#endif
+
+// Readiness notification for one socket returned by Poller::wait
+struct PollEvent {
+    socket_t socket;
+    bool readable;
+    bool writable;
+    bool error;  // hang-up or socket error
+};
+
+// Readiness-based socket multiplexer.
+// Linux uses epoll, every other platform (including Windows through WSAPoll) uses poll().
+class Poller {
+public:
+    // Most sockets one wait() reports with epoll; the rest are reported by the next wait
+    static constexpr size_t MAX_EVENTS = 256;
+
+    Poller();
+    ~Poller();
+
+    Poller(const Poller&) = delete;
+    Poller& operator=(const Poller&) = delete;
+
+    void add(socket_t socket, bool want_read, bool want_write);
+    void modify(socket_t socket, bool want_read, bool want_write);
+    void remove(socket_t socket);
+
+    // Block until at least one socket is ready, wakeup() is called or timeout_ms elapses (-1 = forever)
+    void wait(std::vector<PollEvent>& events, int timeout_ms);
+
+    // Interrupt a wait() in progress; safe to call from any thread
+    void wakeup();
+
+private:
+    void drainWakeup();
+
+#ifdef __linux__
+    int epoll_fd;
+    int wake_fd;  // eventfd
+    std::vector<epoll_event> ready;
+#else
+#ifdef _WIN32
+    std::vector<WSAPOLLFD> fds;
+#else
+    std::vector<pollfd> fds;
+#endif
+    std::unordered_map<socket_t, size_t> fd_index;
+    socket_t wake_socket;  // UDP socket connected to itself
+#endif
+};
+
+// Switch a socket to non-blocking mode
+bool setSocketNonBlocking(socket_t socket);
@@ -0,0 +1,8 @@
+#include "pch.h"
+#include "ServerConfig.h"
+#include "Net/PrecompressedCache.h"
+
+PrecompressedCache& descriptionCache() {
+    static PrecompressedCache cache(currentConfig()->description_cache_budget_bytes);
+    return cache;
+}
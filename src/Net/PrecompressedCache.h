@@ -0,0 +1,11 @@
+#pragma once
+
+#include "Net/StampedCache.h"
+#include "Utils/Compression.h"
+
+// Small response files held in memory together with their compressed variants, so serving one
+// in any coding costs a lookup rather than a read and a compression
+using PrecompressedCache = StampedCache<PrecompressedBody>;
+
+// Process-wide cache of description sidecars, filled as the catalog loads them and on first request
+PrecompressedCache& descriptionCache();
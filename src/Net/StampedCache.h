@@ -0,0 +1,99 @@
+#pragma once
+
+#include "TrackInfo.h"
+#include "Utils/Hash.h"
+
+// LRU cache of values derived from files, keyed by path and tied to the catalog's FileStamp for
+// it, so a changed file is never served from a stale entry. Sharded by path hash so lookups from
+// different loops rarely meet on one mutex, and bounded by a byte budget split between the shards.
+// Value reports its own footprint through memoryUsage().
+template <typename Value>
+class StampedCache {
+public:
+    explicit StampedCache(uint64_t budget_bytes) : budget_per_shard(budget_bytes / SHARD_COUNT) {}
+
+    // Value of path cached for this stamp; nullptr if there is none
+    std::shared_ptr<const Value> find(std::string_view path, const FileStamp& stamp) {
+        Shard& shard = shards[StringHash()(path) % SHARD_COUNT];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto found = shard.entries.find(path);
+        if (found != shard.entries.end()) {
+            auto it = found->second;
+            if (it->stamp == stamp) {
+                shard.lru.splice(shard.lru.begin(), shard.lru, it);
+                hit_count.fetch_add(1, std::memory_order_relaxed);
+                return it->value;
+            }
+            // The file changed since it was cached
+            evict(shard, it);
+        }
+        miss_count.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    // Cache value as derived from path at stamp, replacing any older entry; returns the shared copy
+    std::shared_ptr<const Value> store(const std::string& path, const FileStamp& stamp, Value value) {
+        size_t bytes = value.memoryUsage() + path.capacity() + sizeof(Entry);
+        auto shared = std::make_shared<const Value>(std::move(value));
+        if (bytes > budget_per_shard) {
+            return shared;  // would push everything else out
+        }
+
+        Shard& shard = shards[StringHash()(path) % SHARD_COUNT];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto found = shard.entries.find(path);
+        if (found != shard.entries.end()) {
+            evict(shard, found->second);
+        }
+        shard.lru.push_front(Entry{path, stamp, shared, bytes});
+        shard.entries[path] = shard.lru.begin();
+        shard.bytes += bytes;
+        while (shard.bytes > budget_per_shard) {
+            evict(shard, std::prev(shard.lru.end()));
+        }
+        return shared;
+    }
+
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        size_t entries;
+        uint64_t bytes;
+    };
+    Stats stats() const {
+        Stats result{hit_count.load(), miss_count.load(), 0, 0};
+        for (const Shard& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            result.entries += shard.lru.size();
+            result.bytes += shard.bytes;
+        }
+        return result;
+    }
+
+private:
+    struct Entry {
+        std::string path;
+        FileStamp stamp;
+        std::shared_ptr<const Value> value;
+        size_t bytes;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::list<Entry> lru;  // most recently used first
+        std::unordered_map<std::string, typename std::list<Entry>::iterator, StringHash, std::equal_to<>> entries;
+        uint64_t bytes = 0;
+    };
+    static constexpr size_t SHARD_COUNT = 8;
+
+    void evict(Shard& shard, typename std::list<Entry>::iterator it) {
+        shard.bytes -= it->bytes;
+        shard.entries.erase(it->path);
+        shard.lru.erase(it);
+    }
+
+    Shard shards[SHARD_COUNT];
+    uint64_t budget_per_shard;
+    std::atomic<uint64_t> hit_count{0};
+    std::atomic<uint64_t> miss_count{0};
+};
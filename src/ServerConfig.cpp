@@ -0,0 +1,311 @@
+#include "pch.h"
+#include "ServerConfig.h"
+#include "Net/Poller.h"
+#include "Utils/Logger.h"
+#include "Utils/Utf8.h"
+
+#include <algorithm>
+#include <set>
+#include <stdexcept>
+
+using json = nlohmann::json;
+
+// Published configuration; swapped atomically, never modified after publication
+static std::atomic<std::shared_ptr<const ServerConfig>> current_config{std::make_shared<const ServerConfig>()};
+static std::mutex load_mutex;
+static std::string loaded_path = DEFAULT_CONFIG_PATH;  // guarded by load_mutex
+static bool loaded_path_required = false;              // guarded by load_mutex
+static bool started = false;                           // guarded by load_mutex; set by the first load
+
+std::shared_ptr<const ServerConfig> currentConfig() {
+    return current_config.load();
+}
+
+namespace {
+
+// Reads the settings present in one config document, checking each against its field's type
+class ConfigReader {
+public:
+    explicit ConfigReader(const json& document) : document(document) {}
+
+    bool has(const char* key) {
+        known.insert(key);
+        return document.contains(key);
+    }
+
+    void read(const char* key, bool& value) {
+        if (has(key)) value = check(key, document[key].is_boolean(), "true or false").get<bool>();
+    }
+    void read(const char* key, int& value) {
+        if (has(key)) value = check(key, document[key].is_number_integer(), "an integer").get<int>();
+    }
+    void read(const char* key, unsigned& value) {
+        if (has(key)) value = check(key, document[key].is_number_unsigned(), "a non-negative integer").get<unsigned>();
+    }
+    void read(const char* key, unsigned long& value) {
+        if (has(key)) value = check(key, document[key].is_number_unsigned(), "a non-negative integer").get<unsigned long>();
+    }
+    void read(const char* key, unsigned long long& value) {
+        if (has(key)) value = check(key, document[key].is_number_unsigned(), "a non-negative integer").get<unsigned long long>();
+    }
+    void read(const char* key, double& value) {
+        if (has(key)) value = check(key, document[key].is_number(), "a number").get<double>();
+    }
+    void read(const char* key, std::string& value) {
+        if (has(key)) value = check(key, document[key].is_string(), "a string").get<std::string>();
+    }
+    void read(const char* key, std::u8string& value) {
+        if (has(key)) value = toUtf8(check(key, document[key].is_string(), "a string").get<std::string>());
+    }
+    void read(const char* key, std::vector<std::string>& value) {
+        if (has(key)) {
+            const json& list = check(key, document[key].is_array(), "an array of strings");
+            value.clear();
+            for (const json& item : list) {
+                check(key, item.is_string(), "an array of strings");
+                value.push_back(item.get<std::string>());
+            }
+        }
+    }
+
+    // Keys in the document that no read() asked for
+    std::vector<std::string> unknownKeys() const {
+        std::vector<std::string> unknown;
+        for (const auto& item : document.items()) {
+            if (!known.count(item.key())) {
+                unknown.push_back(item.key());
+            }
+        }
+        return unknown;
+    }
+
+private:
+    const json& check(const char* key, bool valid, const char* expected) const {
+        if (!valid) {
+            throw std::runtime_error(std::string(key) + " must be " + expected);
+        }
+        return document[key];
+    }
+
+    const json& document;
+    std::set<std::string> known;
+};
+
+void readConfig(ConfigReader& reader, ServerConfig& config) {
+    reader.read("port", config.port);
+    reader.read("listen_backlog", config.listen_backlog);
+    reader.read("worker_threads", config.worker_threads);
+    reader.read("background_threads", config.background_threads);
+    reader.read("reuse_port", config.reuse_port);
+    reader.read("pin_event_loops", config.pin_event_loops);
+    reader.read("buffer_size", config.buffer_size);
+    reader.read("sendfile_chunk_size", config.sendfile_chunk_size);
+    reader.read("socket_send_buffer", config.socket_send_buffer);
+    reader.read("music_dir", config.music_dir);
+    reader.read("file_cache_max_handles", config.file_cache_max_handles);
+    reader.read("hot_cache_budget_bytes", config.hot_cache_budget_bytes);
+    reader.read("hot_track_threshold", config.hot_track_threshold);
+    reader.read("description_cache_budget_bytes", config.description_cache_budget_bytes);
+    reader.read("max_client_bytes_per_second", config.max_client_bytes_per_second);
+    reader.read("max_total_bytes_per_second", config.max_total_bytes_per_second);
+    reader.read("io_uring_file_reads", config.io_uring_file_reads);
+    reader.read("io_uring_buffer_count", config.io_uring_buffer_count);
+    reader.read("io_uring_buffer_size", config.io_uring_buffer_size);
+    reader.read("hls_segment_seconds", config.hls_segment_seconds);
+    reader.read("hls_cache_budget_bytes", config.hls_cache_budget_bytes);
+    reader.read("cluster_self", config.cluster_self);
+    reader.read("cluster_nodes", config.cluster_nodes);
+    reader.read("cluster_virtual_nodes", config.cluster_virtual_nodes);
+
+    reader.read("keepalive_timeout_seconds", config.keepalive_timeout_seconds);
+    reader.read("max_keepalive_requests", config.max_keepalive_requests);
+    reader.read("request_header_timeout_seconds", config.request_header_timeout_seconds);
+    reader.read("send_timeout_seconds", config.send_timeout_seconds);
+    reader.read("max_connections", config.max_connections);
+    reader.read("max_connections_per_ip", config.max_connections_per_ip);
+    reader.read("shed_queue_depth", config.shed_queue_depth);
+    reader.read("shed_loop_lag_ms", config.shed_loop_lag_ms);
+    reader.read("retry_after_seconds", config.retry_after_seconds);
+    reader.read("stream_pacing_enabled", config.stream_pacing_enabled);
+    reader.read("stream_pacing_multiplier", config.stream_pacing_multiplier);
+    reader.read("stream_pacing_burst_bytes", config.stream_pacing_burst_bytes);
+    reader.read("catalog_watch_debounce_ms", config.catalog_watch_debounce_ms);
+    reader.read("catalog_query_gzip_min_bytes", config.catalog_query_gzip_min_bytes);
+    reader.read("catalog_query_gzip_level", config.catalog_query_gzip_level);
+    reader.read("catalog_query_brotli_quality", config.catalog_query_brotli_quality);
+    reader.read("catalog_query_default_limit", config.catalog_query_default_limit);
+    reader.read("catalog_query_max_limit", config.catalog_query_max_limit);
+    reader.read("catalog_brotli_quality", config.catalog_brotli_quality);
+    reader.read("description_brotli_quality", config.description_brotli_quality);
+    reader.read("description_cache_max_file_bytes", config.description_cache_max_file_bytes);
+    reader.read("stream_max_age_seconds", config.stream_max_age_seconds);
+    reader.read("description_max_age_seconds", config.description_max_age_seconds);
+    reader.read("search_default_limit", config.search_default_limit);
+    reader.read("search_max_limit", config.search_max_limit);
+    reader.read("cluster_poll_interval_ms", config.cluster_poll_interval_ms);
+    reader.read("cluster_peer_timeout_ms", config.cluster_peer_timeout_ms);
+    reader.read("shutdown_drain_seconds", config.shutdown_drain_seconds);
+    reader.read("restart_ready_timeout_seconds", config.restart_ready_timeout_seconds);
+    reader.read("slow_request_ms", config.slow_request_ms);
+    reader.read("debug_access", config.debug_access);
+    reader.read("profile_max_seconds", config.profile_max_seconds);
+    reader.read("profile_sample_hz", config.profile_sample_hz);
+    reader.read("log_level", config.log_level);
+}
+
+// Function to reject values the server can't run with; returns an error message or nullptr
+const char* validateConfig(const ServerConfig& config) {
+    LogLevel level;
+    if (config.port <= 0 || config.port > 65535) return "port must be between 1 and 65535";
+    if (config.listen_backlog <= 0) return "listen_backlog must be positive";
+    if (config.buffer_size < 1024) return "buffer_size must be at least 1024";
+    if (config.sendfile_chunk_size == 0) return "sendfile_chunk_size must be positive";
+    if (config.socket_send_buffer < 0) return "socket_send_buffer must not be negative";
+    if (config.music_dir.empty()) return "music_dir must not be empty";
+    if (config.io_uring_buffer_count == 0 || config.io_uring_buffer_count > 4096) return "io_uring_buffer_count must be between 1 and 4096";
+    if (config.io_uring_buffer_size < 4096 || config.io_uring_buffer_size > 16 * 1024 * 1024) return "io_uring_buffer_size must be between 4 KiB and 16 MiB";
+    if (config.hls_segment_seconds == 0 || config.hls_segment_seconds > 60) return "hls_segment_seconds must be between 1 and 60";
+    if (!config.cluster_self.empty()) {
+        if (std::find(config.cluster_nodes.begin(), config.cluster_nodes.end(), config.cluster_self) == config.cluster_nodes.end()) {
+            return "cluster_nodes must include cluster_self";
+        }
+        if (config.cluster_nodes.size() > 64) return "cluster_nodes must list at most 64 nodes";
+        for (const std::string& node : config.cluster_nodes) {
+            size_t colon = node.rfind(':');
+            if (colon == 0 || colon == std::string::npos || colon + 1 == node.size() ||
+                node.find_first_not_of("0123456789", colon + 1) != std::string::npos) {
+                return "cluster_nodes must be host:port";
+            }
+        }
+        if (std::set<std::string>(config.cluster_nodes.begin(), config.cluster_nodes.end()).size() != config.cluster_nodes.size()) {
+            return "cluster_nodes must not repeat a node";
+        }
+    }
+    if (config.cluster_virtual_nodes == 0 || config.cluster_virtual_nodes > 4096) return "cluster_virtual_nodes must be between 1 and 4096";
+    if (config.keepalive_timeout_seconds <= 0) return "keepalive_timeout_seconds must be positive";
+    if (config.max_keepalive_requests == 0) return "max_keepalive_requests must be positive";
+    if (config.request_header_timeout_seconds <= 0) return "request_header_timeout_seconds must be positive";
+    if (config.send_timeout_seconds <= 0) return "send_timeout_seconds must be positive";
+    // A wakeup never reports more sockets than the poller's event array holds
+    if (config.shed_queue_depth >= Poller::MAX_EVENTS) return "shed_queue_depth must be below 256";
+    if (!(config.stream_pacing_multiplier > 0)) return "stream_pacing_multiplier must be positive";
+    if (config.catalog_watch_debounce_ms < 0) return "catalog_watch_debounce_ms must not be negative";
+    if (config.catalog_query_gzip_level < 1 || config.catalog_query_gzip_level > 9) return "catalog_query_gzip_level must be between 1 and 9";
+    for (int quality : {config.catalog_query_brotli_quality, config.catalog_brotli_quality, config.description_brotli_quality}) {
+        if (quality < 0 || quality > 11) return "Brotli qualities must be between 0 and 11";
+    }
+    if (config.cluster_poll_interval_ms <= 0) return "cluster_poll_interval_ms must be positive";
+    if (config.cluster_peer_timeout_ms <= 0) return "cluster_peer_timeout_ms must be positive";
+    if (config.shutdown_drain_seconds < 0) return "shutdown_drain_seconds must not be negative";
+    if (config.restart_ready_timeout_seconds <= 0) return "restart_ready_timeout_seconds must be positive";
+    if (config.debug_access != "off" && config.debug_access != "loopback" && config.debug_access != "any") {
+        return "debug_access must be off, loopback or any";
+    }
+    if (config.profile_max_seconds == 0 || config.profile_max_seconds > 600) return "profile_max_seconds must be between 1 and 600";
+    if (config.profile_sample_hz == 0 || config.profile_sample_hz > 1000) return "profile_sample_hz must be between 1 and 1000";
+    if (config.background_threads == 0) return "background_threads must be positive";
+    if (config.search_max_limit == 0) return "search_max_limit must be positive";
+    if (config.catalog_query_max_limit == 0) return "catalog_query_max_limit must be positive";
+    if (!parseLogLevel(config.log_level, level)) return "log_level must be debug, info, warning, error or off";
+    return nullptr;
+}
+
+// Function to carry the running start-up-only settings over into a reloaded configuration,
+// warning about any the file tried to change
+void keepStartupSettings(ServerConfig& next, const ServerConfig& running) {
+    auto keep = [](const char* key, auto& value, const auto& running_value) {
+        if (value != running_value) {
+            logMessage(LogLevel::Warning, "Config: %s changes take effect after a restart", key);
+            value = running_value;
+        }
+    };
+    keep("port", next.port, running.port);
+    keep("listen_backlog", next.listen_backlog, running.listen_backlog);
+    keep("worker_threads", next.worker_threads, running.worker_threads);
+    keep("background_threads", next.background_threads, running.background_threads);
+    keep("reuse_port", next.reuse_port, running.reuse_port);
+    keep("pin_event_loops", next.pin_event_loops, running.pin_event_loops);
+    keep("buffer_size", next.buffer_size, running.buffer_size);
+    keep("sendfile_chunk_size", next.sendfile_chunk_size, running.sendfile_chunk_size);
+    keep("socket_send_buffer", next.socket_send_buffer, running.socket_send_buffer);
+    keep("music_dir", next.music_dir, running.music_dir);
+    keep("file_cache_max_handles", next.file_cache_max_handles, running.file_cache_max_handles);
+    keep("hot_cache_budget_bytes", next.hot_cache_budget_bytes, running.hot_cache_budget_bytes);
+    keep("hot_track_threshold", next.hot_track_threshold, running.hot_track_threshold);
+    keep("description_cache_budget_bytes", next.description_cache_budget_bytes, running.description_cache_budget_bytes);
+    keep("max_client_bytes_per_second", next.max_client_bytes_per_second, running.max_client_bytes_per_second);
+    keep("max_total_bytes_per_second", next.max_total_bytes_per_second, running.max_total_bytes_per_second);
+    keep("io_uring_file_reads", next.io_uring_file_reads, running.io_uring_file_reads);
+    keep("io_uring_buffer_count", next.io_uring_buffer_count, running.io_uring_buffer_count);
+    keep("io_uring_buffer_size", next.io_uring_buffer_size, running.io_uring_buffer_size);
+    keep("hls_segment_seconds", next.hls_segment_seconds, running.hls_segment_seconds);
+    keep("hls_cache_budget_bytes", next.hls_cache_budget_bytes, running.hls_cache_budget_bytes);
+    keep("cluster_self", next.cluster_self, running.cluster_self);
+    keep("cluster_nodes", next.cluster_nodes, running.cluster_nodes);
+    keep("cluster_virtual_nodes", next.cluster_virtual_nodes, running.cluster_virtual_nodes);
+}
+
+}
+
+bool loadServerConfig(const std::string& path, bool required, std::string& error) {
+    std::lock_guard<std::mutex> lock(load_mutex);
+    loaded_path = path;
+    loaded_path_required = required;
+
+    auto config = std::make_shared<ServerConfig>();
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        if (required) {
+            error = "Cannot open " + path;
+            return false;
+        }
+        // No file: the defaults, which on a reload also means undoing earlier overrides
+    } else {
+        try {
+            json document = json::parse(file, nullptr, true, true);  // comments allowed
+            if (!document.is_object()) {
+                throw std::runtime_error("top level must be an object");
+            }
+            ConfigReader reader(document);
+            readConfig(reader, *config);
+            for (const std::string& key : reader.unknownKeys()) {
+                logMessage(LogLevel::Warning, "Config: ignoring unknown setting %s in %s", key.c_str(), path.c_str());
+            }
+        } catch (const std::exception& e) {
+            error = path + ": " + e.what();
+            return false;
+        }
+    }
+
+    if (const char* invalid = validateConfig(*config)) {
+        error = path + ": " + invalid;
+        return false;
+    }
+    if (started) {
+        keepStartupSettings(*config, *currentConfig());
+    }
+    started = true;
+
+    LogLevel level;
+    parseLogLevel(config->log_level, level);
+    setLogLevel(level);
+    current_config.store(std::move(config));
+    return true;
+}
+
+void reloadServerConfig() {
+    std::string path;
+    bool required;
+    {
+        std::lock_guard<std::mutex> lock(load_mutex);
+        path = loaded_path;
+        required = loaded_path_required;
+    }
+
+    std::string error;
+    if (loadServerConfig(path, required, error)) {
+        logMessage(LogLevel::Info, "Config reloaded from %s", path.c_str());
+    } else {
+        logMessage(LogLevel::Error, "Config reload failed, keeping the current settings: %s", error.c_str());
+    }
+}
@@ -1,7 +1,92 @@
 #pragma once
 
-// Server configuration - One day we will have a config file for this but for now will just hard code it into the executeable :/
-const int PORT = 8080;
-const size_t BUFFER_SIZE = 8192;
-const std::u8string MUSIC_DIR = u8"music/";  
-const std::u8string DESCRIPTION_EXT = u8".json";
\ No newline at end of file
+#include <string>
+#include <vector>
+
+// Server configuration. Every setting has a compiled-in default that a JSON config file can
+// override (server.json, or the file given with --config), using the field names below as keys.
+// Settings in the first group are read once at start-up and only change on a restart; the rest
+// take effect for new work whenever the file is reloaded (SIGHUP or /reload).
+struct ServerConfig {
+    // -- Start-up only --
+    int port = 8080;
+    int listen_backlog = 511;  // pending connections the kernel queues for accept()
+    unsigned worker_threads = 0;  // event loop threads, 0 = one per hardware thread
+    unsigned background_threads = 2;  // threads reading and compressing files the caches miss, off the event loops
+    bool reuse_port = true;  // one SO_REUSEPORT listener per event loop where the kernel balances them (Linux)
+    bool pin_event_loops = true;  // run each event loop thread on its own CPU (Linux)
+    size_t buffer_size = 8192;  // per-connection request buffer and read-fallback chunk; also the request head limit
+    size_t sendfile_chunk_size = 512 * 1024;  // max bytes per sendfile() call, keeps one stream from hogging a loop
+    int socket_send_buffer = 0;  // SO_SNDBUF for client sockets in bytes, 0 = the OS default (autotuned on Linux)
+    std::u8string music_dir = u8"music/";
+    size_t file_cache_max_handles = 1024;  // open track/description files kept for reuse
+    uint64_t hot_cache_budget_bytes = 256ull * 1024 * 1024;  // memory-mapped hot tracks (platforms without sendfile)
+    unsigned hot_track_threshold = 8;  // cache hits before a file counts as hot
+    uint64_t description_cache_budget_bytes = 64ull * 1024 * 1024;  // sidecars kept in memory with their compressed variants
+    uint64_t max_client_bytes_per_second = 0;  // file bytes per second per client address, 0 = no cap
+    uint64_t max_total_bytes_per_second = 0;  // file bytes per second for the whole server, 0 = no cap
+    bool io_uring_file_reads = false;  // read file bodies through io_uring instead of sendfile(), so a cold disk stalls no loop (Linux)
+    unsigned io_uring_buffer_count = 64;  // registered read buffers per event loop, i.e. file reads in flight at once
+    size_t io_uring_buffer_size = 128 * 1024;  // bytes per read buffer, and so per file read
+    unsigned hls_segment_seconds = 6;  // length of /hls media segments; cut at the first frame boundary after each multiple
+    uint64_t hls_cache_budget_bytes = 16ull * 1024 * 1024;  // segment cuts and playlists kept in memory
+    std::string cluster_self;  // this node's "host:port" as listed in cluster_nodes; empty = not clustered
+    std::vector<std::string> cluster_nodes;  // every node's "host:port", in the same order on every node
+    unsigned cluster_virtual_nodes = 128;  // points per node on the consistent-hash ring
+
+    // -- Reloadable --
+    int keepalive_timeout_seconds = 15;  // idle persistent connections are closed after this long
+    unsigned max_keepalive_requests = 100;  // requests served on one connection before it is closed
+    int request_header_timeout_seconds = 10;  // a request still incomplete this long after its first byte is answered 408
+    int send_timeout_seconds = 60;  // a response that makes no write progress for this long is dropped
+    unsigned max_connections = 10000;  // open client connections, 0 = no cap; more are answered 503 and closed
+    unsigned max_connections_per_ip = 0;  // open connections from one client address, 0 = no cap
+    unsigned shed_queue_depth = 0;  // turn requests away with 503 while a loop wakes to more ready sockets than this, 0 = off; below 256
+    unsigned shed_loop_lag_ms = 0;  // likewise while a loop's smoothed time per wakeup is above this, 0 = off
+    unsigned retry_after_seconds = 5;  // Retry-After of those 503s
+    bool stream_pacing_enabled = true;  // shape /stream responses to a multiple of the track's bitrate
+    double stream_pacing_multiplier = 2.0;  // paced rate relative to the bitrate
+    uint64_t stream_pacing_burst_bytes = 2 * 1024 * 1024;  // sent unpaced first so players can fill their buffer
+    int catalog_watch_debounce_ms = 250;  // quiet period before file system changes are applied to the catalog; a busy directory waits at most 10 of these
+    size_t catalog_query_gzip_min_bytes = 1024;  // filtered /catalog pages smaller than this are sent uncompressed
+    int catalog_query_gzip_level = 6;  // per-request compression, so faster than the full catalog's level 9
+    int catalog_query_brotli_quality = 5;  // per-request too; still smaller than gzip at level 9
+    size_t catalog_query_default_limit = 100;  // filtered /catalog tracks per page when the request gives no limit
+    size_t catalog_query_max_limit = 1000;  // largest filtered /catalog page served
+    int catalog_brotli_quality = 9;  // full catalog, compressed once per generation on the reload thread
+    int description_brotli_quality = 9;  // compressed once per change; 10 and 11 are ~40x slower for a few bytes
+    uint64_t description_cache_max_file_bytes = 256 * 1024;  // larger sidecars are streamed from disk uncompressed
+    unsigned stream_max_age_seconds = 3600;  // Cache-Control max-age of /stream responses, 0 = revalidate every time
+    unsigned description_max_age_seconds = 300;  // likewise for /description
+    size_t search_default_limit = 20;  // /search results per page when the request gives no limit
+    size_t search_max_limit = 200;  // largest /search page served
+    int cluster_poll_interval_ms = 2000;  // how often peers' catalogs are checked for a new generation
+    int cluster_peer_timeout_ms = 2000;  // connect and transfer timeout of one peer catalog fetch
+    int shutdown_drain_seconds = 30;  // on SIGTERM or a restart, how long responses in flight may take to finish
+    int restart_ready_timeout_seconds = 60;  // how long a restart waits for the new process to start accepting
+    unsigned slow_request_ms = 0;  // trace requests and keep those whose parse and handler time reach this, 0 = off
+    std::string debug_access = "off";  // who may use /debug/profile and /debug/slow: off, loopback or any
+    unsigned profile_max_seconds = 60;  // longest /debug/profile run
+    unsigned profile_sample_hz = 99;  // /debug/profile stack samples per CPU second, off a round number so it doesn't beat with timers
+    std::string log_level = "info";  // debug, info, warning, error or off
+
+    // Persistent catalog index, rebuilt when stale
+    std::u8string catalogIndexPath() const { return music_dir + u8".catalog.idx"; }
+};
+
+// Fixed at build time
+const std::u8string DESCRIPTION_EXT = u8".json";
+const char* const DEFAULT_CONFIG_PATH = "server.json";
+const size_t LOG_QUEUE_CAPACITY = 4096;  // records buffered for the log writer (power of two); overflow is dropped
+
+// The configuration in effect; defaults until loadServerConfig() succeeds. Like a catalog
+// snapshot, the returned object never changes, so take it once per request for a consistent view.
+std::shared_ptr<const ServerConfig> currentConfig();
+
+// Function to read path and make it the configuration in effect. A missing file at the default
+// path just means defaults; anything else that goes wrong is reported in error and leaves the
+// current configuration in place. On a reload, start-up-only settings keep their running values.
+bool loadServerConfig(const std::string& path, bool required, std::string& error);
+
+// Function to re-read the file last given to loadServerConfig(), logging the outcome
+void reloadServerConfig();
@@ -1,12 +1,33 @@
 #pragma once
 
-// Track information structure
+#include "Media/Mp3.h"
+
+// Identity of a file on disk; a track is re-parsed when any of it changes
+struct FileStamp {
+    bool exists = false;
+    int64_t mtime = 0;  // file_time_type ticks
+    uint64_t size = 0;
+
+    bool operator==(const FileStamp& other) const {
+        return exists == other.exists && mtime == other.mtime && size == other.size;
+    }
+
+    static FileStamp of(const std::filesystem::path& path);
+
+    // mtime as a Unix time in seconds, e.g. for Last-Modified
+    int64_t modifiedSeconds() const;
+};
+
+// Track information as loaded from disk; published catalogs keep it compactly in a TrackTable
 struct TrackInfo {
     std::u8string id;
     std::u8string title;
     std::u8string artist;
     std::u8string album;
-    int duration;  // in seconds
+    int duration;  // in seconds; from the sidecar, or measured from the mp3 when it gives none
     std::u8string filepath;
     std::u8string description_path;
+    FileStamp file_stamp;         // of filepath when the track was loaded
+    FileStamp description_stamp;  // of description_path when it was parsed
+    Mp3SeekIndex seek_index;      // for ?t= seeks; invalid if the file couldn't be indexed
 };
\ No newline at end of file
@@ -0,0 +1,71 @@
+#include "pch.h"
+#include "Utils/Arena.h"
+
+#include <new>
+
+Arena::Arena(size_t block_size, size_t max_retained_blocks)
+    : block_size(block_size), max_retained_blocks(std::max<size_t>(1, max_retained_blocks)) {
+}
+
+Arena::~Arena() {
+    for (const Block& block : blocks) {
+        ::operator delete(block.data);
+    }
+    for (const Block& block : oversized) {
+        ::operator delete(block.data);
+    }
+}
+
+void Arena::reset() {
+    for (const Block& block : oversized) {
+        ::operator delete(block.data);
+    }
+    oversized.clear();
+    while (blocks.size() > max_retained_blocks) {
+        ::operator delete(blocks.back().data);
+        blocks.pop_back();
+    }
+    current = 0;
+    used = 0;
+}
+
+size_t Arena::capacity() const {
+    size_t bytes = 0;
+    for (const Block& block : blocks) {
+        bytes += block.size;
+    }
+    for (const Block& block : oversized) {
+        bytes += block.size;
+    }
+    return bytes;
+}
+
+void* Arena::do_allocate(size_t bytes, size_t alignment) {
+    // Operator new returns memory aligned for any fundamental type, which covers everything allocated here
+    if (bytes + alignment > block_size / 4) {
+        // Large enough to waste much of a block: give it its own
+        char* data = static_cast<char*>(::operator new(bytes));
+        oversized.push_back({data, bytes});
+        return data;
+    }
+
+    while (current < blocks.size()) {
+        size_t aligned = (used + alignment - 1) & ~(alignment - 1);
+        if (aligned + bytes <= blocks[current].size) {
+            used = aligned + bytes;
+            return blocks[current].data + aligned;
+        }
+        current++;
+        used = 0;
+    }
+
+    blocks.push_back({static_cast<char*>(::operator new(block_size)), block_size});
+    current = blocks.size() - 1;
+    used = bytes;
+    return blocks[current].data;
+}
+
+Arena& requestArena() {
+    thread_local Arena arena;
+    return arena;
+}
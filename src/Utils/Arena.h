@@ -0,0 +1,45 @@
+#pragma once
+
+#include <memory_resource>
+
+// Bump allocator for data that lives no longer than one request.
+// Allocations are carved out of large blocks and never freed one by one; reset() makes all of it
+// reusable at once. Blocks are kept across resets (up to a limit, so one huge request doesn't pin
+// its memory), so once the arena has grown to its working size a request allocates nothing from
+// the heap. A std::pmr::memory_resource, so std::pmr containers and strings can live in it.
+// Not thread-safe; each thread has its own, see requestArena().
+class Arena : public std::pmr::memory_resource {
+public:
+    explicit Arena(size_t block_size = 64 * 1024, size_t max_retained_blocks = 4);
+    ~Arena() override;
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // Forget every allocation; anything still pointing into the arena is invalid afterwards
+    void reset();
+
+    // Bytes held in blocks, used or not
+    size_t capacity() const;
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void*, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    struct Block {
+        char* data;
+        size_t size;
+    };
+    std::vector<Block> blocks;     // standard-sized blocks, reused in order
+    std::vector<Block> oversized;  // single allocations larger than a block, freed on reset()
+    size_t block_size;
+    size_t max_retained_blocks;
+    size_t current = 0;  // block being carved
+    size_t used = 0;     // bytes taken from it
+};
+
+// The calling thread's arena for request-lifetime data: strings and vectors a handler builds and
+// drops before it returns. The event loop resets it after every request, so nothing queued on the
+// connection (which outlives the handler) may be allocated here.
+Arena& requestArena();
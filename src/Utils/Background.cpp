@@ -0,0 +1,65 @@
+#include "pch.h"
+#include "Utils/Background.h"
+#include "Utils/Logger.h"
+
+#include <condition_variable>
+#include <deque>
+
+namespace {
+
+std::mutex queue_mutex;
+std::condition_variable queue_cv;
+std::deque<std::function<void()>> jobs;
+std::vector<std::thread> workers;
+bool stopping = false;
+
+void workerLoop() {
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_cv.wait(lock, [] { return stopping || !jobs.empty(); });
+            if (jobs.empty()) {
+                return;  // stopping, and nothing left to run
+            }
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        try {
+            job();
+        }
+        catch (const std::exception& e) {
+            logMessage(LogLevel::Error, "Background job failed: %s", e.what());
+        }
+    }
+}
+
+}
+
+void startBackgroundWorkers(unsigned count) {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    stopping = false;
+    for (unsigned i = 0; i < count; ++i) {
+        workers.emplace_back(workerLoop);
+    }
+}
+
+void stopBackgroundWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stopping = true;
+    }
+    queue_cv.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+}
+
+void runInBackground(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        jobs.push_back(std::move(job));
+    }
+    queue_cv.notify_one();
+}
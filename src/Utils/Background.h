@@ -0,0 +1,17 @@
+#pragma once
+
+#include <functional>
+
+// Worker threads for the work a request handler mustn't do on its event loop, such as reading and
+// compressing a file a cache has no copy of yet. The handler defers its response (Connection::defer),
+// queues a job that does the work and completes the response, and the loop carries on meanwhile.
+// Jobs run in the order they were queued, each on whichever worker is free.
+
+// Function to start count worker threads; call before the event loops start
+void startBackgroundWorkers(unsigned count);
+
+// Function to run the jobs still queued and stop the workers; call once the event loops have stopped
+void stopBackgroundWorkers();
+
+// Function to queue job for a worker. Jobs queued while no workers run wait for startBackgroundWorkers().
+void runInBackground(std::function<void()> job);
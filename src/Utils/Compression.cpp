@@ -0,0 +1,108 @@
+#include "pch.h"
+#include "Utils/Compression.h"
+
+#ifdef SERVER_HAS_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef SERVER_HAS_BROTLI
+#include <brotli/encode.h>
+#endif
+
+bool gzipAvailable() {
+#ifdef SERVER_HAS_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool gzipCompress(std::string_view input, std::string& output, int level) {
+#ifdef SERVER_HAS_ZLIB
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+
+    // windowBits 15 + 16 selects the gzip wrapper instead of raw zlib
+    if (deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+
+    output.resize(deflateBound(&stream, static_cast<uLong>(input.size())));
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    stream.avail_in = static_cast<uInt>(input.size());
+    stream.next_out = reinterpret_cast<Bytef*>(output.data());
+    stream.avail_out = static_cast<uInt>(output.size());
+
+    int result = deflate(&stream, Z_FINISH);
+    output.resize(stream.total_out);
+    deflateEnd(&stream);
+    return result == Z_STREAM_END;
+#else
+    (void)input;
+    (void)output;
+    (void)level;
+    return false;
+#endif
+}
+
+bool brotliAvailable() {
+#ifdef SERVER_HAS_BROTLI
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool brotliCompress(std::string_view input, std::string& output, int quality) {
+#ifdef SERVER_HAS_BROTLI
+    size_t size = BrotliEncoderMaxCompressedSize(input.size());
+    if (size == 0) {
+        return false;  // input too large for the encoder
+    }
+    // A window no larger than the input; small bodies compress many times faster with a small one
+    int window = BROTLI_MIN_WINDOW_BITS;
+    while (window < BROTLI_MAX_WINDOW_BITS && (size_t(1) << window) < input.size()) {
+        window++;
+    }
+    output.resize(size);
+    if (!BrotliEncoderCompress(quality, window, BROTLI_MODE_TEXT, input.size(),
+                               reinterpret_cast<const uint8_t*>(input.data()), &size,
+                               reinterpret_cast<uint8_t*>(output.data()))) {
+        return false;
+    }
+    output.resize(size);
+    return true;
+#else
+    (void)input;
+    (void)output;
+    (void)quality;
+    return false;
+#endif
+}
+
+size_t PrecompressedBody::memoryUsage() const {
+    return (identity ? identity->capacity() : 0) + (gzip ? gzip->capacity() : 0) + (brotli ? brotli->capacity() : 0);
+}
+
+PrecompressedBody precompress(std::string body, int gzip_level, int brotli_quality) {
+    PrecompressedBody result;
+    // Below about 1/16 smaller the saved bytes don't pay for the client's decompression
+    auto compressed = [&body](bool ok, std::string& output) -> std::shared_ptr<const std::string> {
+        if (!ok || output.size() + output.size() / 16 >= body.size()) {
+            return nullptr;
+        }
+        output.shrink_to_fit();
+        return std::make_shared<const std::string>(std::move(output));
+    };
+
+    std::string output;
+    if (gzipAvailable()) {
+        result.gzip = compressed(gzipCompress(body, output, gzip_level), output);
+    }
+    output = std::string();
+    if (brotliAvailable()) {
+        result.brotli = compressed(brotliCompress(body, output, brotli_quality), output);
+    }
+    result.identity = std::make_shared<const std::string>(std::move(body));
+    return result;
+}
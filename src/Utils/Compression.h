@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string_view>
+
+// True if the build links zlib and gzipCompress can produce output
+bool gzipAvailable();
+
+// Compress input into a complete gzip stream; returns false if compression is unavailable or fails
+bool gzipCompress(std::string_view input, std::string& output, int level = 9);
+
+// True if the build links the Brotli encoder and brotliCompress can produce output
+bool brotliAvailable();
+
+// Compress input into a complete Brotli stream (quality 0-11); returns false if unavailable or it fails
+bool brotliCompress(std::string_view input, std::string& output, int quality = 11);
+
+// A response body with its compressed variants, built once and then shared by every request for it
+struct PrecompressedBody {
+    std::shared_ptr<const std::string> identity;
+    std::shared_ptr<const std::string> gzip;    // null when unavailable or not worth it
+    std::shared_ptr<const std::string> brotli;  // likewise
+
+    size_t memoryUsage() const;
+};
+
+// Compress body with every available coding; a variant is kept only if it is meaningfully smaller
+PrecompressedBody precompress(std::string body, int gzip_level, int brotli_quality);
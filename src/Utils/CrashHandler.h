@@ -28,7 +28,7 @@ namespace Paingine2D {
 
     class CrashHandler {
     private:
-        static CrashHandler* s_instance;
+        static inline CrashHandler* s_instance = nullptr;
         std::string m_applicationName;
         std::string m_crashReportFolder;
 
@@ -131,6 +131,20 @@ namespace Paingine2D {
 #endif
         }
 
+        // Capture the return addresses on the calling thread's stack, innermost first, and return how
+        // many were stored. It allocates nothing, so a signal handler may call it (the profiler's timer
+        // does) once it has been called outside of one: the first call loads the unwinder.
+        // Always inlined, so the caller's own frame is the first one captured.
+#ifdef _WIN32
+        static __forceinline int CaptureStackTrace(void** frames, int maxFrames) {
+            return CaptureStackBackTrace(0, static_cast<DWORD>(maxFrames), frames, NULL);
+        }
+#else
+        static inline __attribute__((always_inline)) int CaptureStackTrace(void** frames, int maxFrames) {
+            return backtrace(frames, maxFrames);
+        }
+#endif
+
     private:
         std::string GenerateCrashReportPath() {
             // Generate a filename with timestamp
@@ -433,7 +447,7 @@ namespace Paingine2D {
             const int MAX_STACK_FRAMES = 64;
             void* stack[MAX_STACK_FRAMES];
 
-            int frames = backtrace(stack, MAX_STACK_FRAMES);
+            int frames = CaptureStackTrace(stack, MAX_STACK_FRAMES);
             char** symbols = backtrace_symbols(stack, frames);
 
             logFile << "Stack trace:" << std::endl;
@@ -471,7 +485,7 @@ namespace Paingine2D {
             }
         }
 
-        static void UnixSignalHandler(int signal, siginfo_t* info, void* context) {
+        static void UnixSignalHandler(int signal, siginfo_t* info, void* /*context*/) {
             CrashHandler* handler = CrashHandler::GetInstance();
 
             // Generate the crash report path
@@ -485,13 +499,10 @@ namespace Paingine2D {
                 << crashReportPath << ".log" << std::endl;
 
             // Restore default handler and re-raise signal
-            signal(signal, SIG_DFL);
+            ::signal(signal, SIG_DFL);
             raise(signal);
         }
 #endif
     };
 
-    // Initialize static member
-    CrashHandler* CrashHandler::s_instance = nullptr;
-
 } // namespace Paingine
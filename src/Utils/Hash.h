@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string_view>
+
+// Hash for unordered containers keyed by std::string that can be probed with a string_view
+// (with std::equal_to<>), so a lookup doesn't have to build a temporary key
+struct StringHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view value) const { return std::hash<std::string_view>()(value); }
+};
+
+// 64-bit FNV-1a hash; cheap, stable across runs and platforms
+inline uint64_t fnv1aHash(std::string_view data, uint64_t hash = 14695981039346656037ull) {
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
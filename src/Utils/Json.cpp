@@ -0,0 +1,80 @@
+#include "pch.h"
+#include "Utils/Json.h"
+
+// Length of the valid UTF-8 sequence starting at bytes[0], or 0 if it isn't one
+static size_t utf8SequenceLength(const unsigned char* bytes, size_t available) {
+    unsigned char lead = bytes[0];
+    size_t length;
+    unsigned char min_second = 0x80, max_second = 0xBF;  // narrower after some leads, to reject overlongs and surrogates
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        length = 2;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        length = 3;
+        if (lead == 0xE0) min_second = 0xA0;
+        if (lead == 0xED) max_second = 0x9F;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        length = 4;
+        if (lead == 0xF0) min_second = 0x90;
+        if (lead == 0xF4) max_second = 0x8F;
+    } else {
+        return 0;
+    }
+
+    if (available < length || bytes[1] < min_second || bytes[1] > max_second) {
+        return 0;
+    }
+    for (size_t i = 2; i < length; ++i) {
+        if ((bytes[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+    }
+    return length;
+}
+
+void appendJsonString(std::string& out, std::string_view value) {
+    static const char hex[] = "0123456789abcdef";
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(value.data());
+    size_t length = value.size();
+
+    out.reserve(out.size() + length + 2);
+    out += '"';
+    size_t run_start = 0;  // plain bytes are copied in runs rather than one at a time
+    for (size_t i = 0; i < length;) {
+        unsigned char c = bytes[i];
+        if (c >= 0x20 && c != '"' && c != '\\' && c < 0x80) {
+            ++i;
+            continue;
+        }
+        if (c >= 0x80) {
+            size_t sequence = utf8SequenceLength(bytes + i, length - i);
+            if (sequence > 0) {
+                i += sequence;
+                continue;
+            }
+        }
+
+        out.append(value.data() + run_start, i - run_start);
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    out += "\\u00";
+                    out += hex[c >> 4];
+                    out += hex[c & 0xF];
+                } else {
+                    out += "\xEF\xBF\xBD";  // U+FFFD for a byte that doesn't start valid UTF-8
+                }
+                break;
+        }
+        ++i;
+        run_start = i;
+    }
+    out.append(value.data() + run_start, length - run_start);
+    out += '"';
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <string_view>
+
+// Append value to out as a quoted JSON string, escaped the way nlohmann::json::dump() does it
+// (short escapes where JSON has them, \u00XX for other control characters, UTF-8 kept as is).
+// Invalid UTF-8 is replaced with U+FFFD rather than producing a document clients can't parse.
+void appendJsonString(std::string& out, std::string_view value);
@@ -0,0 +1,289 @@
+#include "pch.h"
+#include "ServerConfig.h"
+#include "Utils/Logger.h"
+
+#include <cstdarg>
+#include <ctime>
+
+namespace {
+
+enum class RecordKind { Message, Access };
+
+struct LogRecord {
+    RecordKind kind;
+    LogLevel level;
+    std::chrono::system_clock::time_point time;
+
+    // Access fields
+    int status;
+    bool completed;
+    uint64_t bytes;
+    uint64_t duration_us;
+    char client_ip[48];
+    char method[16];
+
+    char text[320];  // message, or request target for access records
+};
+
+// Bounded multi-producer queue (Vyukov): each slot's sequence number says whether it is free
+// for the producer at that position or holds a record for the consumer
+struct Slot {
+    std::atomic<size_t> sequence;
+    LogRecord record;
+};
+
+static_assert((LOG_QUEUE_CAPACITY & (LOG_QUEUE_CAPACITY - 1)) == 0, "LOG_QUEUE_CAPACITY must be a power of two");
+
+class LogQueue {
+public:
+    LogQueue() : slots(new Slot[LOG_QUEUE_CAPACITY]) {
+        for (size_t i = 0; i < LOG_QUEUE_CAPACITY; ++i) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Claim a free slot, or nullptr if the queue is full. The caller fills it, then calls publish().
+    Slot* claim() {
+        size_t position = enqueue_position.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots[position & (LOG_QUEUE_CAPACITY - 1)];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (difference == 0) {
+                if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    return &slot;
+                }
+            } else if (difference < 0) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            } else {
+                position = enqueue_position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void publish(Slot* slot) {
+        size_t position = slot->sequence.load(std::memory_order_relaxed);
+        slot->sequence.store(position + 1, std::memory_order_release);
+    }
+
+    // Single consumer: the writer thread
+    const LogRecord* peek() {
+        Slot& slot = slots[dequeue_position & (LOG_QUEUE_CAPACITY - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != dequeue_position + 1) {
+            return nullptr;
+        }
+        return &slot.record;
+    }
+
+    void pop() {
+        Slot& slot = slots[dequeue_position & (LOG_QUEUE_CAPACITY - 1)];
+        slot.sequence.store(dequeue_position + LOG_QUEUE_CAPACITY, std::memory_order_release);
+        dequeue_position++;
+    }
+
+    std::atomic<uint64_t> dropped{0};
+
+private:
+    std::unique_ptr<Slot[]> slots;
+    alignas(64) std::atomic<size_t> enqueue_position{0};
+    alignas(64) size_t dequeue_position = 0;
+};
+
+LogQueue& queue() {
+    static LogQueue instance;
+    return instance;
+}
+
+std::atomic<int> minimum_level{static_cast<int>(LogLevel::Info)};
+std::atomic<bool> writer_running{false};
+std::thread writer_thread;
+
+const char* levelName(LogLevel level) {
+    switch (level) {
+        case LogLevel::Debug: return "debug";
+        case LogLevel::Info: return "info";
+        case LogLevel::Warning: return "warning";
+        case LogLevel::Error: return "error";
+        default: return "off";
+    }
+}
+
+void copyField(char* destination, size_t capacity, std::string_view value) {
+    size_t length = std::min(value.size(), capacity - 1);
+    memcpy(destination, value.data(), length);
+    destination[length] = '\0';
+}
+
+// Quoted logfmt value
+void appendQuoted(std::string& out, const char* value) {
+    out += '"';
+    for (const char* c = value; *c; ++c) {
+        if (*c == '"' || *c == '\\') {
+            out += '\\';
+        }
+        out += (*c == '\n' || *c == '\r') ? ' ' : *c;
+    }
+    out += '"';
+}
+
+void appendTimestamp(std::string& out, std::chrono::system_clock::time_point time) {
+    time_t seconds = std::chrono::system_clock::to_time_t(time);
+    int millis = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count() % 1000);
+    std::tm utc;
+#ifdef _WIN32
+    gmtime_s(&utc, &seconds);
+#else
+    gmtime_r(&seconds, &utc);
+#endif
+    char buffer[32];
+    size_t length = strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &utc);
+    snprintf(buffer + length, sizeof(buffer) - length, ".%03dZ", millis);
+    out += buffer;
+}
+
+void formatRecord(std::string& out, const LogRecord& record) {
+    out += "ts=";
+    appendTimestamp(out, record.time);
+    out += " level=";
+    out += levelName(record.level);
+    if (record.kind == RecordKind::Access) {
+        char numbers[128];
+        snprintf(numbers, sizeof(numbers), " status=%d bytes=%llu duration_us=%llu completed=%s", record.status,
+                 static_cast<unsigned long long>(record.bytes), static_cast<unsigned long long>(record.duration_us),
+                 record.completed ? "true" : "false");
+        out += " event=access client=";
+        out += record.client_ip;
+        out += " method=";
+        out += record.method;
+        out += " path=";
+        appendQuoted(out, record.text);
+        out += numbers;
+    } else {
+        out += " msg=";
+        appendQuoted(out, record.text);
+    }
+    out += '\n';
+}
+
+// Write out everything currently queued; returns false if there was nothing
+bool drainQueue(std::string& out, uint64_t& reported_drops) {
+    out.clear();
+    const LogRecord* record;
+    while ((record = queue().peek()) != nullptr && out.size() < 64 * 1024) {
+        formatRecord(out, *record);
+        queue().pop();
+    }
+
+    uint64_t dropped = queue().dropped.load(std::memory_order_relaxed);
+    if (dropped != reported_drops) {
+        out += "ts=";
+        appendTimestamp(out, std::chrono::system_clock::now());
+        out += " level=warning msg=\"" + std::to_string(dropped - reported_drops) + " log records dropped\"\n";
+        reported_drops = dropped;
+    }
+
+    if (out.empty()) {
+        return false;
+    }
+    fwrite(out.data(), 1, out.size(), stdout);
+    fflush(stdout);
+    return true;
+}
+
+void writerLoop() {
+    std::string out;
+    uint64_t reported_drops = 0;
+    while (writer_running.load(std::memory_order_relaxed)) {
+        if (!drainQueue(out, reported_drops)) {
+            // Nothing to write; producers never signal, so poll at a rate that keeps the log current
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+    while (drainQueue(out, reported_drops)) {
+    }
+}
+
+}
+
+void startLogger() {
+    if (writer_running.exchange(true)) {
+        return;
+    }
+    writer_thread = std::thread(writerLoop);
+}
+
+void stopLogger() {
+    if (!writer_running.exchange(false)) {
+        return;
+    }
+    writer_thread.join();
+}
+
+bool parseLogLevel(std::string_view name, LogLevel& level) {
+    for (LogLevel candidate : {LogLevel::Debug, LogLevel::Info, LogLevel::Warning, LogLevel::Error, LogLevel::Off}) {
+        if (name == levelName(candidate)) {
+            level = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void setLogLevel(LogLevel level) {
+    minimum_level.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+bool logEnabled(LogLevel level) {
+    return level != LogLevel::Off && static_cast<int>(level) >= minimum_level.load(std::memory_order_relaxed);
+}
+
+void logMessage(LogLevel level, const char* format, ...) {
+    if (!logEnabled(level)) {
+        return;
+    }
+    Slot* slot = queue().claim();
+    if (!slot) {
+        return;
+    }
+
+    LogRecord& record = slot->record;
+    record.kind = RecordKind::Message;
+    record.level = level;
+    record.time = std::chrono::system_clock::now();
+    va_list args;
+    va_start(args, format);
+    vsnprintf(record.text, sizeof(record.text), format, args);
+    va_end(args);
+
+    queue().publish(slot);
+}
+
+void logAccess(std::string_view client_ip, std::string_view method, std::string_view target, int status,
+               uint64_t bytes, uint64_t duration_us, bool completed) {
+    if (!logEnabled(LogLevel::Info)) {
+        return;
+    }
+    Slot* slot = queue().claim();
+    if (!slot) {
+        return;
+    }
+
+    LogRecord& record = slot->record;
+    record.kind = RecordKind::Access;
+    record.level = LogLevel::Info;
+    record.time = std::chrono::system_clock::now();
+    record.status = status;
+    record.completed = completed;
+    record.bytes = bytes;
+    record.duration_us = duration_us;
+    copyField(record.client_ip, sizeof(record.client_ip), client_ip);
+    copyField(record.method, sizeof(record.method), method);
+    copyField(record.text, sizeof(record.text), target);
+
+    queue().publish(slot);
+}
+
+uint64_t droppedLogRecords() {
+    return queue().dropped.load(std::memory_order_relaxed);
+}
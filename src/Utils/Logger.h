@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string_view>
+
+// Asynchronous logger. Producers format into a slot of a fixed-size lock-free ring and return;
+// a background thread turns the records into logfmt lines on stdout. When the ring is full the
+// record is dropped and counted rather than making the caller wait.
+
+enum class LogLevel {
+    Debug,
+    Info,
+    Warning,
+    Error,
+    Off
+};
+
+#if defined(__GNUC__)
+#define LOG_PRINTF_FORMAT(format_index, args_index) __attribute__((format(printf, format_index, args_index)))
+#else
+#define LOG_PRINTF_FORMAT(format_index, args_index)
+#endif
+
+// Function to start the writer thread; records logged before this are kept until it runs
+void startLogger();
+
+// Function to write out everything queued and stop the writer thread
+void stopLogger();
+
+// "debug", "info", "warning", "error" or "off"; returns false for anything else
+bool parseLogLevel(std::string_view name, LogLevel& level);
+void setLogLevel(LogLevel level);
+bool logEnabled(LogLevel level);
+
+// printf-style message, truncated to the slot size
+void logMessage(LogLevel level, const char* format, ...) LOG_PRINTF_FORMAT(2, 3);
+
+// One access log line for a finished (or aborted) response, at Info level
+void logAccess(std::string_view client_ip, std::string_view method, std::string_view target, int status,
+               uint64_t bytes, uint64_t duration_us, bool completed);
+
+// Records dropped because the ring was full
+uint64_t droppedLogRecords();
@@ -0,0 +1,90 @@
+#include "pch.h"
+#include "Utils/MappedFile.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& path) {
+    close();
+
+#ifdef _WIN32
+    std::filesystem::path native_path(std::u8string(reinterpret_cast<const char8_t*>(path.c_str())));
+    file = CreateFileW(native_path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                       NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        close();
+        return false;
+    }
+    length = static_cast<size_t>(size.QuadPart);
+
+    if (length > 0) {
+        mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        address = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (!address) {
+            close();
+            return false;
+        }
+    }
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    length = static_cast<size_t>(st.st_size);
+
+    if (length > 0) {
+        void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            ::close(fd);
+            length = 0;
+            return false;
+        }
+        address = mapped;
+    }
+    // The mapping keeps its own reference to the file
+    ::close(fd);
+#endif
+
+    is_open = true;
+    return true;
+}
+
+void MappedFile::close() {
+#ifdef _WIN32
+    if (address) {
+        UnmapViewOfFile(address);
+    }
+    if (mapping) {
+        CloseHandle(mapping);
+    }
+    if (file != INVALID_HANDLE_VALUE) {
+        CloseHandle(file);
+    }
+    mapping = NULL;
+    file = INVALID_HANDLE_VALUE;
+#else
+    if (address) {
+        munmap(const_cast<void*>(address), length);
+    }
+#endif
+    address = nullptr;
+    length = 0;
+    is_open = false;
+}
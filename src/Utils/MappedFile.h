@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string_view>
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Map path; returns false if it can't be opened or mapped (an empty file maps to an empty view)
+    bool open(const std::string& path);
+    void close();
+
+    std::string_view data() const { return std::string_view(static_cast<const char*>(address), length); }
+    bool isOpen() const { return is_open; }
+
+private:
+    const void* address = nullptr;
+    size_t length = 0;
+    bool is_open = false;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#endif
+};
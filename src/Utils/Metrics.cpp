@@ -0,0 +1,259 @@
+#include "pch.h"
+#include "Utils/Metrics.h"
+
+namespace {
+
+constexpr size_t ENDPOINT_COUNT = static_cast<size_t>(Endpoint::Count);
+const char* const ENDPOINT_NAMES[ENDPOINT_COUNT] = {
+    "catalog", "description", "stream", "hls", "search", "cluster", "reload", "metrics", "debug", "shed", "not_found", "bad_request"
+};
+
+// Status codes the server sends; anything else is counted as "other"
+const int STATUS_CODES[] = {200, 202, 206, 304, 307, 400, 404, 409, 416, 431, 500, 501, 503};
+constexpr size_t STATUS_COUNT = sizeof(STATUS_CODES) / sizeof(STATUS_CODES[0]) + 1;
+
+size_t statusIndex(int status) {
+    for (size_t i = 0; i + 1 < STATUS_COUNT; ++i) {
+        if (STATUS_CODES[i] == status) {
+            return i;
+        }
+    }
+    return STATUS_COUNT - 1;
+}
+
+// Bucket upper bounds in seconds
+const double BUCKET_BOUNDS[] = {0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025,
+                                0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10};
+constexpr size_t BUCKET_COUNT = sizeof(BUCKET_BOUNDS) / sizeof(BUCKET_BOUNDS[0]) + 1;  // + Inf
+
+// Only the owning thread writes a shard; relaxed atomics just make concurrent scrapes well-defined
+void bump(std::atomic<uint64_t>& counter, uint64_t amount = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+struct Histogram {
+    std::atomic<uint64_t> buckets[BUCKET_COUNT] = {};
+    std::atomic<uint64_t> sum_ns{0};
+    std::atomic<uint64_t> count{0};
+
+    void observe(std::chrono::steady_clock::duration elapsed) {
+        uint64_t ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        double seconds = ns / 1e9;
+        size_t bucket = 0;
+        while (bucket + 1 < BUCKET_COUNT && seconds > BUCKET_BOUNDS[bucket]) {
+            bucket++;
+        }
+        bump(buckets[bucket]);
+        bump(sum_ns, ns);
+        bump(count);
+    }
+};
+
+struct MetricsShard {
+    Histogram handler_time[ENDPOINT_COUNT];
+    Histogram response_time[ENDPOINT_COUNT];
+    std::atomic<uint64_t> responses[ENDPOINT_COUNT][STATUS_COUNT] = {};
+    std::atomic<uint64_t> aborted[ENDPOINT_COUNT] = {};
+    std::atomic<uint64_t> bytes_sent{0};
+    std::atomic<uint64_t> connections_opened{0};
+    std::atomic<uint64_t> connections_closed{0};
+    std::atomic<uint64_t> connections_rejected{0};
+    std::atomic<uint64_t> connections_timed_out{0};
+    Histogram catalog_lock_wait;
+    Histogram catalog_load_time;
+};
+
+// Shards outlive their threads so totals never go backwards
+std::mutex shards_mutex;
+std::deque<MetricsShard> shards;
+
+MetricsShard& localShard() {
+    thread_local MetricsShard* shard = []() {
+        std::lock_guard<std::mutex> lock(shards_mutex);
+        return &shards.emplace_back();
+    }();
+    return *shard;
+}
+
+uint64_t load(const std::atomic<uint64_t>& value) {
+    return value.load(std::memory_order_relaxed);
+}
+
+void appendHeader(std::string& out, const char* name, const char* type, const char* help) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+void appendSample(std::string& out, const char* name, const std::string& labels, double value) {
+    char number[32];
+    snprintf(number, sizeof(number), "%.10g", value);
+    out += name;
+    if (!labels.empty()) {
+        out += '{';
+        out += labels;
+        out += '}';
+    }
+    out += ' ';
+    out += number;
+    out += '\n';
+}
+
+// Sum one histogram across shards (picked by member pointer) and append it
+template <typename Select>
+void appendHistogram(std::string& out, const char* name, const std::string& labels, Select select) {
+    uint64_t buckets[BUCKET_COUNT] = {};
+    uint64_t sum_ns = 0;
+    uint64_t count = 0;
+    for (const MetricsShard& shard : shards) {
+        const Histogram& histogram = select(shard);
+        for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+            buckets[i] += load(histogram.buckets[i]);
+        }
+        sum_ns += load(histogram.sum_ns);
+        count += load(histogram.count);
+    }
+
+    std::string bucket_name = std::string(name) + "_bucket";
+    std::string prefix = labels.empty() ? "" : labels + ",";
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        cumulative += buckets[i];
+        char bound[32];
+        if (i + 1 < BUCKET_COUNT) {
+            snprintf(bound, sizeof(bound), "%g", BUCKET_BOUNDS[i]);
+        } else {
+            snprintf(bound, sizeof(bound), "+Inf");
+        }
+        appendSample(out, bucket_name.c_str(), prefix + "le=\"" + bound + "\"", static_cast<double>(cumulative));
+    }
+    appendSample(out, (std::string(name) + "_sum").c_str(), labels, sum_ns / 1e9);
+    appendSample(out, (std::string(name) + "_count").c_str(), labels, static_cast<double>(count));
+}
+
+std::string endpointLabel(size_t endpoint) {
+    return std::string("endpoint=\"") + ENDPOINT_NAMES[endpoint] + "\"";
+}
+
+}
+
+const char* endpointName(Endpoint endpoint) {
+    return ENDPOINT_NAMES[static_cast<size_t>(endpoint)];
+}
+
+void recordHandlerTime(Endpoint endpoint, std::chrono::steady_clock::duration elapsed) {
+    localShard().handler_time[static_cast<size_t>(endpoint)].observe(elapsed);
+}
+
+void recordResponse(Endpoint endpoint, int status, std::chrono::steady_clock::duration elapsed, bool completed) {
+    MetricsShard& shard = localShard();
+    size_t index = static_cast<size_t>(endpoint);
+    bump(shard.responses[index][statusIndex(status)]);
+    if (completed) {
+        shard.response_time[index].observe(elapsed);
+    } else {
+        bump(shard.aborted[index]);
+    }
+}
+
+void recordBytesSent(uint64_t bytes) {
+    bump(localShard().bytes_sent, bytes);
+}
+
+void recordConnectionOpened() {
+    bump(localShard().connections_opened);
+}
+
+void recordConnectionClosed() {
+    bump(localShard().connections_closed);
+}
+
+void recordConnectionRejected() {
+    bump(localShard().connections_rejected);
+}
+
+void recordConnectionTimedOut() {
+    bump(localShard().connections_timed_out);
+}
+
+void recordCatalogLoad(std::chrono::steady_clock::duration lock_wait, std::chrono::steady_clock::duration load_time) {
+    MetricsShard& shard = localShard();
+    shard.catalog_lock_wait.observe(lock_wait);
+    shard.catalog_load_time.observe(load_time);
+}
+
+void appendMetric(std::string& out, const char* name, const char* type, const char* help, double value) {
+    appendHeader(out, name, type, help);
+    appendSample(out, name, "", value);
+}
+
+void renderMetrics(std::string& out) {
+    std::lock_guard<std::mutex> lock(shards_mutex);
+
+    appendHeader(out, "server_responses_total", "counter", "Responses by endpoint and status code.");
+    for (size_t endpoint = 0; endpoint < ENDPOINT_COUNT; ++endpoint) {
+        for (size_t status = 0; status < STATUS_COUNT; ++status) {
+            uint64_t total = 0;
+            for (const MetricsShard& shard : shards) {
+                total += load(shard.responses[endpoint][status]);
+            }
+            if (total == 0) {
+                continue;
+            }
+            std::string code = status + 1 < STATUS_COUNT ? std::to_string(STATUS_CODES[status]) : "other";
+            appendSample(out, "server_responses_total", endpointLabel(endpoint) + ",code=\"" + code + "\"",
+                         static_cast<double>(total));
+        }
+    }
+
+    appendHeader(out, "server_responses_aborted_total", "counter", "Responses the client disconnected from before the last byte.");
+    for (size_t endpoint = 0; endpoint < ENDPOINT_COUNT; ++endpoint) {
+        uint64_t total = 0;
+        for (const MetricsShard& shard : shards) {
+            total += load(shard.aborted[endpoint]);
+        }
+        appendSample(out, "server_responses_aborted_total", endpointLabel(endpoint), static_cast<double>(total));
+    }
+
+    appendHeader(out, "server_handler_duration_seconds", "histogram", "Time spent in the request handler.");
+    for (size_t endpoint = 0; endpoint < ENDPOINT_COUNT; ++endpoint) {
+        appendHistogram(out, "server_handler_duration_seconds", endpointLabel(endpoint),
+                        [endpoint](const MetricsShard& shard) -> const Histogram& { return shard.handler_time[endpoint]; });
+    }
+
+    appendHeader(out, "server_response_duration_seconds", "histogram", "Time from a complete request to its last response byte.");
+    for (size_t endpoint = 0; endpoint < ENDPOINT_COUNT; ++endpoint) {
+        appendHistogram(out, "server_response_duration_seconds", endpointLabel(endpoint),
+                        [endpoint](const MetricsShard& shard) -> const Histogram& { return shard.response_time[endpoint]; });
+    }
+
+    uint64_t bytes_sent = 0, opened = 0, closed = 0, rejected = 0, timed_out = 0;
+    for (const MetricsShard& shard : shards) {
+        bytes_sent += load(shard.bytes_sent);
+        opened += load(shard.connections_opened);
+        closed += load(shard.connections_closed);
+        rejected += load(shard.connections_rejected);
+        timed_out += load(shard.connections_timed_out);
+    }
+    appendMetric(out, "server_bytes_sent_total", "counter", "Bytes written to client sockets.", static_cast<double>(bytes_sent));
+    appendMetric(out, "server_connections_total", "counter", "Client connections accepted.", static_cast<double>(opened));
+    appendMetric(out, "server_connections_active", "gauge", "Client connections currently open.",
+                 static_cast<double>(opened >= closed ? opened - closed : 0));
+    appendMetric(out, "server_connections_rejected_total", "counter", "Connections refused with 503 over a connection cap.",
+                 static_cast<double>(rejected));
+    appendMetric(out, "server_connections_timed_out_total", "counter", "Connections dropped by the request header or send timeout.",
+                 static_cast<double>(timed_out));
+
+    appendHeader(out, "server_catalog_lock_wait_seconds", "histogram", "Time catalog rebuilds waited for the reload lock.");
+    appendHistogram(out, "server_catalog_lock_wait_seconds", "",
+                    [](const MetricsShard& shard) -> const Histogram& { return shard.catalog_lock_wait; });
+    appendHeader(out, "server_catalog_load_seconds", "histogram", "Time taken by catalog rebuilds and updates.");
+    appendHistogram(out, "server_catalog_load_seconds", "",
+                    [](const MetricsShard& shard) -> const Histogram& { return shard.catalog_load_time; });
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+
+// Low-overhead server metrics. Every thread records into its own shard of relaxed atomics, so the
+// hot path never shares a cache line with another thread; a scrape sums the shards.
+
+enum class Endpoint {
+    Catalog,
+    Description,
+    Stream,
+    Hls,
+    Search,
+    Cluster,
+    Reload,
+    Metrics,
+    Debug,  // profiles and slow request traces
+    Shed,  // turned away with 503 while overloaded
+    NotFound,
+    BadRequest,  // rejected by the request parser
+    Count
+};
+
+// Label of an endpoint in metrics, e.g. "stream"
+const char* endpointName(Endpoint endpoint);
+
+void recordHandlerTime(Endpoint endpoint, std::chrono::steady_clock::duration elapsed);
+
+// A response finished (completed) or was cut short, measured from request start to last byte
+void recordResponse(Endpoint endpoint, int status, std::chrono::steady_clock::duration elapsed, bool completed);
+
+void recordBytesSent(uint64_t bytes);
+void recordConnectionOpened();
+void recordConnectionClosed();
+void recordConnectionRejected();  // over max_connections or max_connections_per_ip
+void recordConnectionTimedOut();  // request header or send timeout
+
+// One catalog rebuild: time spent waiting for the reload lock, then holding it
+void recordCatalogLoad(std::chrono::steady_clock::duration lock_wait, std::chrono::steady_clock::duration load_time);
+
+// Append all sharded metrics in Prometheus text exposition format
+void renderMetrics(std::string& out);
+
+// Append a single-valued metric owned by someone else (cache sizes, catalog generation...)
+void appendMetric(std::string& out, const char* name, const char* type, const char* help, double value);
@@ -0,0 +1,227 @@
+#include "pch.h"
+#include "Utils/Profiler.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+#include "Utils/CrashHandler.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <sys/time.h>
+
+namespace {
+
+constexpr int PROFILE_MAX_FRAMES = 64;
+// The innermost frames of every sample: the timer signal handler and the trampoline the kernel
+// returns from signals through. The frame after them is where the thread was interrupted.
+constexpr int PROFILE_SKIPPED_FRAMES = 2;
+// Upper bound of the sample buffer (32 MiB), whatever the rate, length and CPU count
+constexpr size_t PROFILE_MAX_SAMPLES = 64 * 1024;
+
+struct Sample {
+    int depth;
+    void* frames[PROFILE_MAX_FRAMES];
+};
+
+// Shared with the signal handler, so plain pointers and lock-free atomics only
+Sample* samples = nullptr;
+size_t sample_capacity = 0;
+std::atomic<size_t> next_sample{0};
+std::atomic<bool> sampling{false};
+std::atomic<int> handlers_running{0};
+
+std::atomic<bool> profiling{false};  // a profile is in progress, from startProfile() until done returns
+std::mutex session_mutex;
+std::condition_variable session_wake;
+bool stop_requested = false;
+std::thread session_thread;
+
+void onProfileTimer(int) {
+    int saved_errno = errno;
+    handlers_running.fetch_add(1);
+    if (sampling.load()) {
+        size_t index = next_sample.fetch_add(1);
+        if (index < sample_capacity) {
+            samples[index].depth = Paingine2D::CrashHandler::CaptureStackTrace(samples[index].frames, PROFILE_MAX_FRAMES);
+        }
+    }
+    handlers_running.fetch_sub(1);
+    errno = saved_errno;
+}
+
+// Function to name a code address: the demangled function, or module+offset when the dynamic
+// symbol table doesn't cover it
+std::string frameName(void* address) {
+    Dl_info info;
+    if (dladdr(address, &info) == 0) {
+        char hex[24];
+        snprintf(hex, sizeof(hex), "%p", address);
+        return hex;
+    }
+    std::string name;
+    if (info.dli_sname != nullptr) {
+        int status = 0;
+        char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        name = status == 0 ? demangled : info.dli_sname;
+        free(demangled);
+    } else {
+        const char* module = info.dli_fname ? info.dli_fname : "?";
+        const char* slash = strrchr(module, '/');
+        char offset[24];
+        snprintf(offset, sizeof(offset), "+0x%zx", static_cast<size_t>(static_cast<char*>(address) - static_cast<char*>(info.dli_fbase)));
+        name = std::string(slash ? slash + 1 : module) + offset;
+    }
+    // ';' separates frames in the folded format
+    std::replace(name.begin(), name.end(), ';', ':');
+    return name;
+}
+
+// Function to fold collected samples into one line per distinct stack
+std::string foldSamples(const Sample* collected, size_t count) {
+    std::unordered_map<void*, std::string> names;
+    std::map<std::string, uint64_t> stacks;
+    std::string stack;
+    for (size_t i = 0; i < count; ++i) {
+        const Sample& sample = collected[i];
+        stack.clear();
+        // Return addresses point just past their call, so look up the byte before to land in the
+        // calling function even when the call is its last instruction; the interrupted frame is exact
+        for (int frame = sample.depth - 1; frame >= PROFILE_SKIPPED_FRAMES; --frame) {
+            void* address = sample.frames[frame];
+            void* lookup = frame == PROFILE_SKIPPED_FRAMES ? address : static_cast<char*>(address) - 1;
+            auto it = names.find(lookup);
+            if (it == names.end()) {
+                it = names.emplace(lookup, frameName(lookup)).first;
+            }
+            if (!stack.empty()) {
+                stack += ';';
+            }
+            stack += it->second;
+        }
+        if (!stack.empty()) {
+            stacks[stack]++;
+        }
+    }
+
+    std::string folded;
+    for (const auto& [folded_stack, samples_in_stack] : stacks) {
+        folded += folded_stack;
+        folded += ' ';
+        folded += std::to_string(samples_in_stack);
+        folded += '\n';
+    }
+    return folded;
+}
+
+void runProfile(unsigned seconds, unsigned hz, std::function<void(ProfileResult)> done) {
+    size_t capacity = std::min<size_t>(size_t(hz) * seconds * std::max(1u, std::thread::hardware_concurrency()),
+                                       PROFILE_MAX_SAMPLES);
+    std::unique_ptr<Sample[]> buffer(new Sample[capacity]);
+    samples = buffer.get();
+    sample_capacity = capacity;
+    next_sample = 0;
+
+    // The first capture loads the unwinder, which must not happen inside the signal handler.
+    // The handler stays installed afterwards: a timer signal still pending when a profile ends is
+    // then ignored rather than taking the default action, which ends the process.
+    void* warm_up[1];
+    Paingine2D::CrashHandler::CaptureStackTrace(warm_up, 1);
+    static std::once_flag install_handler;
+    std::call_once(install_handler, [] {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = onProfileTimer;
+        action.sa_flags = SA_RESTART;  // interrupted blocking calls resume instead of failing with EINTR
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGPROF, &action, nullptr);
+    });
+
+    ProfileResult result;
+    sampling = true;
+    itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    unsigned interval_us = 1000000 / hz;
+    timer.it_interval.tv_sec = interval_us / 1000000;  // tv_usec must stay below a second
+    timer.it_interval.tv_usec = static_cast<suseconds_t>(interval_us % 1000000);
+    timer.it_value = timer.it_interval;
+    if (setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+        sampling = false;
+        result.error = std::string("Failed to start the profiling timer: ") + strerror(errno);
+        samples = nullptr;
+        sample_capacity = 0;
+        done(std::move(result));
+        profiling = false;
+        return;
+    }
+    {
+        std::unique_lock<std::mutex> lock(session_mutex);
+        session_wake.wait_for(lock, std::chrono::seconds(seconds), [] { return stop_requested; });
+    }
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    sampling = false;
+    while (handlers_running.load() != 0) {
+        std::this_thread::yield();
+    }
+
+    size_t taken = next_sample.load();
+    result.samples = std::min(taken, capacity);
+    result.dropped = taken - result.samples;
+    result.folded = foldSamples(buffer.get(), result.samples);
+    samples = nullptr;
+    sample_capacity = 0;
+    buffer.reset();
+
+    done(std::move(result));
+    profiling = false;
+}
+
+}
+
+bool profilerAvailable() {
+    return true;
+}
+
+bool startProfile(unsigned seconds, unsigned hz, std::function<void(ProfileResult)> done, std::string& error) {
+    if (profiling.exchange(true)) {
+        error = "A profile is already running";
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(session_mutex);
+    if (session_thread.joinable()) {
+        session_thread.join();  // the previous profile's, which is past its last use of the lock
+    }
+    stop_requested = false;
+    session_thread = std::thread(runProfile, seconds, hz, std::move(done));
+    return true;
+}
+
+void stopProfiler() {
+    std::thread finishing;
+    {
+        std::lock_guard<std::mutex> lock(session_mutex);
+        stop_requested = true;
+        finishing.swap(session_thread);
+    }
+    session_wake.notify_all();
+    if (finishing.joinable()) {
+        finishing.join();
+    }
+}
+
+#else
+
+bool profilerAvailable() {
+    return false;
+}
+
+bool startProfile(unsigned, unsigned, std::function<void(ProfileResult)>, std::string& error) {
+    error = "Sampling profiles aren't supported on this platform";
+    return false;
+}
+
+void stopProfiler() {
+}
+
+#endif
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+// On-demand sampling profiler. While a profile runs, a CPU-time timer interrupts whichever threads
+// are using CPU (so mostly the event loops) and the signal handler records their stacks with
+// CrashHandler::CaptureStackTrace into a preallocated buffer; nothing is locked or allocated then.
+// Symbols are resolved once the profile ends. Names come from the dynamic symbol table, so
+// functions with internal linkage show up as module+offset (resolve them with addr2line).
+
+struct ProfileResult {
+    std::string folded;  // "outermost;...;innermost count" lines, the input of flamegraph.pl and speedscope
+    uint64_t samples = 0;
+    uint64_t dropped = 0;  // taken after the sample buffer filled up
+    std::string error;     // set, with nothing sampled, when the profile couldn't run
+};
+
+// Whether this platform can sample stacks (Linux and macOS)
+bool profilerAvailable();
+
+// Function to sample every thread's stack hz times per CPU second for seconds on a background
+// thread, then call done with the result from that thread. Only one profile runs at a time:
+// returns false with error if another one is in progress or the platform can't sample.
+bool startProfile(unsigned seconds, unsigned hz, std::function<void(ProfileResult)> done, std::string& error);
+
+// Function to end a running profile early and wait for its thread; its result is still delivered
+void stopProfiler();
@@ -0,0 +1,79 @@
+#include "pch.h"
+#include "Utils/Trace.h"
+#include "Utils/Json.h"
+#include "Utils/Logger.h"
+
+namespace {
+
+const char* const SPAN_NAMES[static_cast<size_t>(TraceSpan::Count)] = {"parse", "catalog", "open", "handler", "send"};
+
+struct SlowRequest {
+    int64_t time_ms;  // Unix time the request finished
+    std::string client_ip;
+    std::string method;
+    std::string target;
+    int status;
+    Endpoint endpoint;
+    uint64_t span_us[static_cast<size_t>(TraceSpan::Count)];
+};
+
+// Slow requests are rare, so one lock around a small ring is plenty
+std::mutex slow_mutex;
+std::deque<SlowRequest> slow_requests;  // newest first
+
+uint64_t micros(std::chrono::steady_clock::duration elapsed) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+}
+
+}
+
+void recordSlowRequest(std::string_view client_ip, std::string_view method, std::string_view target, int status,
+                       Endpoint endpoint, const RequestTrace& trace) {
+    SlowRequest slow;
+    slow.time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                       std::chrono::system_clock::now().time_since_epoch()).count();
+    slow.client_ip = client_ip;
+    slow.method = method;
+    slow.target = target;
+    slow.status = status;
+    slow.endpoint = endpoint;
+    for (size_t i = 0; i < static_cast<size_t>(TraceSpan::Count); ++i) {
+        slow.span_us[i] = micros(trace.spans[i]);
+    }
+
+    logMessage(LogLevel::Warning,
+               "Slow request %.*s %.*s: status=%d parse_us=%llu catalog_us=%llu open_us=%llu handler_us=%llu send_us=%llu",
+               static_cast<int>(method.size()), method.data(), static_cast<int>(target.size()), target.data(), status,
+               static_cast<unsigned long long>(slow.span_us[0]), static_cast<unsigned long long>(slow.span_us[1]),
+               static_cast<unsigned long long>(slow.span_us[2]), static_cast<unsigned long long>(slow.span_us[3]),
+               static_cast<unsigned long long>(slow.span_us[4]));
+
+    std::lock_guard<std::mutex> lock(slow_mutex);
+    slow_requests.push_front(std::move(slow));
+    if (slow_requests.size() > SLOW_REQUEST_HISTORY) {
+        slow_requests.pop_back();
+    }
+}
+
+void renderSlowRequests(std::string& out) {
+    std::lock_guard<std::mutex> lock(slow_mutex);
+    out += '[';
+    for (const SlowRequest& slow : slow_requests) {
+        if (&slow != &slow_requests.front()) {
+            out += ", ";
+        }
+        out += "{\"time_ms\": " + std::to_string(slow.time_ms) + ", \"client\": ";
+        appendJsonString(out, slow.client_ip);
+        out += ", \"method\": ";
+        appendJsonString(out, slow.method);
+        out += ", \"target\": ";
+        appendJsonString(out, slow.target);
+        out += ", \"status\": " + std::to_string(slow.status) + ", \"endpoint\": \"" + endpointName(slow.endpoint) +
+               "\", \"spans_us\": {";
+        for (size_t i = 0; i < static_cast<size_t>(TraceSpan::Count); ++i) {
+            out += (i > 0 ? ", \"" : "\"") + std::string(SPAN_NAMES[i]) + "\": " + std::to_string(slow.span_us[i]);
+        }
+        out += "}}";
+    }
+    out += ']';
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Utils/Metrics.h"
+
+#include <string>
+
+// Per-request trace spans. While slow_request_ms is set, the loop and the handlers time the phases
+// of every request into its connection's RequestTrace. A request whose server time (parse plus
+// handler) reaches the threshold is logged with its spans and kept for /debug/slow.
+
+enum class TraceSpan {
+    Parse,    // in the request parser, over every read the request took
+    Catalog,  // looking the track up in the catalog snapshot
+    Open,     // opening the file through the file cache
+    Handler,  // the whole request handler, the two above included
+    Send,     // from the handler returning to the last byte written
+    Count
+};
+
+struct RequestTrace {
+    bool enabled = false;
+    std::chrono::steady_clock::duration spans[static_cast<size_t>(TraceSpan::Count)] = {};
+    std::chrono::steady_clock::time_point handler_done;  // where the Send span starts
+
+    void reset(bool on) {
+        enabled = on;
+        for (auto& span : spans) {
+            span = {};
+        }
+    }
+    void add(TraceSpan span, std::chrono::steady_clock::duration elapsed) { spans[static_cast<size_t>(span)] += elapsed; }
+    std::chrono::steady_clock::duration operator[](TraceSpan span) const { return spans[static_cast<size_t>(span)]; }
+};
+
+// Times the enclosing scope into one span of a trace; costs a branch when the trace is off
+class TraceScope {
+public:
+    TraceScope(RequestTrace& trace, TraceSpan span) : trace(trace.enabled ? &trace : nullptr), span(span) {
+        if (this->trace) {
+            started = std::chrono::steady_clock::now();
+        }
+    }
+    ~TraceScope() {
+        if (trace) {
+            trace->add(span, std::chrono::steady_clock::now() - started);
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    RequestTrace* trace;
+    TraceSpan span;
+    std::chrono::steady_clock::time_point started;
+};
+
+// Slow requests kept for /debug/slow; older ones are forgotten
+constexpr size_t SLOW_REQUEST_HISTORY = 64;
+
+// Function to log a finished request that crossed the slow threshold and keep it for /debug/slow
+void recordSlowRequest(std::string_view client_ip, std::string_view method, std::string_view target, int status,
+                       Endpoint endpoint, const RequestTrace& trace);
+
+// Function to append the kept slow requests, newest first, as a JSON array
+void renderSlowRequests(std::string& out);
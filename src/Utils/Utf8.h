@@ -0,0 +1,17 @@
+#pragma once
+
+// UTF-8 conversion utilities
+// Convert from UTF-8 string to std::u8string
+inline std::u8string toUtf8(const std::string& str) {
+    return std::u8string(reinterpret_cast<const char8_t*>(str.c_str()));
+}
+
+// Convert from std::u8string to UTF-8 string
+inline std::string fromUtf8(const std::u8string& u8str) {
+    return std::string(reinterpret_cast<const char*>(u8str.c_str()));
+}
+
+// View UTF-8 text's bytes as a plain string_view, without copying
+inline std::string_view viewUtf8(std::u8string_view u8str) {
+    return std::string_view(reinterpret_cast<const char*>(u8str.data()), u8str.size());
+}
@@ -5,11 +5,17 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <list>
 #include <filesystem>
 #include <cstring>
 #include <thread>
 #include <mutex>
 #include <unordered_map>
+#include <deque>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <chrono>
 #include <nlohmann/json.hpp>
 
 // Socket headers
@@ -20,14 +26,20 @@
 	typedef SOCKET socket_t;
 	#define SOCKET_ERROR_CODE SOCKET_ERROR
 	#define CLOSE_SOCKET(s) closesocket(s)
+	#define SOCKET_LAST_ERROR WSAGetLastError()
+	#define SOCKET_WOULD_BLOCK(e) ((e) == WSAEWOULDBLOCK)
+	#define MSG_NOSIGNAL 0
 #else
 	#include <sys/socket.h>
 	#include <netinet/in.h>
 	#include <arpa/inet.h>
 	#include <unistd.h>
 	#include <fcntl.h>
+	#include <cerrno>
 	typedef int socket_t;
 	#define INVALID_SOCKET -1
 	#define SOCKET_ERROR_CODE -1
 	#define CLOSE_SOCKET(s) close(s)
+	#define SOCKET_LAST_ERROR errno
+	#define SOCKET_WOULD_BLOCK(e) ((e) == EAGAIN || (e) == EWOULDBLOCK)
 #endif
\ No newline at end of file